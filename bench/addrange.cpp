@@ -0,0 +1,181 @@
+// Times Sprite::Add against both Sprite::AddRange overloads, with GL stubbed
+// into plain memory so only the packing and the stores are measured. Build it
+// once per instruction set from the repository root:
+//
+//      g++ -std=c++17 -O2                  -Ibench/stub -I. petit2d.cpp bench/glstub.cpp bench/addrange.cpp -lpthread -o addrange_sse2
+//      g++ -std=c++17 -O2 -mavx2 -mf16c    -Ibench/stub -I. petit2d.cpp bench/glstub.cpp bench/addrange.cpp -lpthread -o addrange_avx2
+//      g++ -std=c++17 -O2 -DPETIT2D_NO_SIMD -Ibench/stub -I. petit2d.cpp bench/glstub.cpp bench/addrange.cpp -lpthread -o addrange_scalar
+//
+// and run it as addrange [compact]. It fails when an AddRange overload draws
+// other instances than Add or, in the SIMD builds, is slower than it.
+
+#include "petit2d.h"
+#include "glstub.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <vector>
+
+#define SPRITE_COUNT                    200000
+#define BATCH_CAPACITY                  16384
+#define RUN_COUNT                       20
+
+struct Columns
+{
+    std::vector<float>          x, y, s, t, p, q, scale_x, scale_y, rotation;
+    std::vector<int>            width, height;
+    std::vector<unsigned char>  r, g, b, a;
+};
+
+double measure(const std::function<void()>& submit)
+{
+    // Best of the runs without capture, then one more run keeping the draws for
+    // the comparison.
+    GLStub::SetCapture(false);
+    auto best = 0.0;
+    for (auto run=0; run<RUN_COUNT; ++run)
+    {
+        Petit2D::Sprite::Begin();
+        auto start = std::chrono::steady_clock::now();
+        submit();
+        Petit2D::Sprite::End();
+        Petit2D::Sprite::Render();
+        auto time = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        best = run == 0 || time < best ? time : best;
+    }
+
+    GLStub::SetCapture(true);
+    GLStub::ClearDraws();
+    Petit2D::Sprite::Begin();
+    submit();
+    Petit2D::Sprite::End();
+    Petit2D::Sprite::Render();
+    return best;
+}
+
+bool sameDraws(const std::vector<GLStub::Draw>& a, const std::vector<GLStub::Draw>& b)
+{
+    if (a.size() != b.size())
+    {
+        return false;
+    }
+
+    for (size_t i=0; i<a.size(); ++i)
+    {
+        if (a[i].count != b[i].count || a[i].instances != b[i].instances)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    Petit2D::Config config;
+    config.maxSpritesPerBatch = BATCH_CAPACITY;
+    config.spriteLayout = argc > 1 && strcmp(argv[1], "compact") == 0 ? Petit2D::SpriteLayout::COMPACT : Petit2D::SpriteLayout::PRECISE;
+    Petit2D::Create(config);
+    Petit2D::Sprite::Use();
+
+    // Translations stay in range: Add wraps the compact ones, AddRange saturates.
+    srand(1);
+    std::vector<Petit2D::Sprite::Sprite> sprites(SPRITE_COUNT);
+    Columns columns;
+    for (auto& sprite : sprites)
+    {
+        sprite.x = (rand() % 4000) * 0.5f;
+        sprite.y = (rand() % 4000) * 0.5f;
+        sprite.s = (rand() % 16) / 16.0f;
+        sprite.t = (rand() % 16) / 16.0f;
+        sprite.p = sprite.s + 1.0f / 16.0f;
+        sprite.q = sprite.t + 1.0f / 16.0f;
+        sprite.r = static_cast<unsigned char>(rand());
+        sprite.scale_x = 1.0f + (rand() % 4) * 0.25f;
+        sprite.scale_y = sprite.scale_x;
+        sprite.rotation = static_cast<float>(rand() % 360);
+        sprite.width = 16 + rand() % 16;
+        sprite.height = 16 + rand() % 16;
+
+        columns.x.push_back(sprite.x);
+        columns.y.push_back(sprite.y);
+        columns.s.push_back(sprite.s);
+        columns.t.push_back(sprite.t);
+        columns.p.push_back(sprite.p);
+        columns.q.push_back(sprite.q);
+        columns.r.push_back(sprite.r);
+        columns.g.push_back(sprite.g);
+        columns.b.push_back(sprite.b);
+        columns.a.push_back(sprite.a);
+        columns.scale_x.push_back(sprite.scale_x);
+        columns.scale_y.push_back(sprite.scale_y);
+        columns.rotation.push_back(sprite.rotation);
+        columns.width.push_back(sprite.width);
+        columns.height.push_back(sprite.height);
+    }
+
+    Petit2D::Sprite::SpriteArrays arrays;
+    arrays.x = columns.x.data();
+    arrays.y = columns.y.data();
+    arrays.s = columns.s.data();
+    arrays.t = columns.t.data();
+    arrays.p = columns.p.data();
+    arrays.q = columns.q.data();
+    arrays.r = columns.r.data();
+    arrays.g = columns.g.data();
+    arrays.b = columns.b.data();
+    arrays.a = columns.a.data();
+    arrays.scale_x = columns.scale_x.data();
+    arrays.scale_y = columns.scale_y.data();
+    arrays.rotation = columns.rotation.data();
+    arrays.width = columns.width.data();
+    arrays.height = columns.height.data();
+
+    auto add = measure([&]()
+    {
+        for (const auto& sprite : sprites)
+        {
+            Petit2D::Sprite::Add(sprite);
+        }
+    });
+    auto reference = GLStub::GetDraws();
+
+    auto addRange = measure([&]()
+    {
+        Petit2D::Sprite::AddRange(sprites.data(), sprites.size());
+    });
+    auto sameAddRange = sameDraws(reference, GLStub::GetDraws());
+
+    auto addRangeArrays = measure([&]()
+    {
+        Petit2D::Sprite::AddRange(arrays, SPRITE_COUNT);
+    });
+    auto sameAddRangeArrays = sameDraws(reference, GLStub::GetDraws());
+
+#if defined(PETIT2D_NO_SIMD)
+    const char* build = "scalar";
+#elif defined(__AVX2__)
+    const char* build = "avx2";
+#else
+    const char* build = "sse2";
+#endif
+
+    printf("%s, %s layout, %d sprites, best of %d runs\n", build, argc > 1 ? argv[1] : "precise", SPRITE_COUNT, RUN_COUNT);
+    printf("  Add                     %7.3f ms\n", add);
+    printf("  AddRange(Sprite*)       %7.3f ms  x%.2f  %s\n", addRange, add / addRange, sameAddRange ? "same" : "DIFFERENT");
+    printf("  AddRange(SpriteArrays)  %7.3f ms  x%.2f  %s\n", addRangeArrays, add / addRangeArrays, sameAddRangeArrays ? "same" : "DIFFERENT");
+
+    Petit2D::Destroy();
+
+    // The scalar build is the baseline the kernels are measured against, it
+    // only has to draw the same instances.
+#if defined(PETIT2D_NO_SIMD)
+    auto passed = sameAddRange && sameAddRangeArrays;
+#else
+    auto passed = sameAddRange && sameAddRangeArrays && addRange < add && addRangeArrays < add;
+#endif
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,497 @@
+#include "glstub.h"
+
+#include <map>
+#include <cstdlib>
+#include <cstring>
+#include <glad/glad.h>
+#include <stb_image.h>
+
+#define ARENA_SIZE                      (64 << 20)
+
+namespace GLStub
+{
+
+//-----------------------------------------------------------------------------
+// [SECTION] GLStub - Context
+//-----------------------------------------------------------------------------
+
+// Storage moves to the next slice of an arena larger than the caches when it
+// is invalidated, as a driver hands out fresh memory on orphaning, so streamed
+// instances never land in cache resident lines between frames.
+struct Buffer
+{
+    std::vector<unsigned char>  arena;
+    size_t                      size    = 0;
+    size_t                      base    = 0;
+
+    unsigned char* data()
+    {
+        return arena.data() + base;
+    }
+};
+
+struct VertexArray
+{
+    GLuint  buffer  = 0;
+    GLsizei stride  = 0;
+};
+
+struct Context
+{
+    std::map<GLuint, Buffer>                        buffers;
+    std::map<GLuint, VertexArray>                   vertexArrays;
+    std::vector<Draw>                               draws;
+    GLuint                                          nextId          = 1;
+    GLuint                                          arrayBuffer     = 0;
+    GLuint                                          vertexArray     = 0;
+    bool                                            capture         = true;
+} g_context;
+
+//-----------------------------------------------------------------------------
+// [SECTION] GLStub - Private functions
+//-----------------------------------------------------------------------------
+
+void generate(GLsizei n, GLuint* ids)
+{
+    for (auto i=0; i<n; ++i)
+    {
+        ids[i] = g_context.nextId++;
+    }
+}
+
+Buffer& resize(GLsizeiptr size)
+{
+    auto& buffer = g_context.buffers[g_context.arrayBuffer];
+    if (buffer.size < static_cast<size_t>(size))
+    {
+        buffer.size = size;
+    }
+
+    if (buffer.arena.size() < buffer.base + buffer.size)
+    {
+        buffer.arena.resize(buffer.base + buffer.size);
+    }
+    return buffer;
+}
+
+void orphan()
+{
+    auto& buffer = g_context.buffers[g_context.arrayBuffer];
+    if (buffer.arena.size() < ARENA_SIZE)
+    {
+        buffer.arena.resize(ARENA_SIZE);
+    }
+
+    buffer.base += (buffer.size + 63) & ~static_cast<size_t>(63);
+    if (buffer.base + buffer.size > buffer.arena.size())
+    {
+        buffer.base = 0;
+    }
+}
+
+//-----------------------------------------------------------------------------
+// [SECTION] GLStub - End-user API functions
+//-----------------------------------------------------------------------------
+
+void SetCapture(bool capture)
+{
+    g_context.capture = capture;
+}
+
+const std::vector<Draw>& GetDraws()
+{
+    return g_context.draws;
+}
+
+void ClearDraws()
+{
+    g_context.draws.clear();
+}
+
+} // namespace GLStub
+
+//-----------------------------------------------------------------------------
+// [SECTION] GL entry points
+//-----------------------------------------------------------------------------
+
+// Reports a 0.0 context: Petit2D streams through glMapBufferRange, the buffer
+// storage path is not taken.
+void glGetIntegerv(GLenum, GLint* data)
+{
+    *data = 0;
+}
+
+void glGenBuffers(GLsizei n, GLuint* buffers)
+{
+    GLStub::generate(n, buffers);
+}
+
+void glGenVertexArrays(GLsizei n, GLuint* arrays)
+{
+    GLStub::generate(n, arrays);
+}
+
+void glGenTextures(GLsizei n, GLuint* textures)
+{
+    GLStub::generate(n, textures);
+}
+
+void glGenFramebuffers(GLsizei n, GLuint* framebuffers)
+{
+    GLStub::generate(n, framebuffers);
+}
+
+void glGenRenderbuffers(GLsizei n, GLuint* renderbuffers)
+{
+    GLStub::generate(n, renderbuffers);
+}
+
+void glDeleteBuffers(GLsizei n, const GLuint* buffers)
+{
+    for (auto i=0; i<n; ++i)
+    {
+        GLStub::g_context.buffers.erase(buffers[i]);
+    }
+}
+
+void glDeleteVertexArrays(GLsizei n, const GLuint* arrays)
+{
+    for (auto i=0; i<n; ++i)
+    {
+        GLStub::g_context.vertexArrays.erase(arrays[i]);
+    }
+}
+
+void glBindBuffer(GLenum target, GLuint buffer)
+{
+    if (target == GL_ARRAY_BUFFER)
+    {
+        GLStub::g_context.arrayBuffer = buffer;
+    }
+}
+
+void glBindVertexArray(GLuint array)
+{
+    GLStub::g_context.vertexArray = array;
+}
+
+void glBufferData(GLenum target, GLsizeiptr size, const void* data, GLenum)
+{
+    if (target == GL_ARRAY_BUFFER)
+    {
+        GLStub::orphan();
+        auto& buffer = GLStub::resize(size);
+        if (data != nullptr)
+        {
+            memcpy(buffer.data(), data, size);
+        }
+    }
+}
+
+void glBufferStorage(GLenum target, GLsizeiptr size, const void*, GLbitfield)
+{
+    if (target == GL_ARRAY_BUFFER)
+    {
+        GLStub::resize(size);
+    }
+}
+
+void glBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const void* data)
+{
+    if (target == GL_ARRAY_BUFFER && data != nullptr)
+    {
+        auto& buffer = GLStub::resize(offset + size);
+        memcpy(buffer.data() + offset, data, size);
+    }
+}
+
+void* glMapBufferRange(GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access)
+{
+    if (target != GL_ARRAY_BUFFER)
+    {
+        return nullptr;
+    }
+
+    GLStub::resize(offset + length);
+    if (offset == 0 && (access & (GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_INVALIDATE_RANGE_BIT)) != 0)
+    {
+        GLStub::orphan();
+    }
+    return GLStub::resize(offset + length).data() + offset;
+}
+
+GLboolean glUnmapBuffer(GLenum)
+{
+    return GL_TRUE;
+}
+
+void glVertexAttribPointer(GLuint, GLint, GLenum, GLboolean, GLsizei stride, const void*)
+{
+    auto& vertexArray = GLStub::g_context.vertexArrays[GLStub::g_context.vertexArray];
+    vertexArray.buffer = GLStub::g_context.arrayBuffer;
+    vertexArray.stride = stride;
+}
+
+void glDrawArraysInstanced(GLenum, GLint, GLsizei, GLsizei instancecount)
+{
+    // Instance attributes start at offset 0 without buffer storage.
+    if (!GLStub::g_context.capture)
+    {
+        return;
+    }
+
+    auto it = GLStub::g_context.vertexArrays.find(GLStub::g_context.vertexArray);
+    if (it == GLStub::g_context.vertexArrays.end() || it->second.stride == 0)
+    {
+        return;
+    }
+
+    auto& buffer = GLStub::g_context.buffers[it->second.buffer];
+    auto size = static_cast<size_t>(it->second.stride) * instancecount;
+    size = size < buffer.size ? size : buffer.size;
+
+    GLStub::Draw draw;
+    draw.count = instancecount;
+    draw.instances.assign(buffer.data(), buffer.data() + size);
+    GLStub::g_context.draws.push_back(draw);
+}
+
+GLuint glCreateShader(GLenum)
+{
+    return GLStub::g_context.nextId++;
+}
+
+GLuint glCreateProgram()
+{
+    return GLStub::g_context.nextId++;
+}
+
+void glGetShaderiv(GLuint, GLenum, GLint* params)
+{
+    *params = GL_TRUE;
+}
+
+void glGetProgramiv(GLuint, GLenum, GLint* params)
+{
+    *params = GL_TRUE;
+}
+
+GLenum glCheckFramebufferStatus(GLenum)
+{
+    return GL_FRAMEBUFFER_COMPLETE;
+}
+
+GLsync glFenceSync(GLenum, GLbitfield)
+{
+    return nullptr;
+}
+
+GLenum glClientWaitSync(GLsync, GLbitfield, GLuint64)
+{
+    return GL_ALREADY_SIGNALED;
+}
+
+void glActiveTexture(GLenum)
+{
+}
+
+void glAttachShader(GLuint, GLuint)
+{
+}
+
+void glBindFramebuffer(GLenum, GLuint)
+{
+}
+
+void glBindRenderbuffer(GLenum, GLuint)
+{
+}
+
+void glBindTexture(GLenum, GLuint)
+{
+}
+
+void glBlendFunc(GLenum, GLenum)
+{
+}
+
+void glClear(GLbitfield)
+{
+}
+
+void glClearColor(GLfloat, GLfloat, GLfloat, GLfloat)
+{
+}
+
+void glCompileShader(GLuint)
+{
+}
+
+void glCompressedTexImage2D(GLenum, GLint, GLenum, GLsizei, GLsizei, GLint, GLsizei, const void*)
+{
+}
+
+void glCullFace(GLenum)
+{
+}
+
+void glDeleteFramebuffers(GLsizei, const GLuint*)
+{
+}
+
+void glDeleteProgram(GLuint)
+{
+}
+
+void glDeleteRenderbuffers(GLsizei, const GLuint*)
+{
+}
+
+void glDeleteShader(GLuint)
+{
+}
+
+void glDeleteSync(GLsync)
+{
+}
+
+void glDeleteTextures(GLsizei, const GLuint*)
+{
+}
+
+void glDisable(GLenum)
+{
+}
+
+void glDrawArrays(GLenum, GLint, GLsizei)
+{
+}
+
+void glDrawElements(GLenum, GLsizei, GLenum, const void*)
+{
+}
+
+void glEnable(GLenum)
+{
+}
+
+void glEnableVertexAttribArray(GLuint)
+{
+}
+
+void glFlushMappedBufferRange(GLenum, GLintptr, GLsizeiptr)
+{
+}
+
+void glFramebufferRenderbuffer(GLenum, GLenum, GLenum, GLuint)
+{
+}
+
+void glFramebufferTexture2D(GLenum, GLenum, GLenum, GLuint, GLint)
+{
+}
+
+GLint glGetAttribLocation(GLuint, const GLchar*)
+{
+    return 0;
+}
+
+void glGetProgramInfoLog(GLuint, GLsizei, GLsizei*, GLchar*)
+{
+}
+
+void glGetShaderInfoLog(GLuint, GLsizei, GLsizei*, GLchar*)
+{
+}
+
+const GLubyte* glGetStringi(GLenum, GLuint)
+{
+    return nullptr;
+}
+
+GLint glGetUniformLocation(GLuint, const GLchar*)
+{
+    return 0;
+}
+
+void glLineWidth(GLfloat)
+{
+}
+
+void glLinkProgram(GLuint)
+{
+}
+
+void glPixelStorei(GLenum, GLint)
+{
+}
+
+void glPointSize(GLfloat)
+{
+}
+
+void glRenderbufferStorage(GLenum, GLenum, GLsizei, GLsizei)
+{
+}
+
+void glShaderSource(GLuint, GLsizei, const GLchar* const*, const GLint*)
+{
+}
+
+void glTexBuffer(GLenum, GLenum, GLuint)
+{
+}
+
+void glTexImage2D(GLenum, GLint, GLint, GLsizei, GLsizei, GLint, GLenum, GLenum, const void*)
+{
+}
+
+void glTexParameteri(GLenum, GLenum, GLint)
+{
+}
+
+void glTexSubImage2D(GLenum, GLint, GLint, GLint, GLsizei, GLsizei, GLenum, GLenum, const void*)
+{
+}
+
+void glUniform1f(GLint, GLfloat)
+{
+}
+
+void glUniform1i(GLint, GLint)
+{
+}
+
+void glUniform2fv(GLint, GLsizei, const GLfloat*)
+{
+}
+
+void glUniform4fv(GLint, GLsizei, const GLfloat*)
+{
+}
+
+void glUniformMatrix4fv(GLint, GLsizei, GLboolean, const GLfloat*)
+{
+}
+
+void glUseProgram(GLuint)
+{
+}
+
+void glVertexAttribDivisor(GLuint, GLuint)
+{
+}
+
+void glViewport(GLint, GLint, GLsizei, GLsizei)
+{
+}
+
+unsigned char* stbi_load(const char*, int*, int*, int*, int)
+{
+    return nullptr;
+}
+
+void stbi_image_free(void* data)
+{
+    free(data);
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <vector>
+
+namespace GLStub
+{
+
+//-----------------------------------------------------------------------------
+// [SECTION] GLStub - Forward declarations and basic types
+//-----------------------------------------------------------------------------
+
+struct          Draw;
+
+//-----------------------------------------------------------------------------
+// [SECTION] GLStub - End-user API functions
+//-----------------------------------------------------------------------------
+
+// Buffers live in plain memory. While capturing, every instanced draw keeps a
+// copy of the instances it read, in draw order.
+void                        SetCapture  (bool capture);
+const std::vector<Draw>&    GetDraws    ();
+void                        ClearDraws  ();
+
+} // namespace GLStub
+
+//-----------------------------------------------------------------------------
+// [SECTION] GLStub - Public declarations and basic types
+//-----------------------------------------------------------------------------
+
+struct GLStub::Draw
+{
+    std::vector<unsigned char>  instances;
+    int                         count       = 0;
+};
@@ -0,0 +1,8 @@
+#pragma once
+
+// Stands in for the glad loader in the bench builds: the GL entry points are
+// plain functions, defined by bench/glstub.cpp.
+#define GL_GLEXT_PROTOTYPES
+#include <GL/glcorearb.h>
+
+#define GLAD_GL_VERSION_4_4 1
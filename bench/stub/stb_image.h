@@ -0,0 +1,5 @@
+#pragma once
+
+// Image loading is not benchmarked, bench/glstub.cpp loads nothing.
+unsigned char*  stbi_load       (const char* filename, int* x, int* y, int* channels, int desired_channels);
+void            stbi_image_free (void* data);
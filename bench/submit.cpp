@@ -0,0 +1,185 @@
+// Checks that sprites recorded on the PetitTask threads draw exactly what the
+// serial path draws, retained batches included, and that cached text runs draw
+// the same wherever the batch they land in is, with GL stubbed into plain
+// memory. Build it from the repository root:
+//
+//      g++ -std=c++17 -O2 -Ibench/stub -I. petit2d.cpp petittask.cpp petittext.cpp bench/glstub.cpp bench/submit.cpp -lpthread -o submit
+//
+// It exits non-zero on the first case that differs.
+
+#include "petit2d.h"
+#include "petittask.h"
+#include "petitactor.h"
+#include "petittext.h"
+#include "glstub.h"
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#define BATCH_CAPACITY                  8
+
+struct Sprites : public PetitActor::Actor::SpriteVectorActor
+{
+    Sprites(int count, float x, bool retained)
+    {
+        isAlive = true;
+        isVisible = true;
+        for (auto i=0; i<count; ++i)
+        {
+            Petit2D::Sprite::Sprite sprite;
+            sprite.x = x + i;
+            sprite.y = static_cast<float>(i);
+            sprite.width = 8;
+            sprite.height = 8;
+            sprite.rotation = x * 10.0f + i;
+            target.push_back(sprite);
+        }
+        setRetained(retained);
+    }
+
+    virtual void update(float) override
+    {
+    }
+};
+
+std::vector<GLStub::Draw> capture(PetitActor::Layer::SpriteLayer& layer, int before, bool parallel, int grain)
+{
+    // Sprites added first leave the batch at any count, so the recorded ones
+    // cross flushes and replayed batch draws at every alignment.
+    GLStub::ClearDraws();
+    Petit2D::Sprite::Begin();
+    for (auto i=0; i<before; ++i)
+    {
+        Petit2D::Sprite::Sprite sprite;
+        sprite.x = -1.0f - i;
+        Petit2D::Sprite::Add(sprite);
+    }
+
+    if (parallel)
+    {
+        layer.renderParallel(grain);
+    }
+    else
+    {
+        layer.render();
+    }
+
+    Petit2D::Sprite::End();
+    Petit2D::Sprite::Render();
+    return GLStub::GetDraws();
+}
+
+std::vector<unsigned char> captureText(const PetitText::Run* run, int before, size_t stride)
+{
+    // Runs drawn at the origin take the plain copy, the other positions move
+    // the translations on the way. Only the run instances are kept.
+    GLStub::ClearDraws();
+    Petit2D::Sprite::Begin();
+    for (auto i=0; i<before; ++i)
+    {
+        Petit2D::Sprite::Add(Petit2D::Sprite::Sprite());
+    }
+
+    PetitText::Draw(run, 0.0f, 0.0f);
+    Petit2D::Sprite::End();
+    Petit2D::Sprite::Render();
+
+    std::vector<unsigned char> instances;
+    for (const auto& draw : GLStub::GetDraws())
+    {
+        instances.insert(instances.end(), draw.instances.begin(), draw.instances.end());
+    }
+    instances.erase(instances.begin(), instances.begin() + stride * before);
+    return instances;
+}
+
+bool sameDraws(const std::vector<GLStub::Draw>& a, const std::vector<GLStub::Draw>& b)
+{
+    if (a.size() != b.size())
+    {
+        return false;
+    }
+
+    for (size_t i=0; i<a.size(); ++i)
+    {
+        if (a[i].count != b[i].count || a[i].instances != b[i].instances)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main()
+{
+    PetitTask::Config taskConfig;
+    taskConfig.threads = 4;
+    PetitTask::Create(taskConfig);
+
+    Petit2D::Config config;
+    config.maxSpritesPerBatch = BATCH_CAPACITY;
+    Petit2D::Create(config);
+    Petit2D::Sprite::Use();
+
+    // A retained actor between plain ones: its draw is recorded in the middle of
+    // a chunk and the instances after it start at an odd offset.
+    PetitActor::Layer::SpriteLayer layer;
+    layer.actors.push_back(new Sprites(3, 100.0f, false));
+    layer.actors.push_back(new Sprites(5, 200.0f, true));
+    layer.actors.push_back(new Sprites(4, 300.0f, false));
+    layer.actors.push_back(new Sprites(7, 400.0f, false));
+    layer.actors.push_back(new Sprites(2, 500.0f, true));
+    layer.actors.push_back(new Sprites(9, 600.0f, false));
+    layer.refresh();
+
+    auto failures = 0;
+    for (auto before=0; before<BATCH_CAPACITY; ++before)
+    {
+        auto serial = capture(layer, before, false, 0);
+        for (auto grain=1; grain<=static_cast<int>(layer.actors.size()); ++grain)
+        {
+            if (!sameDraws(serial, capture(layer, before, true, grain)))
+            {
+                printf("Recorded layer differs: %d sprites before, grain %d\n", before, grain);
+                failures += 1;
+            }
+        }
+    }
+
+    Petit2D::Catalog::SpriteDef sheet;
+    sheet.width = 128;
+    sheet.height = 128;
+    auto font = PetitText::CreateFont(sheet);
+    auto cache = PetitText::CreateCache();
+
+    PetitText::Style style;
+    style.maxWidth = 64.0f;
+    auto run = PetitText::Get(cache, font, "Cached text, drawn at the origin", style);
+
+    auto reference = captureText(run, 0, 0);
+    auto stride = reference.size() / PetitText::GetGlyphCount(run);
+    for (auto before=1; before<BATCH_CAPACITY; ++before)
+    {
+        if (captureText(run, before, stride) != reference)
+        {
+            printf("Text run differs: %d sprites before\n", before);
+            failures += 1;
+        }
+    }
+
+    PetitText::DestroyCache(cache);
+    PetitText::DestroyFont(font);
+
+    printf("%s\n", failures == 0 ? "Recorded layers and text runs match" : "Recorded layers or text runs differ");
+
+    for (auto actor : layer.actors)
+    {
+        delete(actor);
+    }
+    layer.actors.clear();
+
+    Petit2D::Destroy();
+    PetitTask::Destroy();
+    return failures == 0 ? 0 : 1;
+}
@@ -2,10 +2,38 @@
 
 #include <map>
 #include <cmath>
+#include <deque>
+#include <mutex>
+#include <chrono>
 #include <string>
+#include <thread>
+#include <cstdint>
+#include <cstring>
 #include <fstream>
+#include <condition_variable>
 #include <glad/glad.h>
 
+#ifdef _WIN32
+#  define WIN32_LEAN_AND_MEAN
+#  include <windows.h>
+#else
+#  include <fcntl.h>
+#  include <unistd.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#endif
+
+// PETIT2D_NO_SIMD keeps the scalar packing paths, to compare against them.
+#if defined(PETIT2D_NO_SIMD)
+#elif defined(__AVX2__)
+#  include <immintrin.h>
+#  define PETIT2D_AVX2
+#  define PETIT2D_SSE2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  include <emmintrin.h>
+#  define PETIT2D_SSE2
+#endif
+
 #define STB_IMAGE_IMPLEMENTATION
 #define STBI_NO_PSD
 #define STBI_NO_TGA
@@ -22,9 +50,33 @@
 #  define DEBUG(...)
 #endif
 
-#define MAX_SPRITES_PER_SPRITE_BATCH    16384 // 65536   // yes.
-#define MAX_VERTICES_PER_SHAPE_BATCH    4096
+#ifndef GL_RGB565
+#  define GL_RGB565                                 0x8D62
+#endif
+#ifndef GL_COMPRESSED_RGB8_ETC2
+#  define GL_COMPRESSED_RGB8_ETC2                   0x9274
+#  define GL_COMPRESSED_RGB8_PUNCHTHROUGH_ALPHA1_ETC2 0x9276
+#  define GL_COMPRESSED_RGBA8_ETC2_EAC              0x9278
+#  define GL_COMPRESSED_R11_EAC                     0x9270
+#  define GL_COMPRESSED_RG11_EAC                    0x9272
+#endif
+
+#define MAX_STREAM_REGIONS              8
+#define SPRITE_BLOCK_SIZE               16
+#define TEXTURE_UPLOAD_BUFFERS          3
+#define ANIMATION_TEXTURE_UNIT          Texture::UNIT_COUNT
+#define KEY_LAYER_SHIFT                 48
+#define KEY_BLEND_SHIFT                 46
+#define KEY_PROGRAM_SHIFT               45
+#define KEY_TEXTURE_SHIFT               32
+#define KEY_LAYER_MASK                  0xFFFFu
+#define KEY_BLEND_MASK                  0x3u
+#define KEY_PROGRAM_MASK                0x1u
+#define KEY_TEXTURE_MASK                0x1FFFu
+#define KEY_FIELD(mask, shift)          (static_cast<uint64_t>(mask) << (shift))
+#define KEY_STATE_MASK                  (KEY_FIELD(KEY_BLEND_MASK, KEY_BLEND_SHIFT) | KEY_FIELD(KEY_PROGRAM_MASK, KEY_PROGRAM_SHIFT) | KEY_FIELD(KEY_TEXTURE_MASK, KEY_TEXTURE_SHIFT))
 #define M_PI_DIV_180                    3.14f / 180.0f
+#define DISTANCE_INFINITY               1e20f
 
 namespace Petit2D
 {
@@ -33,13 +85,28 @@ namespace Petit2D
 // [SECTION] Petit2D - Forward private declarations and basic types
 //-----------------------------------------------------------------------------
 
+struct MappedFile
+{
+    const unsigned char*    data    = nullptr;
+    size_t                  size    = 0;
+#ifdef _WIN32
+    HANDLE                  file    = INVALID_HANDLE_VALUE;
+    HANDLE                  mapping = nullptr;
+#endif
+};
+
             GLuint  compileShader       (GLenum type, const char* src);
+            GLuint  compileShader       (GLenum type, const char* header, const char* src);
             void    checkProgram        (GLuint id);
+            bool    hasBufferStorage    ();
+            bool    mapFile             (const char* filename, MappedFile& mappedFile);
+            void    unmapFile           (MappedFile& mappedFile);
 constexpr   GLenum  getTextureFilter    (Petit2D::Texture::Filter filter);
 constexpr   GLenum  getTextureWrap      (Petit2D::Texture::Wrap wrap);
 constexpr   GLenum  getInternalFormat   (Petit2D::Texture::InternalFormat format);
 constexpr   GLenum  getFormat           (Petit2D::Texture::Format format);
 constexpr   GLenum  getDataType         (Petit2D::Texture::DataType dataType);
+constexpr   int     getBlockSize        (Petit2D::Texture::InternalFormat format);
 constexpr   GLenum  getDrawType         (Petit2D::Shape::DrawType drawType);
 
 //-----------------------------------------------------------------------------
@@ -49,18 +116,294 @@ constexpr   GLenum  getDrawType         (Petit2D::Shape::DrawType drawType);
 namespace Texture
 {
 
-struct Context
+enum State : int
 {
-    GLuint texture[TextureUnit::UNIT_COUNT] = { 0 };
-} g_context;
+    STATE_EMPTY     = 0,
+    STATE_LOADING   = 1,
+    STATE_READY     = 2,
+    STATE_FAILED    = 3
+};
 
 struct Texture
 {
     GLuint  id      = 0;
     int     width   = 0;
     int     height  = 0;
+    State   state   = STATE_EMPTY;
+};
+
+// Workers only touch filename, pixels, width and height. The texture pointer is
+// owned by the render thread, Destroy() clears it to cancel a pending job.
+struct LoadJob
+{
+    Texture*        texture     = nullptr;
+    std::string     filename;
+    InternalFormat  format      = InternalFormat::RGBA8;
+    unsigned char*  pixels      = nullptr;
+    int             width       = 0;
+    int             height      = 0;
+    int             row         = 0;
+};
+
+struct Loader
+{
+    std::vector<std::thread>    threads;
+    std::mutex                  mutex;
+    std::condition_variable     condition;
+    std::deque<LoadJob*>        requests;
+    std::deque<LoadJob*>        decoded;
+    bool                        running     = false;
+};
+
+struct Context
+{
+    GLuint texture[TextureUnit::UNIT_COUNT] = { 0 };
+
+    Loader                  loader;
+    int                     loaderThreads               = 0;
+    std::vector<LoadJob*>   jobs;
+    std::deque<LoadJob*>    uploads;
+    GLuint                  uploadBuffers[TEXTURE_UPLOAD_BUFFERS] = { 0 };
+    int                     uploadIndex                 = 0;
+    int                     uploadBufferSize            = 0;
+} g_context;
+
+void bind(const Texture* texture)
+{
+    if (g_context.texture[TextureUnit::UNIT_0] != texture->id)
+    {
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, texture->id);
+        g_context.texture[TextureUnit::UNIT_0] = texture->id;
+    }
+}
+
+// Client side layout of the pixels uploaded for an uncompressed internal format.
+struct PixelLayout
+{
+    GLenum  format  = GL_RGBA;
+    GLenum  type    = GL_UNSIGNED_BYTE;
+    int     bytes   = 4;
 };
 
+bool getPixelLayout(InternalFormat internalFormat, PixelLayout& layout)
+{
+    switch (internalFormat)
+    {
+    case InternalFormat::RGBA8:     layout = { GL_RGBA, GL_UNSIGNED_BYTE, 4 };          return true;
+    case InternalFormat::R8:        layout = { GL_RED, GL_UNSIGNED_BYTE, 1 };           return true;
+    case InternalFormat::RG8:       layout = { GL_RG, GL_UNSIGNED_BYTE, 2 };            return true;
+    case InternalFormat::RGB565:    layout = { GL_RGB, GL_UNSIGNED_SHORT_5_6_5, 2 };    return true;
+    case InternalFormat::RGBA4:     layout = { GL_RGBA, GL_UNSIGNED_SHORT_4_4_4_4, 2 }; return true;
+    case InternalFormat::RGB5_A1:   layout = { GL_RGBA, GL_UNSIGNED_SHORT_5_5_5_1, 2 }; return true;
+    default:                                                                            return false;
+    }
+}
+
+void convertPixels(unsigned char* pixels, int count, InternalFormat internalFormat)
+{
+    // Converts RGBA8 pixels in place. Every target is at most 4 bytes per pixel so
+    // writing front to back never overwrites a pixel that was not read yet.
+    auto source = pixels;
+    auto target16 = reinterpret_cast<uint16_t*>(pixels);
+    for (auto i=0; i<count; ++i, source += 4)
+    {
+        unsigned r = source[0];
+        unsigned g = source[1];
+        unsigned b = source[2];
+        unsigned a = source[3];
+
+        switch (internalFormat)
+        {
+        case InternalFormat::R8:
+            pixels[i] = r;
+        break;
+
+        case InternalFormat::RG8:
+            pixels[i * 2 + 0] = r;
+            pixels[i * 2 + 1] = g;
+        break;
+
+        case InternalFormat::RGB565:
+            target16[i] = static_cast<uint16_t>(((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3));
+        break;
+
+        case InternalFormat::RGBA4:
+            target16[i] = static_cast<uint16_t>(((r >> 4) << 12) | ((g >> 4) << 8) | ((b >> 4) << 4) | (a >> 4));
+        break;
+
+        case InternalFormat::RGB5_A1:
+            target16[i] = static_cast<uint16_t>(((r >> 3) << 11) | ((g >> 3) << 6) | ((b >> 3) << 1) | (a >> 7));
+        break;
+
+        default:
+        return;
+        }
+    }
+}
+
+void setUnpackAlignment(int rowSize)
+{
+    glPixelStorei(GL_UNPACK_ALIGNMENT, (rowSize % 4) == 0 ? 4 : 1);
+}
+
+void work()
+{
+    auto& loader = g_context.loader;
+    for (;;)
+    {
+        LoadJob* job = nullptr;
+        {
+            std::unique_lock<std::mutex> lock(loader.mutex);
+            loader.condition.wait(lock, [&loader] { return !loader.running || !loader.requests.empty(); });
+            if (!loader.running)
+            {
+                return;
+            }
+
+            job = loader.requests.front();
+            loader.requests.pop_front();
+        }
+
+        int channels;
+        job->pixels = stbi_load(job->filename.c_str(), &job->width, &job->height, &channels, 4);
+        if (job->pixels != nullptr)
+        {
+            convertPixels(job->pixels, job->width * job->height, job->format);
+        }
+
+        std::lock_guard<std::mutex> lock(loader.mutex);
+        loader.decoded.push_back(job);
+    }
+}
+
+void startLoader()
+{
+    auto& loader = g_context.loader;
+    if (loader.running)
+    {
+        return;
+    }
+
+    auto threadCount = g_context.loaderThreads;
+    if (threadCount <= 0)
+    {
+        auto cores = static_cast<int>(std::thread::hardware_concurrency());
+        threadCount = cores > 2 ? cores - 1 : 1;
+    }
+
+    loader.running = true;
+    for (auto i=0; i<threadCount; ++i)
+    {
+        loader.threads.emplace_back(work);
+    }
+}
+
+void releaseJob(LoadJob* job)
+{
+    if (job->pixels != nullptr)
+    {
+        stbi_image_free(job->pixels);
+    }
+
+    auto& jobs = g_context.jobs;
+    for (size_t i=0; i<jobs.size(); ++i)
+    {
+        if (jobs[i] == job)
+        {
+            jobs[i] = jobs.back();
+            jobs.pop_back();
+            break;
+        }
+    }
+
+    delete(job);
+}
+
+bool uploadRows(LoadJob* job)
+{
+    // Upload as many rows as fit one staging buffer, through the next buffer of
+    // the ring so the driver can still be reading the previous ones.
+    auto texture = job->texture;
+    PixelLayout layout;
+    getPixelLayout(job->format, layout);
+
+    auto rowSize = job->width * layout.bytes;
+    auto rows = g_context.uploadBufferSize / rowSize;
+    if (rows < 1)
+    {
+        rows = 1;
+    }
+    if (rows > job->height - job->row)
+    {
+        rows = job->height - job->row;
+    }
+
+    auto size = rowSize * rows;
+    auto buffer = g_context.uploadBuffers[g_context.uploadIndex];
+    g_context.uploadIndex = (g_context.uploadIndex + 1) % TEXTURE_UPLOAD_BUFFERS;
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, size, nullptr, GL_STREAM_DRAW);
+    auto storage = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (storage == nullptr)
+    {
+        DEBUG("Could not map texture upload buffer\n");
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        return false;
+    }
+
+    memcpy(storage, job->pixels + static_cast<size_t>(job->row) * rowSize, size);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+    bind(texture);
+    setUnpackAlignment(rowSize);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, job->row, job->width, rows, layout.format, layout.type, nullptr);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    job->row += rows;
+    return true;
+}
+
+void Create(const Config& config)
+{
+    g_context.loaderThreads = config.textureLoaderThreads;
+    g_context.uploadBufferSize = config.textureUploadBufferSize;
+    if (g_context.uploadBufferSize < 4096)
+    {
+        DEBUG("Texture upload buffer size less than 4096, adjusting to 4096.\n");
+        g_context.uploadBufferSize = 4096;
+    }
+
+    glGenBuffers(TEXTURE_UPLOAD_BUFFERS, g_context.uploadBuffers);
+    g_context.uploadIndex = 0;
+}
+
+void Destroy()
+{
+    auto& loader = g_context.loader;
+    {
+        std::lock_guard<std::mutex> lock(loader.mutex);
+        loader.running = false;
+    }
+    loader.condition.notify_all();
+    for (auto& thread : loader.threads)
+    {
+        thread.join();
+    }
+    loader.threads.clear();
+    loader.requests.clear();
+    loader.decoded.clear();
+    g_context.uploads.clear();
+
+    while (!g_context.jobs.empty())
+    {
+        releaseJob(g_context.jobs.back());
+    }
+
+    glDeleteBuffers(TEXTURE_UPLOAD_BUFFERS, g_context.uploadBuffers);
+}
+
 Texture* Create()
 {
     GLuint id;
@@ -81,6 +424,14 @@ void Destroy(Texture* texture)
 {
     if (texture != nullptr)
     {
+        for (auto job : g_context.jobs)
+        {
+            if (job->texture == texture)
+            {
+                job->texture = nullptr;
+            }
+        }
+
         glDeleteTextures(1, &texture->id);
         delete(texture);
         texture = nullptr;
@@ -88,19 +439,35 @@ void Destroy(Texture* texture)
 }
 
 void Init(Texture* texture, const char* filename)
+{
+    Init(texture, filename, InternalFormat::RGBA8);
+}
+
+void Init(Texture* texture, const char* filename, InternalFormat internalFormat)
 {
     int width;
     int height;
     int channels;
     int desired_channels = 4;
 
+    PixelLayout layout;
+    if (!getPixelLayout(internalFormat, layout))
+    {
+        DEBUG("Images can not be converted to a compressed format %s\n", filename);
+        texture->state = STATE_FAILED;
+        return;
+    }
+
     auto image = stbi_load(filename, &width, &height, &channels, desired_channels);
     if(image == nullptr)
     {
         DEBUG("Error in loading the image %s\n", filename);
+        texture->state = STATE_FAILED;
         return;
     }
 
+    convertPixels(image, width * height, internalFormat);
+
     if (g_context.texture[TextureUnit::UNIT_0] != texture->id)
     {
         glActiveTexture(GL_TEXTURE0);
@@ -108,13 +475,119 @@ void Init(Texture* texture, const char* filename)
         g_context.texture[TextureUnit::UNIT_0] = texture->id;
     }
 
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
+    setUnpackAlignment(width * layout.bytes);
+    glTexImage2D(GL_TEXTURE_2D, 0, getInternalFormat(internalFormat), width, height, 0, layout.format, layout.type, image);
     texture->width = width;
     texture->height = height;
+    texture->state = STATE_READY;
 
     stbi_image_free(image);
 }
 
+void InitAsync(Texture* texture, const char* filename)
+{
+    InitAsync(texture, filename, InternalFormat::RGBA8);
+}
+
+void InitAsync(Texture* texture, const char* filename, InternalFormat internalFormat)
+{
+    PixelLayout layout;
+    if (!getPixelLayout(internalFormat, layout))
+    {
+        DEBUG("Images can not be converted to a compressed format %s\n", filename);
+        texture->state = STATE_FAILED;
+        return;
+    }
+
+    startLoader();
+
+    auto job = new LoadJob();
+    job->texture = texture;
+    job->filename = filename;
+    job->format = internalFormat;
+    g_context.jobs.push_back(job);
+    texture->state = STATE_LOADING;
+
+    {
+        std::lock_guard<std::mutex> lock(g_context.loader.mutex);
+        g_context.loader.requests.push_back(job);
+    }
+    g_context.loader.condition.notify_one();
+}
+
+void Update(float budget)
+{
+    auto start = std::chrono::steady_clock::now();
+    auto& loader = g_context.loader;
+    {
+        std::lock_guard<std::mutex> lock(loader.mutex);
+        while (!loader.decoded.empty())
+        {
+            g_context.uploads.push_back(loader.decoded.front());
+            loader.decoded.pop_front();
+        }
+    }
+
+    while (!g_context.uploads.empty())
+    {
+        auto job = g_context.uploads.front();
+        auto texture = job->texture;
+        if (texture == nullptr || job->pixels == nullptr)
+        {
+            if (texture != nullptr)
+            {
+                DEBUG("Error in loading the image %s\n", job->filename.c_str());
+                texture->state = STATE_FAILED;
+            }
+
+            g_context.uploads.pop_front();
+            releaseJob(job);
+            continue;
+        }
+
+        if (job->row == 0)
+        {
+            PixelLayout layout;
+            getPixelLayout(job->format, layout);
+            bind(texture);
+            glTexImage2D(GL_TEXTURE_2D, 0, getInternalFormat(job->format), job->width, job->height, 0, layout.format, layout.type, nullptr);
+            texture->width = job->width;
+            texture->height = job->height;
+        }
+
+        if (!uploadRows(job))
+        {
+            break;
+        }
+
+        if (job->row >= job->height)
+        {
+            texture->state = STATE_READY;
+            g_context.uploads.pop_front();
+            releaseJob(job);
+        }
+
+        if (budget > 0.0f)
+        {
+            auto elapsed = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+            if (elapsed >= budget)
+            {
+                break;
+            }
+        }
+    }
+}
+
+bool IsReady(const Texture* texture)
+{
+    return texture->state == STATE_READY;
+}
+
+int GetPendingCount()
+{
+    return static_cast<int>(g_context.jobs.size());
+}
+
 void Init(Texture* texture, int width, int height, InternalFormat internalFormat, Format format, DataType type, void* pixels)
 {
     if (g_context.texture[TextureUnit::UNIT_0] != texture->id)
@@ -124,9 +597,56 @@ void Init(Texture* texture, int width, int height, InternalFormat internalFormat
         g_context.texture[TextureUnit::UNIT_0] = texture->id;
     }
 
+    if (getBlockSize(internalFormat) > 0)
+    {
+        DEBUG("Use InitCompressed for compressed formats\n");
+        texture->state = STATE_FAILED;
+        return;
+    }
+
+    auto bytes = 4;
+    switch (type)
+    {
+    case DataType::UNSIGNED_BYTE:
+        bytes = format == Format::RED ? 1 : format == Format::RG ? 2 : format == Format::RGB ? 3 : 4;
+    break;
+
+    default:
+        bytes = 2;
+    break;
+    }
+
+    setUnpackAlignment(width * bytes);
     glTexImage2D(GL_TEXTURE_2D, 0, getInternalFormat(internalFormat), width, height, 0, getFormat(format), getDataType(type), pixels);
     texture->width = width;
     texture->height = height;
+    texture->state = STATE_READY;
+}
+
+void InitCompressed(Texture* texture, int width, int height, InternalFormat internalFormat, int size, const void* data)
+{
+    auto blockSize = getBlockSize(internalFormat);
+    if (blockSize == 0)
+    {
+        DEBUG("Not a compressed format %d\n", internalFormat);
+        texture->state = STATE_FAILED;
+        return;
+    }
+
+    // ETC2 / EAC encode 4x4 texel blocks.
+    auto expected = ((width + 3) / 4) * ((height + 3) / 4) * blockSize;
+    if (size < expected)
+    {
+        DEBUG("Compressed data too small, %d bytes for %d expected\n", size, expected);
+        texture->state = STATE_FAILED;
+        return;
+    }
+
+    bind(texture);
+    glCompressedTexImage2D(GL_TEXTURE_2D, 0, getInternalFormat(internalFormat), width, height, 0, expected, data);
+    texture->width = width;
+    texture->height = height;
+    texture->state = STATE_READY;
 }
 
 void SetWrap(Texture* texture, Wrap s, Wrap t)
@@ -165,6 +685,119 @@ int GetHeight(const Texture* texture)
     return texture->height;
 }
 
+void transformLine(const float* f, int n, float* d, int* v, float* z)
+{
+    // Lower envelope of the parabolas rooted at every sample, Felzenszwalb and
+    // Huttenlocher: squared distances along one line in linear time.
+    auto k = 0;
+    v[0] = 0;
+    z[0] = -DISTANCE_INFINITY;
+    z[1] = DISTANCE_INFINITY;
+    for (auto q=1; q<n; ++q)
+    {
+        auto s = ((f[q] + q * q) - (f[v[k]] + v[k] * v[k])) / (2.0f * (q - v[k]));
+        while (s <= z[k])
+        {
+            k -= 1;
+            s = ((f[q] + q * q) - (f[v[k]] + v[k] * v[k])) / (2.0f * (q - v[k]));
+        }
+        k += 1;
+        v[k] = q;
+        z[k] = s;
+        z[k + 1] = DISTANCE_INFINITY;
+    }
+
+    k = 0;
+    for (auto q=0; q<n; ++q)
+    {
+        while (z[k + 1] < q)
+        {
+            k += 1;
+        }
+        d[q] = (q - v[k]) * (q - v[k]) + f[v[k]];
+    }
+}
+
+void transformGrid(std::vector<float>& grid, int width, int height)
+{
+    // Columns then rows, squared distance to the closest zero of the grid.
+    auto size = width > height ? width : height;
+    std::vector<float> f(size);
+    std::vector<float> d(size);
+    std::vector<float> z(size + 1);
+    std::vector<int> v(size);
+
+    for (auto x=0; x<width; ++x)
+    {
+        for (auto y=0; y<height; ++y)
+        {
+            f[y] = grid[y * width + x];
+        }
+        transformLine(f.data(), height, d.data(), v.data(), z.data());
+        for (auto y=0; y<height; ++y)
+        {
+            grid[y * width + x] = d[y];
+        }
+    }
+
+    for (auto y=0; y<height; ++y)
+    {
+        transformLine(&grid[y * width], width, d.data(), v.data(), z.data());
+        memcpy(&grid[y * width], d.data(), sizeof(float) * width);
+    }
+}
+
+void GenerateDistanceField(const unsigned char* pixels, int width, int height, int spread, unsigned char* distances)
+{
+    if (spread < 1)
+    {
+        DEBUG("Distance field spread less than 1, adjusting to 1.\n");
+        spread = 1;
+    }
+
+    // Pixel centers are half a pixel away from the edge between two of them.
+    auto count = static_cast<size_t>(width) * height;
+    std::vector<float> outside(count);
+    std::vector<float> inside(count);
+    for (size_t i=0; i<count; ++i)
+    {
+        auto opaque = pixels[i * 4 + 3] >= 128;
+        outside[i] = opaque ? 0.0f : DISTANCE_INFINITY;
+        inside[i] = opaque ? DISTANCE_INFINITY : 0.0f;
+    }
+
+    transformGrid(outside, width, height);
+    transformGrid(inside, width, height);
+
+    auto scale = 127.0f / spread;
+    for (size_t i=0; i<count; ++i)
+    {
+        auto distance = outside[i] == 0.0f ? sqrtf(inside[i]) - 0.5f : 0.5f - sqrtf(outside[i]);
+        auto value = 128.0f + distance * scale;
+        distances[i] = static_cast<unsigned char>(value < 0.0f ? 0.0f : value > 255.0f ? 255.0f : value + 0.5f);
+    }
+}
+
+void InitDistanceField(Texture* texture, const char* filename, int spread)
+{
+    int width;
+    int height;
+    int channels;
+    auto image = stbi_load(filename, &width, &height, &channels, 4);
+    if (image == nullptr)
+    {
+        DEBUG("Error in loading the image %s\n", filename);
+        texture->state = STATE_FAILED;
+        return;
+    }
+
+    std::vector<unsigned char> distances(static_cast<size_t>(width) * height);
+    GenerateDistanceField(image, width, height, spread, distances.data());
+    stbi_image_free(image);
+
+    Init(texture, width, height, InternalFormat::R8, Format::RED, DataType::UNSIGNED_BYTE, distances.data());
+}
+
 } // namespace Texture
 
 //-----------------------------------------------------------------------------
@@ -241,6 +874,139 @@ void Init(FrameBuffer* frameBuffer, const Texture::Texture* texture)
 
 } // namespace FrameBuffer
 
+//-----------------------------------------------------------------------------
+// [SECTION] Camera
+//-----------------------------------------------------------------------------
+
+namespace Camera
+{
+
+struct Camera
+{
+    float   x           = 0.0f;
+    float   y           = 0.0f;
+    float   zoom        = 1.0f;
+    float   rotation    = 0.0f;
+    float   width       = 1.0f;
+    float   height      = 1.0f;
+    float   matrix[16]  = { 0.0f };
+    Rect    view;
+};
+
+void update(Camera* camera)
+{
+    // World to clip: move the camera position to the origin, rotate the world the
+    // opposite way of the camera, then scale to clip space, y pointing down.
+    auto radians = camera->rotation * M_PI_DIV_180;
+    auto c = cosf(radians);
+    auto s = sinf(radians);
+    auto ax = 2.0f * camera->zoom / camera->width;
+    auto ay = -2.0f * camera->zoom / camera->height;
+
+    auto m = camera->matrix;
+    memset(m, 0, sizeof(camera->matrix));
+    m[0] = ax * c;
+    m[1] = ay * s;
+    m[4] = -ax * s;
+    m[5] = ay * c;
+    m[10] = -1.0f;
+    m[12] = -(m[0] * camera->x + m[4] * camera->y);
+    m[13] = -(m[1] * camera->x + m[5] * camera->y);
+    m[15] = 1.0f;
+
+    auto halfWidth = camera->width * 0.5f / camera->zoom;
+    auto halfHeight = camera->height * 0.5f / camera->zoom;
+    auto extentX = fabsf(c) * halfWidth + fabsf(s) * halfHeight;
+    auto extentY = fabsf(s) * halfWidth + fabsf(c) * halfHeight;
+    camera->view.left = camera->x - extentX;
+    camera->view.top = camera->y - extentY;
+    camera->view.right = camera->x + extentX;
+    camera->view.bottom = camera->y + extentY;
+}
+
+Camera* Create()
+{
+    auto camera = new Camera();
+    update(camera);
+
+    return camera;
+}
+
+void Destroy(Camera* camera)
+{
+    if (camera != nullptr)
+    {
+        delete(camera);
+        camera = nullptr;
+    }
+}
+
+void Init(Camera* camera, float width, float height)
+{
+    if (width <= 0.0f || height <= 0.0f)
+    {
+        DEBUG("Invalid camera size %fx%f\n", width, height);
+        return;
+    }
+
+    // Looking at the center of the view keeps the usual top left origin.
+    camera->width = width;
+    camera->height = height;
+    camera->x = width * 0.5f;
+    camera->y = height * 0.5f;
+    camera->zoom = 1.0f;
+    camera->rotation = 0.0f;
+    update(camera);
+}
+
+void SetPosition(Camera* camera, float x, float y)
+{
+    camera->x = x;
+    camera->y = y;
+    update(camera);
+}
+
+void SetZoom(Camera* camera, float zoom)
+{
+    if (zoom <= 0.0f)
+    {
+        DEBUG("Invalid camera zoom %f\n", zoom);
+        return;
+    }
+
+    camera->zoom = zoom;
+    update(camera);
+}
+
+void SetRotation(Camera* camera, float rotation)
+{
+    camera->rotation = rotation;
+    update(camera);
+}
+
+const float* GetMatrix(const Camera* camera)
+{
+    return camera->matrix;
+}
+
+Rect GetView(const Camera* camera)
+{
+    return camera->view;
+}
+
+void ScreenToWorld(const Camera* camera, float screenX, float screenY, float& worldX, float& worldY)
+{
+    auto radians = camera->rotation * M_PI_DIV_180;
+    auto c = cosf(radians);
+    auto s = sinf(radians);
+    auto dx = (screenX - camera->width * 0.5f) / camera->zoom;
+    auto dy = (screenY - camera->height * 0.5f) / camera->zoom;
+    worldX = camera->x + c * dx + s * dy;
+    worldY = camera->y - s * dx + c * dy;
+}
+
+} // namespace Camera
+
 //-----------------------------------------------------------------------------
 // [SECTION] Sprites
 //-----------------------------------------------------------------------------
@@ -248,8 +1014,12 @@ void Init(FrameBuffer* frameBuffer, const Texture::Texture* texture)
 namespace Sprite
 {
 
+// Prepended to VERTEX_SRC, one per SpriteLayout. The compact layout stores the
+// angle as a 16 bits fraction of a turn.
+const char* VERTEX_HEADER_PRECISE = "#version 330 core\n#define ANGLE_SCALE 1.0\n";
+const char* VERTEX_HEADER_COMPACT = "#version 330 core\n#define ANGLE_SCALE 9.58251953125e-05\n";
+
 const char* VERTEX_SRC = R"text(
-    #version 330 core
     precision lowp float;
 
     layout (location = 0) in vec2 size;
@@ -263,6 +1033,26 @@ const char* VERTEX_SRC = R"text(
     out vec2 inTexCoord;
 
     uniform mat4 projection;
+    uniform mat4 model;
+
+    #ifdef ANIMATED
+    // x: animation, -1 for none, y: start time, z: frames per second.
+    layout (location = 6) in vec3 animation;
+
+    // Texel i: first frame texel, frame count, loop, for animation i. Frame
+    // texels hold s, t, p, q.
+    uniform samplerBuffer frames;
+    uniform float time;
+    #endif
+
+    #ifdef DISTANCE_FIELD
+    // x: outline width, y: extra smoothing, both in fractions of the spread.
+    layout (location = 7) in vec4 outlineColor;
+    layout (location = 8) in vec2 distanceField;
+
+    out vec4 inOutlineColor;
+    out vec2 inDistanceField;
+    #endif
 
     void main() {
         const ivec2 tlut[4] = ivec2[4] (
@@ -278,10 +1068,11 @@ const char* VERTEX_SRC = R"text(
             vec2(0.5, 0.5),
             vec2(-0.5, 0.5)
         );
-        
+
+        float radians = angle * ANGLE_SCALE;
         mat3 rotate_mat = mat3 (
-            cos(angle), -sin(angle), 0.0,
-            sin(angle), cos(angle), 0.0,
+            cos(radians), -sin(radians), 0.0,
+            sin(radians), cos(radians), 0.0,
             0.0, 0.0, 1.0
         );
 
@@ -298,9 +1089,23 @@ const char* VERTEX_SRC = R"text(
         );
 
         vec3 transformed = translate_mat * rotate_mat * scale_mat * vec3(plut[gl_VertexID] * size, 1.0);
-        gl_Position = projection * vec4(transformed, 1.0);
-        inTexCoord = vec2(coords[tlut[gl_VertexID].x], coords[tlut[gl_VertexID].y]);
+        gl_Position = projection * model * vec4(transformed, 1.0);
+        vec4 uv = coords;
+    #ifdef ANIMATED
+        if (animation.x >= 0.0)
+        {
+            vec4 info = texelFetch(frames, int(animation.x));
+            float frame = floor((time - animation.y) * animation.z);
+            frame = info.z > 0.5 ? mod(frame, info.y) : clamp(frame, 0.0, info.y - 1.0);
+            uv = texelFetch(frames, int(info.x + frame));
+        }
+    #endif
+        inTexCoord = vec2(uv[tlut[gl_VertexID].x], uv[tlut[gl_VertexID].y]);
         inColor = color;
+    #ifdef DISTANCE_FIELD
+        inOutlineColor = outlineColor;
+        inDistanceField = distanceField;
+    #endif
     }
 )text";
 
@@ -320,155 +1125,351 @@ const char* FRAGMENT_SRC = R"text(
     }
 )text";
 
-struct Context
-{
-    GLuint  vertexBufferId          = 0;
-    GLuint  vertexArrayId           = 0;
-    int     spriteCount             = 0;
-    int     maxSprite               = 0;
-    void*   storage                 = nullptr;
+// Red channel of a Texture::InitDistanceField atlas: 0.5 on the edge, 0 and 1
+// a spread away outside and inside. Edges stay one pixel wide at any scale,
+// then the fill is composited over the outline ring.
+const char* FRAGMENT_DISTANCE_FIELD_SRC = R"text(
+    #version 330 core
+    precision mediump float;
 
-    GLuint  programShaderId         = 0;
-    GLint   matrixUniform           = 0;
-    GLint   textureUniform          = 0;
-    GLint   sizeLocation            = 0;
-    GLint   colorLocation           = 0;
-    GLint   coordsLocation         = 0;
-    GLint   translationLocation     = 0;
-    GLint   scaleLocation           = 0;
-    GLint   angleLocation           = 0;
-} g_context;
+    in vec4 inColor;
+    in vec2 inTexCoord;
+    in vec4 inOutlineColor;
+    in vec2 inDistanceField;
+
+    out vec4 fragColor;
+
+    uniform sampler2D tex2D;
+
+    void main() {
+        float distance = texture(tex2D, inTexCoord).r;
+        float width = max(fwidth(distance) * 0.7, 1e-4) + inDistanceField.y * 0.5;
+        float outlineEdge = 0.5 - inDistanceField.x * 0.5;
+
+        vec4 fill = vec4(inColor.rgb, inColor.a * smoothstep(0.5 - width, 0.5 + width, distance));
+        vec4 outline = vec4(inOutlineColor.rgb, inOutlineColor.a * smoothstep(outlineEdge - width, outlineEdge + width, distance));
+
+        float alpha = fill.a + outline.a * (1.0 - fill.a);
+        vec3 color = fill.rgb * fill.a + outline.rgb * outline.a * (1.0 - fill.a);
+        fragColor = vec4(color / max(alpha, 1e-4), alpha);
+    }
+)text";
+
+//-----------------------------------------------------------------------------
+// [SECTION] Sprites - Instance layouts
+//-----------------------------------------------------------------------------
 
-struct SpriteInstance
+struct PreciseInstance
 {
     float s                 = 0.0f; // 4
     float t                 = 0.0f; // 8
     float p                 = 0.0f; // 12
     float q                 = 0.0f; // 16
-    float rotation          = 0.0f; // 24
-    float scale_x           = 0.0f; // 32
-    float scale_y           = 0.0f; // 40
-    short w                 = 0; // 42
-    short h                 = 0; // 44
-    short translation_x     = 0; // 46
-    short translation_y     = 0; // 48
-    unsigned char r         = 0; // 49
-    unsigned char g         = 0; // 50
-    unsigned char b         = 0; // 51
-    unsigned char a         = 0; // 52
+    float translation_x     = 0.0f; // 20
+    float translation_y     = 0.0f; // 24
+    float scale_x           = 0.0f; // 28
+    float scale_y           = 0.0f; // 32
+    float rotation          = 0.0f; // 36, radians
+    short w                 = 0;    // 38
+    short h                 = 0;    // 40
+    unsigned char r         = 0;    // 41
+    unsigned char g         = 0;    // 42
+    unsigned char b         = 0;    // 43
+    unsigned char a         = 0;    // 44
 };
 
-void Create()
+struct CompactInstance
 {
-    auto vertexShader = compileShader(GL_VERTEX_SHADER, VERTEX_SRC);
-    auto fragmentShader = compileShader(GL_FRAGMENT_SHADER, FRAGMENT_SRC);
+    uint16_t s              = 0;    // 2, unorm16
+    uint16_t t              = 0;    // 4
+    uint16_t p              = 0;    // 6
+    uint16_t q              = 0;    // 8
+    float translation_x     = 0.0f; // 12
+    float translation_y     = 0.0f; // 16
+    short w                 = 0;    // 18
+    short h                 = 0;    // 20
+    uint16_t scale_x        = 0;    // 22, half float
+    uint16_t scale_y        = 0;    // 24
+    unsigned char r         = 0;    // 25
+    unsigned char g         = 0;    // 26
+    unsigned char b         = 0;    // 27
+    unsigned char a         = 0;    // 28
+    uint16_t rotation       = 0;    // 30, 1/65536 of a turn
+    uint16_t padding        = 0;    // 32
+};
 
-    g_context.programShaderId = glCreateProgram();
-    glAttachShader(g_context.programShaderId, vertexShader);
-    glAttachShader(g_context.programShaderId, fragmentShader);
-    glLinkProgram(g_context.programShaderId);
+static_assert(sizeof(PreciseInstance) == 44, "PreciseInstance must stay tightly packed");
+static_assert(sizeof(CompactInstance) == 32, "CompactInstance must stay tightly packed");
 
-    glDeleteShader(vertexShader);
-    glDeleteShader(fragmentShader);
-    checkProgram(g_context.programShaderId);
+// Appended to either layout when Config::spriteAnimation is set.
+struct AnimationInstance
+{
+    float animation         = -1.0f;
+    float animation_start   = 0.0f;
+    float animation_rate    = 0.0f;
+};
 
-    g_context.matrixUniform = glGetUniformLocation(g_context.programShaderId, "projection");
-    g_context.textureUniform = glGetUniformLocation(g_context.programShaderId, "tex2D");
-    g_context.sizeLocation = glGetAttribLocation(g_context.programShaderId, "size");
-    g_context.colorLocation = glGetAttribLocation(g_context.programShaderId, "color");
-    g_context.coordsLocation = glGetAttribLocation(g_context.programShaderId, "coords");
-    g_context.translationLocation = glGetAttribLocation(g_context.programShaderId, "translation");
-    g_context.scaleLocation = glGetAttribLocation(g_context.programShaderId, "scale");
-    g_context.angleLocation = glGetAttribLocation(g_context.programShaderId, "angle");
+// Appended after the animation when Config::spriteDistanceField is set.
+struct DistanceFieldInstance
+{
+    unsigned char outline_r = 0;    // 1
+    unsigned char outline_g = 0;    // 2
+    unsigned char outline_b = 0;    // 3
+    unsigned char outline_a = 0;    // 4
+    unsigned char outline   = 0;    // 5, unorm8
+    unsigned char smoothing = 0;    // 6, unorm8
+    uint16_t padding        = 0;    // 8
+};
 
-    glGenBuffers(1, &g_context.vertexBufferId);
-    glBindBuffer(GL_ARRAY_BUFFER, g_context.vertexBufferId);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(SpriteInstance) * MAX_SPRITES_PER_SPRITE_BATCH, nullptr, GL_STREAM_DRAW);
+#define MAX_INSTANCE_SIZE   (sizeof(PreciseInstance) + sizeof(AnimationInstance) + sizeof(DistanceFieldInstance))
 
-    glGenVertexArrays(1, &g_context.vertexArrayId);
-    glBindVertexArray(g_context.vertexArrayId);
+enum Attribute : int
+{
+    ATTRIBUTE_SIZE           = 0,
+    ATTRIBUTE_COORDS         = 1,
+    ATTRIBUTE_COLOR          = 2,
+    ATTRIBUTE_ANGLE          = 3,
+    ATTRIBUTE_TRANSLATION    = 4,
+    ATTRIBUTE_SCALE          = 5,
+    ATTRIBUTE_ANIMATION      = 6,
+    ATTRIBUTE_OUTLINE_COLOR  = 7,
+    ATTRIBUTE_DISTANCE_FIELD = 8,
+    ATTRIBUTE_COUNT          = 9
+};
 
-    glVertexAttribPointer(g_context.sizeLocation, 2, GL_SHORT, false, sizeof(SpriteInstance), (void*) offsetof(SpriteInstance, w));
-    glVertexAttribPointer(g_context.coordsLocation, 4, GL_FLOAT, false, sizeof(SpriteInstance), (void*) offsetof(SpriteInstance, s));
-    glVertexAttribPointer(g_context.colorLocation, 4, GL_UNSIGNED_BYTE, true, sizeof(SpriteInstance), (void*) offsetof(SpriteInstance, r));
-    glVertexAttribPointer(g_context.angleLocation, 1, GL_FLOAT, false, sizeof(SpriteInstance), (void*) offsetof(SpriteInstance, rotation));
-    glVertexAttribPointer(g_context.translationLocation, 2, GL_SHORT, false, sizeof(SpriteInstance), (void*) offsetof(SpriteInstance, translation_x));
-    glVertexAttribPointer(g_context.scaleLocation, 2, GL_FLOAT, false, sizeof(SpriteInstance), (void*) offsetof(SpriteInstance, scale_x));
-
-    glVertexAttribDivisor(g_context.sizeLocation, 1);
-    glVertexAttribDivisor(g_context.coordsLocation, 1);
-    glVertexAttribDivisor(g_context.colorLocation, 1);
-    glVertexAttribDivisor(g_context.angleLocation, 1);
-    glVertexAttribDivisor(g_context.translationLocation, 1);
-    glVertexAttribDivisor(g_context.scaleLocation, 1);
-
-    glEnableVertexAttribArray(g_context.sizeLocation);
-    glEnableVertexAttribArray(g_context.coordsLocation);
-    glEnableVertexAttribArray(g_context.colorLocation);
-    glEnableVertexAttribArray(g_context.angleLocation);
-    glEnableVertexAttribArray(g_context.translationLocation);
-    glEnableVertexAttribArray(g_context.scaleLocation);
+const char* ATTRIBUTE_NAMES[ATTRIBUTE_COUNT] = { "size", "coords", "color", "angle", "translation", "scale", "animation", "outlineColor", "distanceField" };
 
-    glBindVertexArray(0);
+enum ProgramType : int
+{
+    PROGRAM_COLOR           = 0,
+    PROGRAM_DISTANCE_FIELD  = 1,
+    PROGRAM_COUNT           = 2
+};
+
+struct AttributeFormat
+{
+    GLint       size        = 0;
+    GLenum      type        = GL_FLOAT;
+    GLboolean   normalized  = GL_FALSE;
+    size_t      offset      = 0;
+};
+
+struct InstanceLayout
+{
+    const char*     vertexHeader;
+    size_t          stride;
+    AttributeFormat attributes[ATTRIBUTE_COUNT];
+    void            (*pack)         (const Sprite& sprite, void* target);
+    void            (*packBlock)    (const SpriteArrays& sprites, size_t first, int count, unsigned char* target, size_t stride);
+};
+
+//-----------------------------------------------------------------------------
+// [SECTION] Sprites - Conversion kernels
+//-----------------------------------------------------------------------------
+
+uint16_t toHalf(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    uint32_t sign = (bits >> 16) & 0x8000;
+    int32_t exponent = static_cast<int32_t>((bits >> 23) & 0xFF) - 127 + 15;
+    uint32_t mantissa = bits & 0x7FFFFF;
+
+    if (((bits >> 23) & 0xFF) == 0xFF)
+    {
+        return static_cast<uint16_t>(sign | 0x7C00 | (mantissa != 0 ? 0x200 : 0));
+    }
+
+    if (exponent >= 31)
+    {
+        return static_cast<uint16_t>(sign | 0x7C00);
+    }
+
+    if (exponent <= 0)
+    {
+        if (exponent < -10)
+        {
+            return static_cast<uint16_t>(sign);
+        }
+
+        mantissa |= 0x800000;
+        auto shift = static_cast<uint32_t>(14 - exponent);
+        auto half = mantissa >> shift;
+        auto remainder = mantissa & ((1u << shift) - 1);
+        auto midpoint = 1u << (shift - 1);
+        if (remainder > midpoint || (remainder == midpoint && (half & 1) != 0))
+        {
+            half += 1;
+        }
+        return static_cast<uint16_t>(sign | half);
+    }
+
+    // Round to nearest even, a carry into the exponent is still the right result.
+    auto half = sign | (static_cast<uint32_t>(exponent) << 10) | (mantissa >> 13);
+    auto remainder = mantissa & 0x1FFF;
+    if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1) != 0))
+    {
+        half += 1;
+    }
+    return static_cast<uint16_t>(half);
 }
 
-void Destroy()
+uint16_t toUnorm16(float value)
 {
-    glDeleteProgram(g_context.programShaderId);
-    glDeleteBuffers(1, &g_context.vertexBufferId);
-    glDeleteVertexArrays(1, &g_context.vertexArrayId);
+    value = value < 0.0f ? 0.0f : value > 1.0f ? 1.0f : value;
+    return static_cast<uint16_t>(static_cast<int>(value * 65535.0f + 0.5f));
 }
 
-void Use()
+unsigned char toUnorm8(float value)
 {
-    glUseProgram(g_context.programShaderId);
-    glBindBuffer(GL_ARRAY_BUFFER, g_context.vertexBufferId);
-    glBindVertexArray(g_context.vertexArrayId);
+    value = value < 0.0f ? 0.0f : value > 1.0f ? 1.0f : value;
+    return static_cast<unsigned char>(static_cast<int>(value * 255.0f + 0.5f));
 }
 
-void SetTexture(Texture::TextureUnit unit)
+uint16_t toTurn(float degrees)
 {
-    glUniform1i(g_context.textureUniform, unit);
+    auto turns = degrees / 360.0f;
+    turns -= floorf(turns);
+    return static_cast<uint16_t>(static_cast<int>(turns * 65536.0f + 0.5f) & 0xFFFF);
 }
 
-void SetMatrix(const float* value)
+#if defined(PETIT2D_SSE2)
+__m128i packUnsigned16(__m128i low, __m128i high)
 {
-    glUniformMatrix4fv(g_context.matrixUniform, 1, GL_FALSE, value);
+    // SSE2 only packs with signed saturation: shift the 0..65535 range down,
+    // pack, then flip the sign bit back.
+    auto bias = _mm_set1_epi32(32768);
+    auto packed = _mm_packs_epi32(_mm_sub_epi32(low, bias), _mm_sub_epi32(high, bias));
+    return _mm_xor_si128(packed, _mm_set1_epi16(static_cast<short>(0x8000)));
 }
+#endif
 
-void Begin()
+void convertAngles(const float* degrees, float* radians, int count)
 {
-    if (g_context.maxSprite < g_context.spriteCount)
+    // Same operations, in the same order, as the scalar degrees * M_PI_DIV_180 so
+    // both paths produce identical instances.
+    auto i = 0;
+#if defined(PETIT2D_AVX2)
+    auto pi8 = _mm256_set1_ps(3.14f);
+    auto divisor8 = _mm256_set1_ps(180.0f);
+    for (; i + 8 <= count; i += 8)
     {
-        g_context.maxSprite = g_context.spriteCount;
+        _mm256_storeu_ps(radians + i, _mm256_div_ps(_mm256_mul_ps(_mm256_loadu_ps(degrees + i), pi8), divisor8));
+    }
+#endif
+#if defined(PETIT2D_SSE2)
+    auto pi4 = _mm_set1_ps(3.14f);
+    auto divisor4 = _mm_set1_ps(180.0f);
+    for (; i + 4 <= count; i += 4)
+    {
+        _mm_storeu_ps(radians + i, _mm_div_ps(_mm_mul_ps(_mm_loadu_ps(degrees + i), pi4), divisor4));
+    }
+#endif
+    for (; i < count; ++i)
+    {
+        radians[i] = degrees[i] * M_PI_DIV_180;
     }
-    
-    g_context.spriteCount = 0;
-    g_context.storage = glMapBufferRange
-    (
-        GL_ARRAY_BUFFER,
-        0,
-        sizeof(SpriteInstance) * MAX_SPRITES_PER_SPRITE_BATCH,
-        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_FLUSH_EXPLICIT_BIT
-    );
 }
 
-void Add(const Sprite& sprite)
+void convertTurns(const float* degrees, uint16_t* turns, int count)
 {
-    if (g_context.storage == nullptr)
+    auto i = 0;
+#if defined(PETIT2D_SSE2)
+    auto divisor = _mm_set1_ps(360.0f);
+    auto one = _mm_set1_ps(1.0f);
+    auto scale = _mm_set1_ps(65536.0f);
+    auto half = _mm_set1_ps(0.5f);
+    auto mask = _mm_set1_epi32(0xFFFF);
+    auto fraction = [&](const float* source)
     {
-        DEBUG("Sprite storage nullptr\n");
-        return;
+        // floor() without SSE4.1: truncate, then step down where that rounded up.
+        auto value = _mm_div_ps(_mm_loadu_ps(source), divisor);
+        auto truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(value));
+        auto floored = _mm_sub_ps(truncated, _mm_and_ps(_mm_cmpgt_ps(truncated, value), one));
+        auto scaled = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(value, floored), scale), half);
+        return _mm_and_si128(_mm_cvttps_epi32(scaled), mask);
+    };
+
+    for (; i + 8 <= count; i += 8)
+    {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(turns + i), packUnsigned16(fraction(degrees + i), fraction(degrees + i + 4)));
+    }
+#endif
+    for (; i < count; ++i)
+    {
+        turns[i] = toTurn(degrees[i]);
+    }
+}
+
+void convertUnorm16(const float* values, uint16_t* unorms, int count)
+{
+    auto i = 0;
+#if defined(PETIT2D_SSE2)
+    auto zero = _mm_setzero_ps();
+    auto one = _mm_set1_ps(1.0f);
+    auto scale = _mm_set1_ps(65535.0f);
+    auto half = _mm_set1_ps(0.5f);
+    auto convert = [&](const float* source)
+    {
+        auto value = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(source), zero), one);
+        return _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(value, scale), half));
+    };
+
+    for (; i + 8 <= count; i += 8)
+    {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(unorms + i), packUnsigned16(convert(values + i), convert(values + i + 4)));
+    }
+#endif
+    for (; i < count; ++i)
+    {
+        unorms[i] = toUnorm16(values[i]);
+    }
+}
+
+void convertHalfs(const float* values, uint16_t* halfs, int count)
+{
+    auto i = 0;
+#if defined(PETIT2D_AVX2) && defined(__F16C__)
+    for (; i + 8 <= count; i += 8)
+    {
+        auto packed = _mm256_cvtps_ph(_mm256_loadu_ps(values + i), _MM_FROUND_TO_NEAREST_INT);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(halfs + i), packed);
+    }
+#endif
+    for (; i < count; ++i)
+    {
+        halfs[i] = toHalf(values[i]);
     }
+}
 
-    if (g_context.spriteCount >= MAX_SPRITES_PER_SPRITE_BATCH)
+void streamInstances(void* target, const void* source, size_t size)
+{
+    // The mapped buffer is write-combined: full 16 bytes non-temporal stores keep
+    // the writes in the combining buffers and out of the cache. Only the target
+    // needs the alignment, recorders hand over instances at any stride multiple.
+#if defined(PETIT2D_SSE2)
+    if ((reinterpret_cast<uintptr_t>(target) & 15) == 0 && (size & 15) == 0)
     {
-        DEBUG("spriteCount >= MAX_SPRITES_PER_SPRITE_BATCH\n");
+        auto dst = static_cast<__m128i*>(target);
+        auto src = static_cast<const __m128i*>(source);
+        for (size_t i=0; i<size/16; ++i)
+        {
+            _mm_stream_si128(dst + i, _mm_loadu_si128(src + i));
+        }
         return;
     }
+#endif
+    memcpy(target, source, size);
+}
+
+//-----------------------------------------------------------------------------
+// [SECTION] Sprites - Packing
+//-----------------------------------------------------------------------------
 
-    auto storage = static_cast<SpriteInstance*>(g_context.storage);
-    auto& instance = storage[g_context.spriteCount];
+void packPrecise(const Sprite& sprite, void* target)
+{
+    auto& instance = *static_cast<PreciseInstance*>(target);
     instance.w = sprite.width;
     instance.h = sprite.height;
     instance.s = sprite.s;
@@ -476,7 +1477,7 @@ void Add(const Sprite& sprite)
     instance.p = sprite.p;
     instance.q = sprite.q;
     instance.r = sprite.r;
-    instance.g = sprite.g ;
+    instance.g = sprite.g;
     instance.b = sprite.b;
     instance.a = sprite.a;
     instance.translation_x = sprite.x;
@@ -484,415 +1485,3764 @@ void Add(const Sprite& sprite)
     instance.rotation = sprite.rotation * M_PI_DIV_180;
     instance.scale_x = sprite.scale_x;
     instance.scale_y = sprite.scale_y;
-
-    g_context.spriteCount += 1;
 }
 
-void End()
+void packCompact(const Sprite& sprite, void* target)
 {
-    glFlushMappedBufferRange(GL_ARRAY_BUFFER, 0, sizeof(SpriteInstance) * g_context.spriteCount);
-    glUnmapBuffer(GL_ARRAY_BUFFER);
+    auto& instance = *static_cast<CompactInstance*>(target);
+    instance.w = sprite.width;
+    instance.h = sprite.height;
+    instance.s = toUnorm16(sprite.s);
+    instance.t = toUnorm16(sprite.t);
+    instance.p = toUnorm16(sprite.p);
+    instance.q = toUnorm16(sprite.q);
+    instance.r = sprite.r;
+    instance.g = sprite.g;
+    instance.b = sprite.b;
+    instance.a = sprite.a;
+    instance.translation_x = sprite.x;
+    instance.translation_y = sprite.y;
+    instance.rotation = toTurn(sprite.rotation);
+    instance.scale_x = toHalf(sprite.scale_x);
+    instance.scale_y = toHalf(sprite.scale_y);
+    instance.padding = 0;
 }
 
-void Render()
+void packBlockPrecise(const SpriteArrays& sprites, size_t first, int count, unsigned char* target, size_t stride)
 {
-    if (g_context.spriteCount > 0)
+    alignas(32) float radians[SPRITE_BLOCK_SIZE];
+    convertAngles(sprites.rotation + first, radians, count);
+
+    for (auto i=0; i<count; ++i)
     {
-        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, g_context.spriteCount);
+        auto index = first + i;
+        auto& instance = *reinterpret_cast<PreciseInstance*>(target + stride * i);
+        instance.s = sprites.s[index];
+        instance.t = sprites.t[index];
+        instance.p = sprites.p[index];
+        instance.q = sprites.q[index];
+        instance.translation_x = sprites.x[index];
+        instance.translation_y = sprites.y[index];
+        instance.scale_x = sprites.scale_x[index];
+        instance.scale_y = sprites.scale_y[index];
+        instance.rotation = radians[i];
+        instance.w = sprites.width[index];
+        instance.h = sprites.height[index];
+        instance.r = sprites.r[index];
+        instance.g = sprites.g[index];
+        instance.b = sprites.b[index];
+        instance.a = sprites.a[index];
     }
 }
 
-int GetMaxSprites()
+void packBlockCompact(const SpriteArrays& sprites, size_t first, int count, unsigned char* target, size_t stride)
 {
-    return g_context.maxSprite;
+    alignas(16) uint16_t coords[4][SPRITE_BLOCK_SIZE];
+    alignas(16) uint16_t scales[2][SPRITE_BLOCK_SIZE];
+    alignas(16) uint16_t turns[SPRITE_BLOCK_SIZE];
+    convertUnorm16(sprites.s + first, coords[0], count);
+    convertUnorm16(sprites.t + first, coords[1], count);
+    convertUnorm16(sprites.p + first, coords[2], count);
+    convertUnorm16(sprites.q + first, coords[3], count);
+    convertHalfs(sprites.scale_x + first, scales[0], count);
+    convertHalfs(sprites.scale_y + first, scales[1], count);
+    convertTurns(sprites.rotation + first, turns, count);
+
+    for (auto i=0; i<count; ++i)
+    {
+        auto index = first + i;
+        auto& instance = *reinterpret_cast<CompactInstance*>(target + stride * i);
+        instance.s = coords[0][i];
+        instance.t = coords[1][i];
+        instance.p = coords[2][i];
+        instance.q = coords[3][i];
+        instance.translation_x = sprites.x[index];
+        instance.translation_y = sprites.y[index];
+        instance.w = sprites.width[index];
+        instance.h = sprites.height[index];
+        instance.scale_x = scales[0][i];
+        instance.scale_y = scales[1][i];
+        instance.r = sprites.r[index];
+        instance.g = sprites.g[index];
+        instance.b = sprites.b[index];
+        instance.a = sprites.a[index];
+        instance.rotation = turns[i];
+        instance.padding = 0;
+    }
 }
 
-} // namespace Sprite
+const InstanceLayout LAYOUTS[] =
+{
+    // SpriteLayout::PRECISE
+    {
+        VERTEX_HEADER_PRECISE,
+        sizeof(PreciseInstance),
+        {
+            { 2, GL_SHORT,          GL_FALSE,   offsetof(PreciseInstance, w) },
+            { 4, GL_FLOAT,          GL_FALSE,   offsetof(PreciseInstance, s) },
+            { 4, GL_UNSIGNED_BYTE,  GL_TRUE,    offsetof(PreciseInstance, r) },
+            { 1, GL_FLOAT,          GL_FALSE,   offsetof(PreciseInstance, rotation) },
+            { 2, GL_FLOAT,          GL_FALSE,   offsetof(PreciseInstance, translation_x) },
+            { 2, GL_FLOAT,          GL_FALSE,   offsetof(PreciseInstance, scale_x) }
+        },
+        packPrecise,
+        packBlockPrecise
+    },
+
+    // SpriteLayout::COMPACT
+    {
+        VERTEX_HEADER_COMPACT,
+        sizeof(CompactInstance),
+        {
+            { 2, GL_SHORT,          GL_FALSE,   offsetof(CompactInstance, w) },
+            { 4, GL_UNSIGNED_SHORT, GL_TRUE,    offsetof(CompactInstance, s) },
+            { 4, GL_UNSIGNED_BYTE,  GL_TRUE,    offsetof(CompactInstance, r) },
+            { 1, GL_UNSIGNED_SHORT, GL_FALSE,   offsetof(CompactInstance, rotation) },
+            { 2, GL_FLOAT,          GL_FALSE,   offsetof(CompactInstance, translation_x) },
+            { 2, GL_HALF_FLOAT,     GL_FALSE,   offsetof(CompactInstance, scale_x) }
+        },
+        packCompact,
+        packBlockCompact
+    }
+};
 
 //-----------------------------------------------------------------------------
-// [SECTION] Shapes
+// [SECTION] Sprites - Context
 //-----------------------------------------------------------------------------
 
-namespace Shape
+// SetBatch and DrawBatch calls made while recording, run by Submit right after
+// the instances recorded before them.
+struct Deferred
 {
+    Batch*          upload      = nullptr;  // SetBatch, with count instances at offset in uploads
+    const Batch*    draw        = nullptr;  // DrawBatch
+    int             index       = 0;        // Instances recorded before the command
+    size_t          offset      = 0;
+    int             count       = 0;
+    bool            hasModel    = false;
+    float           model[16];
+};
 
-const char* VERTEX_SRC = R"text(
-    #version 330 core
-    precision lowp float;
-
-    layout (location = 0) in vec2 position;
-    layout (location = 1) in vec4 color;
+// Instances packed away from the mapped buffer, by any thread.
+struct Recorder
+{
+    std::vector<unsigned char>  data;
+    std::vector<unsigned char>  uploads;
+    std::vector<Deferred>       commands;
+    int                         count   = 0;
+};
 
-    out vec4 inColor;
+thread_local Recorder* t_recorder = nullptr;
 
-    uniform mat4 projection;
+// Instances kept on the GPU between frames, with their own vertex array.
+struct Batch
+{
+    GLuint  vertexBufferId          = 0;
+    GLuint  vertexArrayId           = 0;
+    int     count                   = 0;
+    int     capacity                = 0;
+};
 
-    void main() {
-        gl_Position = projection * vec4(position, 0.0, 1.0);
-        inColor = color;
-    }
-)text";
-
-const char* FRAGMENT_SRC = R"text(
-    #version 330 core
-    precision lowp float;
-
-    in vec4 inColor;
-
-    out vec4 fragColor;
+struct Program
+{
+    GLuint  id                      = 0;
+    GLint   matrixUniform           = 0;
+    GLint   modelUniform            = 0;
+    GLint   textureUniform          = 0;
+    GLint   timeUniform             = -1;
+};
 
-    void main() {
-        fragColor = inColor;
-    }
-)text";
+const float IDENTITY_MATRIX[16] =
+{
+    1.0f, 0.0f, 0.0f, 0.0f,
+    0.0f, 1.0f, 0.0f, 0.0f,
+    0.0f, 0.0f, 1.0f, 0.0f,
+    0.0f, 0.0f, 0.0f, 1.0f
+};
 
 struct Context
 {
     GLuint  vertexBufferId          = 0;
     GLuint  vertexArrayId           = 0;
-    int     verticesCount           = 0;
-    int     maxVertices             = 0;
-    float   pointSize               = 1.0f;
-    float   lineWidth               = 1.0f;
+    int     spriteCount             = 0;
+    int     maxSprite               = 0;
+    int     capacity                = 0;
     void*   storage                 = nullptr;
 
-    GLuint  programShaderId         = 0;
-    GLint   matrixUniform           = 0;
-    GLint   vertexLocation          = 0;
-    GLint   colorLocation           = 0;
+    StreamMode      streamMode      = StreamMode::MAP_RANGE;
+    int             regionCount     = 1;
+    int             regionIndex     = 0;
+    unsigned char*  mappedStorage   = nullptr;
+    GLsync          fences[MAX_STREAM_REGIONS] = { 0 };
+    Stats           stats;
+
+    const InstanceLayout*   layout  = &LAYOUTS[SpriteLayout::PRECISE];
+    size_t                  stride  = sizeof(PreciseInstance);
+    int             attributeCount  = 0;
+    Attribute       attributes[ATTRIBUTE_COUNT];    // enabled ones, with their format in formats
+    AttributeFormat formats[ATTRIBUTE_COUNT];
+    size_t          distanceFieldOffset = 0;
+
+    bool                animated            = false;
+    float               time                = 0.0f;
+    GLuint              framesBufferId      = 0;
+    GLuint              framesTextureId     = 0;
+    std::vector<float>  animations;         // first frame, frame count, loop, unused
+    std::vector<float>  frames;             // s, t, p, q
+
+    bool                distanceField       = false;
+    Program             programs[PROGRAM_COUNT];
+    Program*            program             = &programs[PROGRAM_COLOR];    // bound by the last Use
+    GLint   locations[ATTRIBUTE_COUNT] = { 0 };
 } g_context;
 
-void Create()
+void addAttribute(Attribute attribute, const AttributeFormat& format)
 {
-    auto vertexShader = compileShader(GL_VERTEX_SHADER, VERTEX_SRC);
-    auto fragmentShader = compileShader(GL_FRAGMENT_SHADER, FRAGMENT_SRC);
+    g_context.attributes[g_context.attributeCount] = attribute;
+    g_context.formats[g_context.attributeCount] = format;
+    g_context.attributeCount += 1;
+}
 
-    g_context.programShaderId = glCreateProgram();
-    glAttachShader(g_context.programShaderId, vertexShader);
-    glAttachShader(g_context.programShaderId, fragmentShader);
-    glLinkProgram(g_context.programShaderId);
+void setAttributes(GLintptr offset)
+{
+    for (auto i=0; i<g_context.attributeCount; ++i)
+    {
+        const auto& attribute = g_context.formats[i];
+        glVertexAttribPointer
+        (
+            g_context.locations[i],
+            attribute.size,
+            attribute.type,
+            attribute.normalized,
+            g_context.stride,
+            (void*) (offset + attribute.offset)
+        );
+    }
+}
+
+// Instanced sprite attributes read from the start of bufferId, leaves the new
+// vertex array unbound.
+GLuint createVertexArray(GLuint bufferId)
+{
+    GLuint vertexArrayId = 0;
+    glGenVertexArrays(1, &vertexArrayId);
+    glBindVertexArray(vertexArrayId);
+    glBindBuffer(GL_ARRAY_BUFFER, bufferId);
+
+    setAttributes(0);
+
+    for (auto i=0; i<g_context.attributeCount; ++i)
+    {
+        glVertexAttribDivisor(g_context.locations[i], 1);
+        glEnableVertexAttribArray(g_context.locations[i]);
+    }
+
+    glBindVertexArray(0);
+    return vertexArrayId;
+}
+
+void packInstance(const Sprite& sprite, unsigned char* target)
+{
+    g_context.layout->pack(sprite, target);
+    if (g_context.animated)
+    {
+        AnimationInstance instance;
+        instance.animation = static_cast<float>(sprite.animation);
+        instance.animation_start = sprite.animation_start;
+        instance.animation_rate = sprite.animation_rate;
+        memcpy(target + g_context.layout->stride, &instance, sizeof(AnimationInstance));
+    }
+
+    if (g_context.distanceField)
+    {
+        DistanceFieldInstance instance;
+        instance.outline_r = sprite.outline_r;
+        instance.outline_g = sprite.outline_g;
+        instance.outline_b = sprite.outline_b;
+        instance.outline_a = sprite.outline_a;
+        instance.outline = toUnorm8(sprite.outline);
+        instance.smoothing = toUnorm8(sprite.smoothing);
+        memcpy(target + g_context.distanceFieldOffset, &instance, sizeof(DistanceFieldInstance));
+    }
+}
+
+void packInstances(const SpriteArrays& sprites, size_t first, int count, unsigned char* target)
+{
+    g_context.layout->packBlock(sprites, first, count, target, g_context.stride);
+    if (g_context.animated)
+    {
+        for (auto i=0; i<count; ++i)
+        {
+            auto index = first + i;
+            AnimationInstance instance;
+            if (sprites.animation != nullptr)
+            {
+                instance.animation = static_cast<float>(sprites.animation[index]);
+                instance.animation_start = sprites.animation_start != nullptr ? sprites.animation_start[index] : 0.0f;
+                instance.animation_rate = sprites.animation_rate != nullptr ? sprites.animation_rate[index] : 0.0f;
+            }
+            memcpy(target + g_context.stride * i + g_context.layout->stride, &instance, sizeof(AnimationInstance));
+        }
+    }
+
+    if (g_context.distanceField)
+    {
+        for (auto i=0; i<count; ++i)
+        {
+            auto index = first + i;
+            DistanceFieldInstance instance;
+            if (sprites.outline_r != nullptr)
+            {
+                instance.outline_r = sprites.outline_r[index];
+                instance.outline_g = sprites.outline_g[index];
+                instance.outline_b = sprites.outline_b[index];
+                instance.outline_a = sprites.outline_a[index];
+            }
+            instance.outline = sprites.outline != nullptr ? toUnorm8(sprites.outline[index]) : 0;
+            instance.smoothing = sprites.smoothing != nullptr ? toUnorm8(sprites.smoothing[index]) : 0;
+            memcpy(target + g_context.stride * i + g_context.distanceFieldOffset, &instance, sizeof(DistanceFieldInstance));
+        }
+    }
+}
+
+void uploadAnimations()
+{
+    // Animation texels come first, frame offsets are shifted past them.
+    auto animationCount = g_context.animations.size() / 4;
+    std::vector<float> table(g_context.animations);
+    for (size_t i=0; i<animationCount; ++i)
+    {
+        table[i * 4] += static_cast<float>(animationCount);
+    }
+    table.insert(table.end(), g_context.frames.begin(), g_context.frames.end());
+    if (table.empty())
+    {
+        table.assign(4, 0.0f);
+    }
+
+    glBindBuffer(GL_TEXTURE_BUFFER, g_context.framesBufferId);
+    glBufferData(GL_TEXTURE_BUFFER, table.size() * sizeof(float), table.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void waitRegion(int region)
+{
+    auto fence = g_context.fences[region];
+    if (fence == 0)
+    {
+        return;
+    }
+
+    // Fast path: the GPU is already done with this region.
+    auto result = glClientWaitSync(fence, 0, 0);
+    if (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED)
+    {
+        auto start = std::chrono::steady_clock::now();
+        do
+        {
+            result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+        }
+        while (result == GL_TIMEOUT_EXPIRED);
+
+        if (result == GL_WAIT_FAILED)
+        {
+            DEBUG("glClientWaitSync failed\n");
+        }
+
+        auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        g_context.stats.waitCount += 1;
+        g_context.stats.waitTime += elapsed;
+        if (g_context.stats.maxWaitTime < elapsed)
+        {
+            g_context.stats.maxWaitTime = elapsed;
+        }
+    }
+
+    glDeleteSync(fence);
+    g_context.fences[region] = 0;
+}
+
+void createProgram(Program& program, const char* header, const char* fragmentSrc)
+{
+    auto vertexShader = compileShader(GL_VERTEX_SHADER, header, VERTEX_SRC);
+    auto fragmentShader = compileShader(GL_FRAGMENT_SHADER, fragmentSrc);
+
+    program.id = glCreateProgram();
+    glAttachShader(program.id, vertexShader);
+    glAttachShader(program.id, fragmentShader);
+    glLinkProgram(program.id);
 
     glDeleteShader(vertexShader);
     glDeleteShader(fragmentShader);
-    checkProgram(g_context.programShaderId);
+    checkProgram(program.id);
 
-    g_context.matrixUniform = glGetUniformLocation(g_context.programShaderId, "projection");
-    g_context.vertexLocation = glGetAttribLocation(g_context.programShaderId, "position");
-    g_context.colorLocation = glGetAttribLocation(g_context.programShaderId, "color");
- 
-    glGenBuffers(1, &g_context.vertexBufferId);
-    glBindBuffer(GL_ARRAY_BUFFER, g_context.vertexBufferId);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex) * MAX_VERTICES_PER_SHAPE_BATCH, nullptr, GL_STREAM_DRAW);
+    program.matrixUniform = glGetUniformLocation(program.id, "projection");
+    program.modelUniform = glGetUniformLocation(program.id, "model");
+    program.textureUniform = glGetUniformLocation(program.id, "tex2D");
 
-    glGenVertexArrays(1, &g_context.vertexArrayId);
-    glBindVertexArray(g_context.vertexArrayId);
+    glUseProgram(program.id);
+    glUniformMatrix4fv(program.modelUniform, 1, GL_FALSE, IDENTITY_MATRIX);
+    if (g_context.animated)
+    {
+        program.timeUniform = glGetUniformLocation(program.id, "time");
+        glUniform1i(glGetUniformLocation(program.id, "frames"), ANIMATION_TEXTURE_UNIT);
+    }
+    glUseProgram(0);
+}
 
-    glVertexAttribPointer(g_context.vertexLocation, 2, GL_FLOAT, false, sizeof(Vertex), (void*) offsetof(Vertex, x));
-    glVertexAttribPointer(g_context.colorLocation, 4, GL_UNSIGNED_BYTE, true, sizeof(Vertex), (void*) offsetof(Vertex, r));
+void Create(const Config& config)
+{
+    switch (config.spriteLayout)
+    {
+    case SpriteLayout::COMPACT: g_context.layout = &LAYOUTS[SpriteLayout::COMPACT]; break;
+    default:
+    case SpriteLayout::PRECISE: g_context.layout = &LAYOUTS[SpriteLayout::PRECISE]; break;
+    }
 
-    glEnableVertexAttribArray(g_context.vertexLocation);
-    glEnableVertexAttribArray(g_context.colorLocation);
+    // Optional blocks follow the layout, animation first, each adds attributes.
+    g_context.animated = config.spriteAnimation;
+    g_context.distanceField = config.spriteDistanceField;
+    g_context.stride = g_context.layout->stride;
+    g_context.attributeCount = 0;
+    for (auto i=0; i<ATTRIBUTE_ANIMATION; ++i)
+    {
+        addAttribute(static_cast<Attribute>(i), g_context.layout->attributes[i]);
+    }
 
-    glBindVertexArray(0);
+    if (g_context.animated)
+    {
+        addAttribute(ATTRIBUTE_ANIMATION, { 3, GL_FLOAT, GL_FALSE, g_context.stride });
+        g_context.stride += sizeof(AnimationInstance);
+    }
+
+    if (g_context.distanceField)
+    {
+        g_context.distanceFieldOffset = g_context.stride;
+        addAttribute(ATTRIBUTE_OUTLINE_COLOR, { 4, GL_UNSIGNED_BYTE, GL_TRUE, g_context.stride + offsetof(DistanceFieldInstance, outline_r) });
+        addAttribute(ATTRIBUTE_DISTANCE_FIELD, { 2, GL_UNSIGNED_BYTE, GL_TRUE, g_context.stride + offsetof(DistanceFieldInstance, outline) });
+        g_context.stride += sizeof(DistanceFieldInstance);
+    }
+
+    auto header = std::string(g_context.layout->vertexHeader)
+        + (g_context.animated ? "#define ANIMATED\n" : "")
+        + (g_context.distanceField ? "#define DISTANCE_FIELD\n" : "");
+    createProgram(g_context.programs[PROGRAM_COLOR], header.c_str(), FRAGMENT_SRC);
+    if (g_context.distanceField)
+    {
+        createProgram(g_context.programs[PROGRAM_DISTANCE_FIELD], header.c_str(), FRAGMENT_DISTANCE_FIELD_SRC);
+    }
+    g_context.program = &g_context.programs[PROGRAM_COLOR];
+
+    // Attribute locations are explicit in the vertex shader, both programs agree.
+    for (auto i=0; i<g_context.attributeCount; ++i)
+    {
+        g_context.locations[i] = glGetAttribLocation(g_context.program->id, ATTRIBUTE_NAMES[g_context.attributes[i]]);
+    }
+
+    if (g_context.animated)
+    {
+        glGenBuffers(1, &g_context.framesBufferId);
+        uploadAnimations();
+
+        glGenTextures(1, &g_context.framesTextureId);
+        glBindTexture(GL_TEXTURE_BUFFER, g_context.framesTextureId);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, g_context.framesBufferId);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+    }
+
+    g_context.streamMode = config.spriteStreamMode;
+    g_context.regionCount = 1;
+    g_context.regionIndex = 0;
+    if (g_context.streamMode == StreamMode::PERSISTENT)
+    {
+        if (hasBufferStorage())
+        {
+            g_context.regionCount = config.spriteStreamRegions;
+            if (g_context.regionCount < 2)
+            {
+                DEBUG("Sprite stream regions less than 2, adjusting to 2.\n");
+                g_context.regionCount = 2;
+            }
+            if (g_context.regionCount > MAX_STREAM_REGIONS)
+            {
+                DEBUG("Sprite stream regions greater than %d, adjusting to %d.\n", MAX_STREAM_REGIONS, MAX_STREAM_REGIONS);
+                g_context.regionCount = MAX_STREAM_REGIONS;
+            }
+        }
+        else
+        {
+            DEBUG("Persistent mapping not supported, falling back to orphaning.\n");
+            g_context.streamMode = StreamMode::ORPHAN;
+        }
+    }
+
+    g_context.stats = Stats();
+    g_context.stats.streamMode = g_context.streamMode;
+
+    g_context.capacity = config.maxSpritesPerBatch;
+    if (g_context.capacity < 1)
+    {
+        DEBUG("Sprites per batch less than 1, adjusting to 1.\n");
+        g_context.capacity = 1;
+    }
+
+    auto bufferSize = g_context.stride * g_context.capacity * g_context.regionCount;
+    glGenBuffers(1, &g_context.vertexBufferId);
+    glBindBuffer(GL_ARRAY_BUFFER, g_context.vertexBufferId);
+
+    if (g_context.streamMode == StreamMode::PERSISTENT)
+    {
+        glBufferStorage(GL_ARRAY_BUFFER, bufferSize, nullptr, GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT);
+        g_context.mappedStorage = static_cast<unsigned char*>(glMapBufferRange
+        (
+            GL_ARRAY_BUFFER,
+            0,
+            bufferSize,
+            GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_FLUSH_EXPLICIT_BIT
+        ));
+    }
+    else
+    {
+        glBufferData(GL_ARRAY_BUFFER, bufferSize, nullptr, GL_STREAM_DRAW);
+    }
+
+    g_context.vertexArrayId = createVertexArray(g_context.vertexBufferId);
 }
 
 void Destroy()
 {
-    glDeleteProgram(g_context.programShaderId);
+    for (auto i=0; i<MAX_STREAM_REGIONS; ++i)
+    {
+        if (g_context.fences[i] != 0)
+        {
+            glDeleteSync(g_context.fences[i]);
+            g_context.fences[i] = 0;
+        }
+    }
+
+    if (g_context.mappedStorage != nullptr)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, g_context.vertexBufferId);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+        g_context.mappedStorage = nullptr;
+    }
+
+    if (g_context.animated)
+    {
+        glDeleteTextures(1, &g_context.framesTextureId);
+        glDeleteBuffers(1, &g_context.framesBufferId);
+        g_context.framesTextureId = 0;
+        g_context.framesBufferId = 0;
+        g_context.animations.clear();
+        g_context.frames.clear();
+    }
+
+    for (auto& program : g_context.programs)
+    {
+        if (program.id != 0)
+        {
+            glDeleteProgram(program.id);
+            program = Program();
+        }
+    }
+
     glDeleteBuffers(1, &g_context.vertexBufferId);
     glDeleteVertexArrays(1, &g_context.vertexArrayId);
 }
 
-void Use()
+void use(ProgramType type)
 {
-    glUseProgram(g_context.programShaderId);
+    g_context.program = &g_context.programs[type];
+    glUseProgram(g_context.program->id);
     glBindBuffer(GL_ARRAY_BUFFER, g_context.vertexBufferId);
     glBindVertexArray(g_context.vertexArrayId);
+
+    if (g_context.animated)
+    {
+        glActiveTexture(GL_TEXTURE0 + ANIMATION_TEXTURE_UNIT);
+        glBindTexture(GL_TEXTURE_BUFFER, g_context.framesTextureId);
+    }
+}
+
+void Use()
+{
+    use(PROGRAM_COLOR);
+}
+
+void UseDistanceField()
+{
+    if (!g_context.distanceField)
+    {
+        DEBUG("Distance field sprites need Config::spriteDistanceField\n");
+        return;
+    }
+
+    use(PROGRAM_DISTANCE_FIELD);
+}
+
+void SetTime(float time)
+{
+    g_context.time = time;
+}
+
+int AddAnimation(const float* frames, int frameCount, bool loop)
+{
+    if (!g_context.animated)
+    {
+        DEBUG("Sprite animations need Config::spriteAnimation\n");
+        return -1;
+    }
+
+    if (frames == nullptr || frameCount <= 0)
+    {
+        DEBUG("Invalid sprite animation, %d frames\n", frameCount);
+        return -1;
+    }
+
+    auto animation = static_cast<int>(g_context.animations.size() / 4);
+    g_context.animations.push_back(static_cast<float>(g_context.frames.size() / 4));
+    g_context.animations.push_back(static_cast<float>(frameCount));
+    g_context.animations.push_back(loop ? 1.0f : 0.0f);
+    g_context.animations.push_back(0.0f);
+    g_context.frames.insert(g_context.frames.end(), frames, frames + frameCount * 4);
+    uploadAnimations();
+
+    return animation;
+}
+
+void ClearAnimations()
+{
+    if (!g_context.animated)
+    {
+        return;
+    }
+
+    g_context.animations.clear();
+    g_context.frames.clear();
+    uploadAnimations();
+}
+
+void SetTexture(Texture::TextureUnit unit)
+{
+    glUniform1i(g_context.program->textureUniform, unit);
+}
+
+void SetMatrix(const float* value)
+{
+    glUniformMatrix4fv(g_context.program->matrixUniform, 1, GL_FALSE, value);
+}
+
+void SetMatrix(const Camera::Camera* camera)
+{
+    SetMatrix(Camera::GetMatrix(camera));
+}
+
+void Begin()
+{
+    if (g_context.maxSprite < g_context.spriteCount)
+    {
+        g_context.maxSprite = g_context.spriteCount;
+    }
+    
+    g_context.spriteCount = 0;
+
+    auto bufferSize = g_context.stride * g_context.capacity;
+    switch (g_context.streamMode)
+    {
+    case StreamMode::PERSISTENT:
+    {
+        // Move to the next region and make sure the GPU is not reading it anymore,
+        // then point the instance attributes at it.
+        g_context.regionIndex = (g_context.regionIndex + 1) % g_context.regionCount;
+        waitRegion(g_context.regionIndex);
+
+        auto offset = bufferSize * g_context.regionIndex;
+        g_context.storage = g_context.mappedStorage + offset;
+        setAttributes(offset);
+    }
+    break;
+
+    case StreamMode::ORPHAN:
+        glBufferData(GL_ARRAY_BUFFER, bufferSize, nullptr, GL_STREAM_DRAW);
+        g_context.storage = glMapBufferRange
+        (
+            GL_ARRAY_BUFFER,
+            0,
+            bufferSize,
+            GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_FLUSH_EXPLICIT_BIT
+        );
+    break;
+
+    default:
+    case StreamMode::MAP_RANGE:
+        g_context.storage = glMapBufferRange
+        (
+            GL_ARRAY_BUFFER,
+            0,
+            bufferSize,
+            GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_FLUSH_EXPLICIT_BIT
+        );
+    break;
+    }
 }
 
-void SetMatrix(const float* value)
+void Add(const Sprite& sprite)
+{
+    if (t_recorder != nullptr)
+    {
+        Record(t_recorder, sprite);
+        return;
+    }
+
+    if (g_context.storage == nullptr)
+    {
+        DEBUG("Sprite storage nullptr\n");
+        return;
+    }
+
+    if (g_context.spriteCount >= g_context.capacity)
+    {
+        // The batch is full: draw what we have and keep going in a fresh one.
+        End();
+        Render();
+        Begin();
+    }
+
+    auto storage = static_cast<unsigned char*>(g_context.storage);
+    packInstance(sprite, storage + g_context.stride * g_context.spriteCount);
+
+    g_context.spriteCount += 1;
+}
+
+int reserveBlock(int count)
+{
+    // Returns how many sprites of the block fit the current batch, flushing it first
+    // when it is already full. A short block is used to get back to a multiple of 4
+    // sprites, which keeps the following blocks 16 bytes aligned for streaming.
+    if (g_context.spriteCount >= g_context.capacity)
+    {
+        End();
+        Render();
+        Begin();
+    }
+
+    auto available = g_context.capacity - g_context.spriteCount;
+    auto misaligned = g_context.spriteCount & 3;
+    if (misaligned != 0 && available > 4 - misaligned)
+    {
+        available = 4 - misaligned;
+    }
+
+    return count < available ? count : available;
+}
+
+void addBlocks(const SpriteArrays& sprites, size_t first, size_t count)
+{
+    alignas(16) unsigned char block[SPRITE_BLOCK_SIZE * MAX_INSTANCE_SIZE];
+
+    size_t done = 0;
+    while (done < count)
+    {
+        auto remaining = count - done;
+        auto n = reserveBlock(remaining < SPRITE_BLOCK_SIZE ? static_cast<int>(remaining) : SPRITE_BLOCK_SIZE);
+        if (g_context.storage == nullptr)
+        {
+            return;
+        }
+
+        packInstances(sprites, first + done, n, block);
+
+        auto storage = static_cast<unsigned char*>(g_context.storage);
+        streamInstances(storage + g_context.stride * g_context.spriteCount, block, g_context.stride * n);
+        g_context.spriteCount += n;
+        done += n;
+    }
+
+#if defined(PETIT2D_SSE2)
+    _mm_sfence();
+#endif
+}
+
+void AddRange(const Sprite* sprites, size_t count)
+{
+    if (t_recorder != nullptr)
+    {
+        Record(t_recorder, sprites, count);
+        return;
+    }
+
+    if (g_context.storage == nullptr)
+    {
+        DEBUG("Sprite storage nullptr\n");
+        return;
+    }
+
+    // Sprites are packed one by one into a block, there is nothing to gain from
+    // converting them to arrays first, the block still saves the per sprite
+    // capacity check and streams to the mapped buffer.
+    alignas(16) unsigned char block[SPRITE_BLOCK_SIZE * MAX_INSTANCE_SIZE];
+    auto stride = g_context.stride;
+
+    size_t done = 0;
+    while (done < count)
+    {
+        auto remaining = count - done;
+        auto n = reserveBlock(remaining < SPRITE_BLOCK_SIZE ? static_cast<int>(remaining) : SPRITE_BLOCK_SIZE);
+        if (g_context.storage == nullptr)
+        {
+            return;
+        }
+
+        for (auto i=0; i<n; ++i)
+        {
+            packInstance(sprites[done + i], block + stride * i);
+        }
+
+        auto storage = static_cast<unsigned char*>(g_context.storage);
+        streamInstances(storage + stride * g_context.spriteCount, block, stride * n);
+        g_context.spriteCount += n;
+        done += n;
+    }
+
+#if defined(PETIT2D_SSE2)
+    _mm_sfence();
+#endif
+}
+
+void AddRange(const SpriteArrays& sprites, size_t count)
+{
+    if (t_recorder != nullptr)
+    {
+        Record(t_recorder, sprites, count);
+        return;
+    }
+
+    if (g_context.storage == nullptr)
+    {
+        DEBUG("Sprite storage nullptr\n");
+        return;
+    }
+
+    addBlocks(sprites, 0, count);
+}
+
+Recorder* CreateRecorder()
+{
+    return new Recorder();
+}
+
+void DestroyRecorder(Recorder* recorder)
+{
+    if (recorder != nullptr)
+    {
+        if (t_recorder == recorder)
+        {
+            t_recorder = nullptr;
+        }
+        delete(recorder);
+        recorder = nullptr;
+    }
+}
+
+void Clear(Recorder* recorder)
+{
+    recorder->count = 0;
+    recorder->uploads.clear();
+    recorder->commands.clear();
+}
+
+void SetRecorder(Recorder* recorder)
+{
+    t_recorder = recorder;
+}
+
+int GetCount(const Recorder* recorder)
+{
+    return recorder->count;
+}
+
+unsigned char* reserveRecord(Recorder* recorder, size_t count)
+{
+    // Grow geometrically, recorders are cleared and reused every frame so this
+    // settles after the first few.
+    auto stride = g_context.stride;
+    auto size = stride * (recorder->count + count);
+    if (recorder->data.size() < size)
+    {
+        recorder->data.resize(size > recorder->data.size() * 2 ? size : recorder->data.size() * 2);
+    }
+
+    auto target = recorder->data.data() + stride * recorder->count;
+    recorder->count += static_cast<int>(count);
+    return target;
+}
+
+void Record(Recorder* recorder, const Sprite& sprite)
+{
+    packInstance(sprite, reserveRecord(recorder, 1));
+}
+
+void Record(Recorder* recorder, const Sprite* sprites, size_t count)
+{
+    auto target = reserveRecord(recorder, count);
+    for (size_t i=0; i<count; ++i)
+    {
+        packInstance(sprites[i], target + g_context.stride * i);
+    }
+}
+
+void Record(Recorder* recorder, const SpriteArrays& sprites, size_t count)
+{
+    auto target = reserveRecord(recorder, count);
+
+    size_t done = 0;
+    while (done < count)
+    {
+        auto remaining = count - done;
+        auto n = remaining < SPRITE_BLOCK_SIZE ? static_cast<int>(remaining) : SPRITE_BLOCK_SIZE;
+
+        packInstances(sprites, done, n, target + g_context.stride * done);
+        done += n;
+    }
+}
+
+Batch* CreateBatch()
+{
+    return new Batch();
+}
+
+void DestroyBatch(Batch* batch)
+{
+    if (batch != nullptr)
+    {
+        if (batch->vertexBufferId != 0)
+        {
+            glDeleteBuffers(1, &batch->vertexBufferId);
+            glDeleteVertexArrays(1, &batch->vertexArrayId);
+        }
+        delete(batch);
+        batch = nullptr;
+    }
+}
+
+unsigned char* mapBatch(Batch* batch, size_t count)
+{
+    // The store only grows. Invalidating on map lets the driver hand out fresh
+    // memory while the GPU may still read the previous contents.
+    if (batch->vertexBufferId == 0)
+    {
+        // Sprites may already sit in the stream, keep its vertex array bound.
+        glGenBuffers(1, &batch->vertexBufferId);
+        batch->vertexArrayId = createVertexArray(batch->vertexBufferId);
+        glBindVertexArray(g_context.vertexArrayId);
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, batch->vertexBufferId);
+    if (static_cast<int>(count) > batch->capacity)
+    {
+        batch->capacity = static_cast<int>(count);
+        glBufferData(GL_ARRAY_BUFFER, g_context.stride * count, nullptr, GL_STATIC_DRAW);
+    }
+
+    auto target = static_cast<unsigned char*>(glMapBufferRange
+    (
+        GL_ARRAY_BUFFER,
+        0,
+        g_context.stride * count,
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT
+    ));
+
+    if (target == nullptr)
+    {
+        DEBUG("Sprite batch storage nullptr\n");
+        glBindBuffer(GL_ARRAY_BUFFER, g_context.vertexBufferId);
+        return nullptr;
+    }
+
+    batch->count = static_cast<int>(count);
+    g_context.stats.batchBytes += static_cast<int>(g_context.stride * count);
+    return target;
+}
+
+void unmapBatch()
+{
+    // Back to the stream buffer, End flushes whatever GL_ARRAY_BUFFER is bound.
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+    glBindBuffer(GL_ARRAY_BUFFER, g_context.vertexBufferId);
+}
+
+unsigned char* deferUpload(Recorder* recorder, Batch* batch, size_t count)
+{
+    Deferred command;
+    command.upload = batch;
+    command.index = recorder->count;
+    command.offset = recorder->uploads.size();
+    command.count = static_cast<int>(count);
+    recorder->commands.push_back(command);
+
+    recorder->uploads.resize(command.offset + g_context.stride * count);
+    return recorder->uploads.data() + command.offset;
+}
+
+unsigned char* beginBatch(Batch* batch, size_t count)
+{
+    // Recording threads have no GL context, the upload waits for Submit.
+    if (t_recorder != nullptr)
+    {
+        auto target = deferUpload(t_recorder, batch, count);
+        return count > 0 ? target : nullptr;
+    }
+
+    batch->count = 0;
+    return count > 0 ? mapBatch(batch, count) : nullptr;
+}
+
+void endBatch()
+{
+    if (t_recorder == nullptr)
+    {
+        unmapBatch();
+    }
+}
+
+void SetBatch(Batch* batch, const Sprite* sprites, size_t count)
+{
+    auto target = beginBatch(batch, count);
+    if (target == nullptr)
+    {
+        return;
+    }
+
+    for (size_t i=0; i<count; ++i)
+    {
+        packInstance(sprites[i], target + g_context.stride * i);
+    }
+
+    endBatch();
+}
+
+void SetBatch(Batch* batch, const SpriteArrays& sprites, size_t count)
+{
+    auto target = beginBatch(batch, count);
+    if (target == nullptr)
+    {
+        return;
+    }
+
+    size_t done = 0;
+    while (done < count)
+    {
+        auto remaining = count - done;
+        auto n = remaining < SPRITE_BLOCK_SIZE ? static_cast<int>(remaining) : SPRITE_BLOCK_SIZE;
+
+        packInstances(sprites, done, n, target + g_context.stride * done);
+        done += n;
+    }
+
+    endBatch();
+}
+
+void DrawBatch(const Batch* batch, const float* model)
+{
+    if (t_recorder != nullptr)
+    {
+        Deferred command;
+        command.draw = batch;
+        command.index = t_recorder->count;
+        command.hasModel = model != nullptr;
+        if (model != nullptr)
+        {
+            memcpy(command.model, model, sizeof(command.model));
+        }
+        t_recorder->commands.push_back(command);
+        return;
+    }
+
+    if (batch->count == 0)
+    {
+        return;
+    }
+
+    // Sprites added before the batch are drawn first to keep the painter order.
+    if (g_context.storage != nullptr && g_context.spriteCount > 0)
+    {
+        End();
+        Render();
+        Begin();
+    }
+
+    if (g_context.animated)
+    {
+        glUniform1f(g_context.program->timeUniform, g_context.time);
+    }
+
+    if (model != nullptr)
+    {
+        glUniformMatrix4fv(g_context.program->modelUniform, 1, GL_FALSE, model);
+    }
+
+    glBindVertexArray(batch->vertexArrayId);
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, batch->count);
+    g_context.stats.drawCalls += 1;
+    glBindVertexArray(g_context.vertexArrayId);
+
+    if (model != nullptr)
+    {
+        glUniformMatrix4fv(g_context.program->modelUniform, 1, GL_FALSE, IDENTITY_MATRIX);
+    }
+}
+
+int GetCount(const Batch* batch)
+{
+    return batch->count;
+}
+
+void submitInstances(const unsigned char* source, int count)
+{
+    if (count <= 0)
+    {
+        return;
+    }
+
+    if (g_context.storage == nullptr)
+    {
+        DEBUG("Sprite storage nullptr\n");
+        return;
+    }
+
+    // Instances are already packed: copy them over in as large ranges as the
+    // batch allows, flushing when it fills up.
+    auto stride = g_context.stride;
+    auto remaining = count;
+    while (remaining > 0)
+    {
+        if (g_context.spriteCount >= g_context.capacity)
+        {
+            End();
+            Render();
+            Begin();
+
+            if (g_context.storage == nullptr)
+            {
+                return;
+            }
+        }
+
+        auto available = g_context.capacity - g_context.spriteCount;
+        auto n = remaining < available ? remaining : available;
+
+        auto storage = static_cast<unsigned char*>(g_context.storage);
+        streamInstances(storage + stride * g_context.spriteCount, source, stride * n);
+        g_context.spriteCount += n;
+        source += stride * n;
+        remaining -= n;
+    }
+
+#if defined(PETIT2D_SSE2)
+    _mm_sfence();
+#endif
+}
+
+void submitInstances(const unsigned char* source, int count, float x, float y)
+{
+    if (x == 0.0f && y == 0.0f)
+    {
+        submitInstances(source, count);
+        return;
+    }
+
+    if (count <= 0)
+    {
+        return;
+    }
+
+    if (g_context.storage == nullptr)
+    {
+        DEBUG("Sprite storage nullptr\n");
+        return;
+    }
+
+    // Same copy, through a block where the translations are moved: the mapped
+    // buffer is write-combined and must not be read back.
+    alignas(16) unsigned char block[SPRITE_BLOCK_SIZE * MAX_INSTANCE_SIZE];
+    auto stride = g_context.stride;
+    auto translation = g_context.layout->attributes[ATTRIBUTE_TRANSLATION].offset;
+    auto remaining = count;
+    while (remaining > 0)
+    {
+        auto n = reserveBlock(remaining < SPRITE_BLOCK_SIZE ? remaining : SPRITE_BLOCK_SIZE);
+        if (g_context.storage == nullptr)
+        {
+            return;
+        }
+
+        memcpy(block, source, stride * n);
+        for (auto i=0; i<n; ++i)
+        {
+            float position[2];
+            memcpy(position, block + stride * i + translation, sizeof(position));
+            position[0] += x;
+            position[1] += y;
+            memcpy(block + stride * i + translation, position, sizeof(position));
+        }
+
+        auto storage = static_cast<unsigned char*>(g_context.storage);
+        streamInstances(storage + stride * g_context.spriteCount, block, stride * n);
+        g_context.spriteCount += n;
+        source += stride * n;
+        remaining -= n;
+    }
+
+#if defined(PETIT2D_SSE2)
+    _mm_sfence();
+#endif
+}
+
+void replay(const Recorder* recorder, const Deferred& command, float x, float y)
+{
+    if (command.upload != nullptr)
+    {
+        command.upload->count = 0;
+        auto target = command.count > 0 ? mapBatch(command.upload, command.count) : nullptr;
+        if (target != nullptr)
+        {
+            memcpy(target, recorder->uploads.data() + command.offset, g_context.stride * command.count);
+            unmapBatch();
+        }
+        return;
+    }
+
+    if (x == 0.0f && y == 0.0f)
+    {
+        DrawBatch(command.draw, command.hasModel ? command.model : nullptr);
+        return;
+    }
+
+    // The submit offset goes after the batch model: translation * model.
+    float model[16];
+    memcpy(model, command.hasModel ? command.model : IDENTITY_MATRIX, sizeof(model));
+    for (auto column=0; column<4; ++column)
+    {
+        model[column * 4 + 0] += x * model[column * 4 + 3];
+        model[column * 4 + 1] += y * model[column * 4 + 3];
+    }
+    DrawBatch(command.draw, model);
+}
+
+void Submit(const Recorder* recorder)
+{
+    Submit(recorder, 0.0f, 0.0f);
+}
+
+void Submit(const Recorder* recorder, float x, float y)
+{
+    auto stride = g_context.stride;
+    auto source = recorder->data.data();
+    auto done = 0;
+    for (const auto& command : recorder->commands)
+    {
+        submitInstances(source + stride * done, command.index - done, x, y);
+        done = command.index;
+        replay(recorder, command, x, y);
+    }
+
+    submitInstances(source + stride * done, recorder->count - done, x, y);
+}
+
+void End()
+{
+    if (g_context.streamMode == StreamMode::PERSISTENT)
+    {
+        // The buffer stays mapped, only make this frame writes visible to the GPU.
+        auto offset = g_context.stride * g_context.capacity * g_context.regionIndex;
+        glFlushMappedBufferRange(GL_ARRAY_BUFFER, offset, g_context.stride * g_context.spriteCount);
+        g_context.storage = nullptr;
+        return;
+    }
+
+    glFlushMappedBufferRange(GL_ARRAY_BUFFER, 0, g_context.stride * g_context.spriteCount);
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+    g_context.storage = nullptr;
+}
+
+void Render()
+{
+    if (g_context.spriteCount > 0)
+    {
+        if (g_context.animated)
+        {
+            glUniform1f(g_context.program->timeUniform, g_context.time);
+        }
+
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, g_context.spriteCount);
+        g_context.stats.drawCalls += 1;
+
+        if (g_context.streamMode == StreamMode::PERSISTENT)
+        {
+            auto& fence = g_context.fences[g_context.regionIndex];
+            if (fence != 0)
+            {
+                glDeleteSync(fence);
+            }
+            fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        }
+    }
+}
+
+int GetMaxSprites()
+{
+    return g_context.maxSprite;
+}
+
+Stats GetStats()
+{
+    return g_context.stats;
+}
+
+void ResetStats()
+{
+    g_context.stats = Stats();
+    g_context.stats.streamMode = g_context.streamMode;
+}
+
+bool IsVisible(const Sprite& sprite, const Rect& view)
+{
+    auto halfWidth = fabsf(sprite.width * sprite.scale_x) * 0.5f;
+    auto halfHeight = fabsf(sprite.height * sprite.scale_y) * 0.5f;
+
+    // Cheap pass on the box around the bounding circle, valid for any angle: most
+    // sprites are either far away or well inside and never need a sine.
+    auto radius = halfWidth + halfHeight;
+    if (sprite.x + radius < view.left || sprite.x - radius > view.right ||
+        sprite.y + radius < view.top || sprite.y - radius > view.bottom)
+    {
+        return false;
+    }
+
+    if (sprite.x - radius >= view.left && sprite.x + radius <= view.right &&
+        sprite.y - radius >= view.top && sprite.y + radius <= view.bottom)
+    {
+        return true;
+    }
+
+    // Straddling an edge: test the exact bounds of the rotated quad.
+    auto bounds = GetBounds(sprite);
+    return bounds.right >= view.left && bounds.left <= view.right &&
+           bounds.bottom >= view.top && bounds.top <= view.bottom;
+}
+
+Rect GetBounds(const Sprite& sprite)
+{
+    auto extentX = fabsf(sprite.width * sprite.scale_x) * 0.5f;
+    auto extentY = fabsf(sprite.height * sprite.scale_y) * 0.5f;
+    if (sprite.rotation != 0.0f)
+    {
+        auto radians = sprite.rotation * M_PI_DIV_180;
+        auto c = fabsf(cosf(radians));
+        auto s = fabsf(sinf(radians));
+        auto rotatedX = c * extentX + s * extentY;
+        auto rotatedY = s * extentX + c * extentY;
+        extentX = rotatedX;
+        extentY = rotatedY;
+    }
+
+    Rect bounds;
+    bounds.left = sprite.x - extentX;
+    bounds.top = sprite.y - extentY;
+    bounds.right = sprite.x + extentX;
+    bounds.bottom = sprite.y + extentY;
+
+    return bounds;
+}
+
+size_t Cull(const Rect& view, const Sprite* sprites, size_t count, Sprite* visible)
+{
+    size_t visibleCount = 0;
+    for (size_t i=0; i<count; ++i)
+    {
+        if (IsVisible(sprites[i], view))
+        {
+            visible[visibleCount] = sprites[i];
+            visibleCount += 1;
+        }
+    }
+
+    return visibleCount;
+}
+
+} // namespace Sprite
+
+//-----------------------------------------------------------------------------
+// [SECTION] Shapes
+//-----------------------------------------------------------------------------
+
+namespace Shape
+{
+
+const char* VERTEX_SRC = R"text(
+    #version 330 core
+    precision lowp float;
+
+    layout (location = 0) in vec2 position;
+    layout (location = 1) in vec4 color;
+
+    out vec4 inColor;
+
+    uniform mat4 projection;
+
+    void main() {
+        gl_Position = projection * vec4(position, 0.0, 1.0);
+        inColor = color;
+    }
+)text";
+
+const char* FRAGMENT_SRC = R"text(
+    #version 330 core
+    precision lowp float;
+
+    in vec4 inColor;
+
+    out vec4 fragColor;
+
+    void main() {
+        fragColor = inColor;
+    }
+)text";
+
+// Primitive batches keep one index list per primitive class, strips, fans and
+// loops are unrolled into the list of their class.
+enum PrimitiveClass : int
+{
+    PRIMITIVE_TRIANGLES     = 0,
+    PRIMITIVE_LINES         = 1,
+    PRIMITIVE_POINTS        = 2,
+    PRIMITIVE_COUNT         = 3
+};
+
+const GLenum PRIMITIVE_MODES[PRIMITIVE_COUNT] = { GL_TRIANGLES, GL_LINES, GL_POINTS };
+
+struct IndexRange
+{
+    size_t  offset                  = 0;
+    int     count                   = 0;
+};
+
+struct Context
+{
+    GLuint  vertexBufferId          = 0;
+    GLuint  vertexArrayId           = 0;
+    GLuint  indexBufferId           = 0;
+    int     verticesCount           = 0;
+    int     maxVertices             = 0;
+    int     capacity                = 0;
+    float   pointSize               = 1.0f;
+    float   lineWidth               = 1.0f;
+    void*   storage                 = nullptr;
+    Stats   stats;
+
+    // Automatic flush state, drawType is -1 when the batch primitive is unknown.
+    int     drawType                = -1;
+    bool    continued               = false;
+    Vertex  first;
+    Vertex  last[2];
+
+    // Primitive batch state, indices are uploaded on EndPrimitives.
+    std::vector<GLuint>     indices[PRIMITIVE_COUNT];
+    IndexRange              ranges[PRIMITIVE_COUNT];
+
+    GLuint  programShaderId         = 0;
+    GLint   matrixUniform           = 0;
+    GLint   vertexLocation          = 0;
+    GLint   colorLocation           = 0;
+} g_context;
+
+void Create(const Config& config)
+{
+    auto vertexShader = compileShader(GL_VERTEX_SHADER, VERTEX_SRC);
+    auto fragmentShader = compileShader(GL_FRAGMENT_SHADER, FRAGMENT_SRC);
+
+    g_context.programShaderId = glCreateProgram();
+    glAttachShader(g_context.programShaderId, vertexShader);
+    glAttachShader(g_context.programShaderId, fragmentShader);
+    glLinkProgram(g_context.programShaderId);
+
+    glDeleteShader(vertexShader);
+    glDeleteShader(fragmentShader);
+    checkProgram(g_context.programShaderId);
+
+    g_context.capacity = config.maxVerticesPerBatch;
+    if (g_context.capacity < 4)
+    {
+        DEBUG("Vertices per batch less than 4, adjusting to 4.\n");
+        g_context.capacity = 4;
+    }
+
+    g_context.matrixUniform = glGetUniformLocation(g_context.programShaderId, "projection");
+    g_context.vertexLocation = glGetAttribLocation(g_context.programShaderId, "position");
+    g_context.colorLocation = glGetAttribLocation(g_context.programShaderId, "color");
+ 
+    glGenBuffers(1, &g_context.vertexBufferId);
+    glBindBuffer(GL_ARRAY_BUFFER, g_context.vertexBufferId);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex) * g_context.capacity, nullptr, GL_STREAM_DRAW);
+
+    glGenVertexArrays(1, &g_context.vertexArrayId);
+    glBindVertexArray(g_context.vertexArrayId);
+
+    glVertexAttribPointer(g_context.vertexLocation, 2, GL_FLOAT, false, sizeof(Vertex), (void*) offsetof(Vertex, x));
+    glVertexAttribPointer(g_context.colorLocation, 4, GL_UNSIGNED_BYTE, true, sizeof(Vertex), (void*) offsetof(Vertex, r));
+
+    glEnableVertexAttribArray(g_context.vertexLocation);
+    glEnableVertexAttribArray(g_context.colorLocation);
+
+    // The element buffer binding is part of the vertex array state.
+    glGenBuffers(1, &g_context.indexBufferId);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g_context.indexBufferId);
+
+    glBindVertexArray(0);
+}
+
+void Destroy()
+{
+    glDeleteProgram(g_context.programShaderId);
+    glDeleteBuffers(1, &g_context.vertexBufferId);
+    glDeleteBuffers(1, &g_context.indexBufferId);
+    glDeleteVertexArrays(1, &g_context.vertexArrayId);
+}
+
+void Use()
+{
+    glUseProgram(g_context.programShaderId);
+    glBindBuffer(GL_ARRAY_BUFFER, g_context.vertexBufferId);
+    glBindVertexArray(g_context.vertexArrayId);
+}
+
+void SetMatrix(const float* value)
+{
+    glUniformMatrix4fv(g_context.matrixUniform, 1, GL_FALSE, value);
+}
+
+void SetMatrix(const Camera::Camera* camera)
+{
+    SetMatrix(Camera::GetMatrix(camera));
+}
+
+void SetPointSize(float size)
+{
+    if (size < 0)
+    {
+        DEBUG("Point size less than 0, adjusting to 0.\n");
+        size = 0;
+
+    }
+
+    if (size > 32)
+    {
+        DEBUG("Point size greater than 32, adjusting to 32.\n");
+        size = 32;
+    }
+
+    g_context.pointSize = size;
+    glPointSize(size);
+}
+
+float GetPointSize()
+{
+    return g_context.pointSize;
+}
+
+void SetLineWidth(float width)
+{
+    if (width < 0)
+    {
+        DEBUG("Line width less than 0, adjusting to 0.\n");
+        width = 0;
+
+    }
+
+    if (width > 32)
+    {
+        DEBUG("Line width greater than 32, adjusting to 32.\n");
+        width = 32;
+    }
+
+    g_context.lineWidth = width;
+    glLineWidth(width);
+}
+
+float GetLineWidth()
+{
+    return g_context.lineWidth;
+}
+
+int getBatchLimit()
+{
+    // Largest vertex count that still ends on a primitive boundary, so a flush
+    // never splits a primitive in two. Line loops keep one slot for the closing vertex.
+    auto capacity = g_context.capacity;
+    switch (g_context.drawType)
+    {
+    case DrawType::LINES:           return capacity - (capacity % 2);
+    case DrawType::TRIANGLES:       return capacity - (capacity % 3);
+    case DrawType::TRIANGLES_STRIP: return capacity - (capacity % 2);
+    case DrawType::LINE_LOOP:       return capacity - 1;
+    default:                        return capacity;
+    }
+}
+
+void map()
+{
+    g_context.verticesCount = 0;
+    g_context.storage = glMapBufferRange
+    (
+        GL_ARRAY_BUFFER,
+        0,
+        sizeof(Vertex) * g_context.capacity,
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_FLUSH_EXPLICIT_BIT
+    );
+}
+
+void write(const Vertex& vertex)
+{
+    auto storage = static_cast<Vertex*>(g_context.storage);
+    auto index = g_context.verticesCount;
+        
+    storage[index].x = vertex.x;
+    storage[index].y = vertex.y;
+    storage[index].r = vertex.r;
+    storage[index].g = vertex.g;
+    storage[index].b = vertex.b;
+    storage[index].a = vertex.a;
+
+    ++g_context.verticesCount;
+}
+
+void flush()
+{
+    // Strips, fans and loops share vertices with the next primitive: remember the
+    // ones the next batch needs, draw, then seed the fresh batch with them.
+    auto drawType = static_cast<DrawType>(g_context.drawType);
+    Vertex carry[2];
+    auto carryCount = 0;
+    switch (drawType)
+    {
+    case DrawType::LINE_STRIP:
+    case DrawType::LINE_LOOP:
+        carry[carryCount++] = g_context.last[1];
+    break;
+
+    case DrawType::TRIANGLES_STRIP:
+        carry[carryCount++] = g_context.last[0];
+        carry[carryCount++] = g_context.last[1];
+    break;
+
+    case DrawType::TRIANGLES_FAN:
+        carry[carryCount++] = g_context.first;
+        carry[carryCount++] = g_context.last[1];
+    break;
+
+    default:
+    break;
+    }
+
+    glFlushMappedBufferRange(GL_ARRAY_BUFFER, 0, sizeof(Vertex) * g_context.verticesCount);
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+    Render(drawType == DrawType::LINE_LOOP ? DrawType::LINE_STRIP : drawType);
+
+    g_context.continued = true;
+    map();
+    for (auto i=0; i<carryCount; ++i)
+    {
+        write(carry[i]);
+    }
+}
+
+void Begin()
+{
+    Begin(static_cast<DrawType>(-1));
+}
+
+void Begin(const DrawType drawType)
+{
+    if (g_context.maxVertices < g_context.verticesCount)
+    {
+        g_context.maxVertices = g_context.verticesCount;
+    }
+
+    g_context.drawType = drawType;
+    g_context.continued = false;
+    map();
+}
+
+void Add(const Vertex& vertex)
+{
+    if (g_context.storage == nullptr)
+    {
+        DEBUG("Shape storage nullptr\n");
+        return;
+    }
+
+    if (g_context.verticesCount >= getBatchLimit())
+    {
+        if (g_context.drawType < 0)
+        {
+            DEBUG("verticesCount >= maxVerticesPerBatch, use Begin(drawType) to flush automatically\n");
+            return;
+        }
+
+        flush();
+    }
+
+    if (g_context.verticesCount == 0 && !g_context.continued)
+    {
+        g_context.first = vertex;
+    }
+    g_context.last[0] = g_context.last[1];
+    g_context.last[1] = vertex;
+
+    write(vertex);
+}
+
+void End()
+{
+    if (g_context.storage == nullptr)
+    {
+        return;
+    }
+
+    // A loop split over several batches is drawn as strips, close it by hand.
+    if (g_context.continued && g_context.drawType == DrawType::LINE_LOOP)
+    {
+        write(g_context.first);
+    }
+
+    glFlushMappedBufferRange(GL_ARRAY_BUFFER, 0, sizeof(Vertex) * g_context.verticesCount);
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+    g_context.storage = nullptr;
+}
+
+void Render(const DrawType drawType)
+{
+    if (g_context.verticesCount > 0)
+    {
+        auto type = drawType;
+        if (g_context.continued && type == DrawType::LINE_LOOP)
+        {
+            type = DrawType::LINE_STRIP;
+        }
+
+        glDrawArrays(getDrawType(type), 0, g_context.verticesCount);
+        g_context.stats.drawCalls += 1;
+    }
+}
+
+void BeginPrimitives()
+{
+    Begin();
+    for (auto& indices : g_context.indices)
+    {
+        indices.clear();
+    }
+}
+
+bool reservePrimitive(int count)
+{
+    if (g_context.storage == nullptr)
+    {
+        DEBUG("Shape storage nullptr\n");
+        return false;
+    }
+
+    if (count > g_context.capacity)
+    {
+        DEBUG("Shape primitive with %d vertices greater than maxVerticesPerBatch\n", count);
+        return false;
+    }
+
+    // Primitives are never split, a batch that can not hold this one is drawn first.
+    if (g_context.verticesCount + count > g_context.capacity)
+    {
+        EndPrimitives();
+        RenderPrimitives();
+        BeginPrimitives();
+    }
+
+    return true;
+}
+
+void AddPrimitive(const Vertex* vertices, int count, const DrawType drawType)
+{
+    if (vertices == nullptr || count <= 0 || !reservePrimitive(count))
+    {
+        return;
+    }
+
+    auto base = static_cast<GLuint>(g_context.verticesCount);
+    for (auto i=0; i<count; ++i)
+    {
+        write(vertices[i]);
+    }
+
+    auto& points = g_context.indices[PRIMITIVE_POINTS];
+    auto& lines = g_context.indices[PRIMITIVE_LINES];
+    auto& triangles = g_context.indices[PRIMITIVE_TRIANGLES];
+    GLuint n = count;
+    switch (drawType)
+    {
+    case DrawType::POINTS:
+        for (GLuint i=0; i<n; ++i)
+        {
+            points.push_back(base + i);
+        }
+    break;
+
+    case DrawType::LINES:
+        for (GLuint i=0; i+1<n; i+=2)
+        {
+            lines.insert(lines.end(), { base + i, base + i + 1 });
+        }
+    break;
+
+    case DrawType::LINE_STRIP:
+    case DrawType::LINE_LOOP:
+        for (GLuint i=0; i+1<n; ++i)
+        {
+            lines.insert(lines.end(), { base + i, base + i + 1 });
+        }
+        if (drawType == DrawType::LINE_LOOP && n > 2)
+        {
+            lines.insert(lines.end(), { base + n - 1, base });
+        }
+    break;
+
+    case DrawType::TRIANGLES:
+        for (GLuint i=0; i+2<n; i+=3)
+        {
+            triangles.insert(triangles.end(), { base + i, base + i + 1, base + i + 2 });
+        }
+    break;
+
+    case DrawType::TRIANGLES_STRIP:
+        // Odd triangles swap their first two vertices to keep the strip winding.
+        for (GLuint i=0; i+2<n; ++i)
+        {
+            if (i % 2 == 0)
+            {
+                triangles.insert(triangles.end(), { base + i, base + i + 1, base + i + 2 });
+            }
+            else
+            {
+                triangles.insert(triangles.end(), { base + i + 1, base + i, base + i + 2 });
+            }
+        }
+    break;
+
+    case DrawType::TRIANGLES_FAN:
+        for (GLuint i=1; i+1<n; ++i)
+        {
+            triangles.insert(triangles.end(), { base, base + i, base + i + 1 });
+        }
+    break;
+    }
+}
+
+void AddIndexed(const Vertex* vertices, int count, const unsigned int* indices, int indexCount, const DrawType drawType)
+{
+    if (vertices == nullptr || indices == nullptr || count <= 0 || indexCount <= 0)
+    {
+        return;
+    }
+
+    auto primitive = PRIMITIVE_COUNT;
+    switch (drawType)
+    {
+    case DrawType::POINTS:      primitive = PRIMITIVE_POINTS;       break;
+    case DrawType::LINES:       primitive = PRIMITIVE_LINES;        break;
+    case DrawType::TRIANGLES:   primitive = PRIMITIVE_TRIANGLES;    break;
+    default:
+        DEBUG("Indexed shapes must be POINTS, LINES or TRIANGLES\n");
+        return;
+    }
+
+    for (auto i=0; i<indexCount; ++i)
+    {
+        if (indices[i] >= static_cast<unsigned int>(count))
+        {
+            DEBUG("Shape index %u out of range, %d vertices\n", indices[i], count);
+            return;
+        }
+    }
+
+    if (!reservePrimitive(count))
+    {
+        return;
+    }
+
+    auto base = static_cast<GLuint>(g_context.verticesCount);
+    for (auto i=0; i<count; ++i)
+    {
+        write(vertices[i]);
+    }
+
+    auto& target = g_context.indices[primitive];
+    for (auto i=0; i<indexCount; ++i)
+    {
+        target.push_back(base + indices[i]);
+    }
+}
+
+void EndPrimitives()
+{
+    if (g_context.storage == nullptr)
+    {
+        return;
+    }
+
+    End();
+
+    size_t size = 0;
+    for (auto i=0; i<PRIMITIVE_COUNT; ++i)
+    {
+        auto& range = g_context.ranges[i];
+        range.offset = size;
+        range.count = static_cast<int>(g_context.indices[i].size());
+        size += sizeof(GLuint) * range.count;
+    }
+
+    // Orphan the previous frame's indices, then append every class.
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g_context.indexBufferId);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, size, nullptr, GL_STREAM_DRAW);
+    for (auto i=0; i<PRIMITIVE_COUNT; ++i)
+    {
+        const auto& range = g_context.ranges[i];
+        if (range.count > 0)
+        {
+            glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, range.offset, sizeof(GLuint) * range.count, g_context.indices[i].data());
+        }
+    }
+}
+
+void RenderPrimitives()
+{
+    for (auto i=0; i<PRIMITIVE_COUNT; ++i)
+    {
+        const auto& range = g_context.ranges[i];
+        if (range.count > 0)
+        {
+            glDrawElements(PRIMITIVE_MODES[i], range.count, GL_UNSIGNED_INT, (void*) range.offset);
+            g_context.stats.drawCalls += 1;
+        }
+    }
+}
+
+int GetMaxVertices()
+{
+    return g_context.maxVertices;
+}
+
+Stats GetStats()
+{
+    return g_context.stats;
+}
+
+void ResetStats()
+{
+    g_context.stats = Stats();
+}
+
+} // namespace Shape
+
+//-----------------------------------------------------------------------------
+// [SECTION] Lines
+//-----------------------------------------------------------------------------
+
+namespace Line
+{
+
+// One instance per segment, expanded to a quad around it. Each end gets a cap,
+// or a join when the segment knows its neighbour on that side. Coverage comes
+// from the distance to the stroke edge, one pixel wide.
+const char* VERTEX_SRC = R"text(
+    #version 330 core
+    precision highp float;
+
+    layout (location = 0) in vec4 segment;
+    layout (location = 1) in vec4 neighbours;
+    layout (location = 2) in float width;
+    layout (location = 3) in vec4 color0;
+    layout (location = 4) in vec4 color1;
+    layout (location = 5) in float flags;
+
+    out vec2 inLocal;
+    flat out vec4 inColor0;
+    flat out vec4 inColor1;
+    flat out vec4 inShape;
+    flat out ivec2 inEnds;
+
+    uniform mat4 projection;
+    uniform vec2 viewport;
+    uniform int cap;
+    uniform int join;
+    uniform float miterLimit;
+
+    const int END_BUTT      = 0;
+    const int END_SQUARE    = 1;
+    const int END_ROUND     = 2;
+    const int END_MITER     = 3;
+    const int JOIN_MITER    = 0;
+
+    // Picks the shape of one end, for a miter also the offset of its corners.
+    int getEnd(int end, vec2 t, vec2 n, out vec2 miter) {
+        miter = n;
+        if ((int(flags) & (end == 0 ? 1 : 2)) == 0)
+        {
+            return cap;
+        }
+
+        // Tangents in drawing order through the joint, both segments meeting
+        // there build the same miter line.
+        vec2 other = end == 0 ? segment.xy - neighbours.xy : neighbours.zw - segment.zw;
+        vec2 m = normalize(other) + t;
+        if (join != JOIN_MITER || dot(m, m) < 1e-6)
+        {
+            return END_ROUND;
+        }
+
+        vec2 normal = normalize(vec2(-m.y, m.x));
+        float scale = 1.0 / dot(normal, n);
+        if (scale <= 0.0 || scale > miterLimit)
+        {
+            return END_ROUND;
+        }
+
+        miter = normal * scale;
+        return END_MITER;
+    }
+
+    void main() {
+        vec2 p0 = segment.xy;
+        vec2 p1 = segment.zw;
+        vec2 dir = p1 - p0;
+        float len = length(dir);
+        vec2 t = len > 0.0 ? dir / len : vec2(1.0, 0.0);
+        vec2 n = vec2(-t.y, t.x);
+
+        // World units per pixel, rotation does not change the column length.
+        float pixel = 2.0 / (length(projection[0].xy) * viewport.x);
+        float coverage = min(width / pixel, 1.0);
+        float halfWidth = max(width, pixel) * 0.5;
+        float extent = halfWidth + pixel;
+
+        vec2 miter0;
+        vec2 miter1;
+        ivec2 ends = ivec2(getEnd(0, t, n, miter0), getEnd(1, t, n, miter1));
+
+        int end = gl_VertexID >> 1;
+        int mode = end == 0 ? ends.x : ends.y;
+        float side = (gl_VertexID & 1) == 0 ? -1.0 : 1.0;
+        float forward = end == 0 ? -1.0 : 1.0;
+        vec2 base = end == 0 ? p0 : p1;
+
+        vec2 position;
+        if (mode == END_MITER)
+        {
+            position = base + (end == 0 ? miter0 : miter1) * side * extent;
+        }
+        else
+        {
+            position = base + n * side * extent + t * forward * (mode == END_BUTT ? pixel : extent);
+        }
+
+        vec2 local = position - p0;
+        inLocal = vec2(dot(local, t), dot(local, n));
+        inShape = vec4(len, halfWidth, pixel, coverage);
+        inEnds = ends;
+        inColor0 = color0;
+        inColor1 = color1;
+        gl_Position = projection * vec4(position, 0.0, 1.0);
+    }
+)text";
+
+const char* FRAGMENT_SRC = R"text(
+    #version 330 core
+    precision highp float;
+
+    in vec2 inLocal;
+    flat in vec4 inColor0;
+    flat in vec4 inColor1;
+    flat in vec4 inShape;
+    flat in ivec2 inEnds;
+
+    out vec4 fragColor;
+
+    const int END_BUTT      = 0;
+    const int END_SQUARE    = 1;
+    const int END_ROUND     = 2;
+
+    float clipEnd(float d, int mode, float along, float across, float halfWidth) {
+        if (mode == END_BUTT)   return max(d, along);
+        if (mode == END_SQUARE) return max(d, along - halfWidth);
+        if (mode == END_ROUND && along > 0.0) return length(vec2(along, across)) - halfWidth;
+        return d;
+    }
+
+    void main() {
+        float len = inShape.x;
+        float halfWidth = inShape.y;
+        float d = abs(inLocal.y) - halfWidth;
+        d = clipEnd(d, inEnds.x, -inLocal.x, inLocal.y, halfWidth);
+        d = clipEnd(d, inEnds.y, inLocal.x - len, inLocal.y, halfWidth);
+
+        float alpha = clamp(0.5 - d / inShape.z, 0.0, 1.0) * inShape.w;
+        vec4 color = mix(inColor0, inColor1, len > 0.0 ? clamp(inLocal.x / len, 0.0, 1.0) : 0.0);
+        fragColor = vec4(color.rgb, color.a * alpha);
+    }
+)text";
+
+struct LineInstance
+{
+    float           x0, y0, x1, y1;
+    float           prev_x, prev_y, next_x, next_y;
+    float           width;
+    unsigned char   r0, g0, b0, a0;
+    unsigned char   r1, g1, b1, a1;
+    float           flags;
+};
+
+static_assert(sizeof(LineInstance) == 48, "LineInstance must stay tightly packed");
+
+enum Flag : int
+{
+    FLAG_PREV           = 1,
+    FLAG_NEXT           = 2
+};
+
+struct Context
+{
+    GLuint  vertexBufferId          = 0;
+    GLuint  vertexArrayId           = 0;
+    int     lineCount               = 0;
+    int     capacity                = 0;
+    void*   storage                 = nullptr;
+    Cap     cap                     = Cap::CAP_BUTT;
+    Join    join                    = Join::JOIN_MITER;
+    float   miterLimit              = 4.0f;
+    float   viewport[2]             = { 1.0f, 1.0f };
+    Stats   stats;
+
+    GLuint  programShaderId         = 0;
+    GLint   matrixUniform           = 0;
+    GLint   viewportUniform         = 0;
+    GLint   capUniform              = 0;
+    GLint   joinUniform             = 0;
+    GLint   miterLimitUniform       = 0;
+} g_context;
+
+void setViewport(int width, int height)
+{
+    g_context.viewport[0] = width > 0 ? static_cast<float>(width) : 1.0f;
+    g_context.viewport[1] = height > 0 ? static_cast<float>(height) : 1.0f;
+}
+
+void Create(const Config& config)
+{
+    auto vertexShader = compileShader(GL_VERTEX_SHADER, VERTEX_SRC);
+    auto fragmentShader = compileShader(GL_FRAGMENT_SHADER, FRAGMENT_SRC);
+
+    g_context.programShaderId = glCreateProgram();
+    glAttachShader(g_context.programShaderId, vertexShader);
+    glAttachShader(g_context.programShaderId, fragmentShader);
+    glLinkProgram(g_context.programShaderId);
+
+    glDeleteShader(vertexShader);
+    glDeleteShader(fragmentShader);
+    checkProgram(g_context.programShaderId);
+
+    g_context.capacity = config.maxLinesPerBatch;
+    if (g_context.capacity < 1)
+    {
+        DEBUG("Lines per batch less than 1, adjusting to 1.\n");
+        g_context.capacity = 1;
+    }
+
+    g_context.matrixUniform = glGetUniformLocation(g_context.programShaderId, "projection");
+    g_context.viewportUniform = glGetUniformLocation(g_context.programShaderId, "viewport");
+    g_context.capUniform = glGetUniformLocation(g_context.programShaderId, "cap");
+    g_context.joinUniform = glGetUniformLocation(g_context.programShaderId, "join");
+    g_context.miterLimitUniform = glGetUniformLocation(g_context.programShaderId, "miterLimit");
+
+    // Until SetViewport is called the default viewport covers the window.
+    GLint viewport[4] = { 0, 0, 1, 1 };
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    setViewport(viewport[2], viewport[3]);
+
+    glGenBuffers(1, &g_context.vertexBufferId);
+    glBindBuffer(GL_ARRAY_BUFFER, g_context.vertexBufferId);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(LineInstance) * g_context.capacity, nullptr, GL_STREAM_DRAW);
+
+    glGenVertexArrays(1, &g_context.vertexArrayId);
+    glBindVertexArray(g_context.vertexArrayId);
+
+    auto stride = sizeof(LineInstance);
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, stride, (void*) offsetof(LineInstance, x0));
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, stride, (void*) offsetof(LineInstance, prev_x));
+    glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, stride, (void*) offsetof(LineInstance, width));
+    glVertexAttribPointer(3, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, (void*) offsetof(LineInstance, r0));
+    glVertexAttribPointer(4, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, (void*) offsetof(LineInstance, r1));
+    glVertexAttribPointer(5, 1, GL_FLOAT, GL_FALSE, stride, (void*) offsetof(LineInstance, flags));
+
+    for (auto i=0; i<6; ++i)
+    {
+        glEnableVertexAttribArray(i);
+        glVertexAttribDivisor(i, 1);
+    }
+
+    glBindVertexArray(0);
+}
+
+void Destroy()
+{
+    glDeleteProgram(g_context.programShaderId);
+    glDeleteBuffers(1, &g_context.vertexBufferId);
+    glDeleteVertexArrays(1, &g_context.vertexArrayId);
+}
+
+void Use()
+{
+    glUseProgram(g_context.programShaderId);
+    glBindBuffer(GL_ARRAY_BUFFER, g_context.vertexBufferId);
+    glBindVertexArray(g_context.vertexArrayId);
+}
+
+void SetMatrix(const float* value)
+{
+    glUniformMatrix4fv(g_context.matrixUniform, 1, GL_FALSE, value);
+}
+
+void SetMatrix(const Camera::Camera* camera)
+{
+    SetMatrix(Camera::GetMatrix(camera));
+}
+
+void SetCap(Cap cap)
+{
+    g_context.cap = cap;
+}
+
+void SetJoin(Join join)
+{
+    g_context.join = join;
+}
+
+void SetMiterLimit(float limit)
+{
+    if (limit < 1.0f)
+    {
+        DEBUG("Miter limit less than 1, adjusting to 1.\n");
+        limit = 1.0f;
+    }
+
+    g_context.miterLimit = limit;
+}
+
+void Begin()
+{
+    g_context.lineCount = 0;
+    g_context.storage = glMapBufferRange
+    (
+        GL_ARRAY_BUFFER,
+        0,
+        sizeof(LineInstance) * g_context.capacity,
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_FLUSH_EXPLICIT_BIT
+    );
+}
+
+void add(const Shape::Vertex& from, const Shape::Vertex& to, const Shape::Vertex* prev, const Shape::Vertex* next, float width)
+{
+    if (g_context.storage == nullptr)
+    {
+        DEBUG("Line storage nullptr\n");
+        return;
+    }
+
+    if (g_context.lineCount >= g_context.capacity)
+    {
+        // Segments carry their neighbours, a polyline can span two batches.
+        End();
+        Render();
+        Begin();
+    }
+
+    LineInstance instance;
+    instance.x0 = from.x;
+    instance.y0 = from.y;
+    instance.x1 = to.x;
+    instance.y1 = to.y;
+    instance.prev_x = prev != nullptr ? prev->x : from.x;
+    instance.prev_y = prev != nullptr ? prev->y : from.y;
+    instance.next_x = next != nullptr ? next->x : to.x;
+    instance.next_y = next != nullptr ? next->y : to.y;
+    instance.width = width;
+    instance.r0 = from.r;
+    instance.g0 = from.g;
+    instance.b0 = from.b;
+    instance.a0 = from.a;
+    instance.r1 = to.r;
+    instance.g1 = to.g;
+    instance.b1 = to.b;
+    instance.a1 = to.a;
+    instance.flags = static_cast<float>((prev != nullptr ? FLAG_PREV : 0) | (next != nullptr ? FLAG_NEXT : 0));
+
+    auto storage = static_cast<LineInstance*>(g_context.storage);
+    storage[g_context.lineCount] = instance;
+    g_context.lineCount += 1;
+}
+
+void Add(const Shape::Vertex& from, const Shape::Vertex& to, float width)
+{
+    add(from, to, nullptr, nullptr, width);
+}
+
+bool samePoint(const Shape::Vertex& a, const Shape::Vertex& b)
+{
+    return a.x == b.x && a.y == b.y;
+}
+
+void AddPolyline(const Shape::Vertex* vertices, int count, float width, bool closed)
+{
+    if (vertices == nullptr || count < 2)
+    {
+        return;
+    }
+
+    // Repeated points would give a joint without a direction, segments and
+    // neighbours both skip them.
+    auto step = [&](int index, int direction) -> int
+    {
+        for (auto i=1; i<count; ++i)
+        {
+            auto other = index + direction * i;
+            if (closed)
+            {
+                other = (other + count) % count;
+            }
+            else if (other < 0 || other >= count)
+            {
+                return -1;
+            }
+
+            if (!samePoint(vertices[other], vertices[index]))
+            {
+                return other;
+            }
+        }
+        return -1;
+    };
+
+    auto segments = closed ? count : count - 1;
+    for (auto i=0; i<segments; ++i)
+    {
+        const auto& from = vertices[i];
+        const auto& to = vertices[(i + 1) % count];
+        if (samePoint(from, to))
+        {
+            continue;
+        }
+
+        auto prev = step(i, -1);
+        auto next = step((i + 1) % count, 1);
+        add(from, to, prev >= 0 ? &vertices[prev] : nullptr, next >= 0 ? &vertices[next] : nullptr, width);
+    }
+}
+
+void End()
+{
+    if (g_context.storage == nullptr)
+    {
+        return;
+    }
+
+    glFlushMappedBufferRange(GL_ARRAY_BUFFER, 0, sizeof(LineInstance) * g_context.lineCount);
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+    g_context.storage = nullptr;
+}
+
+void Render()
+{
+    if (g_context.lineCount > 0)
+    {
+        glUniform2fv(g_context.viewportUniform, 1, g_context.viewport);
+        glUniform1i(g_context.capUniform, g_context.cap);
+        glUniform1i(g_context.joinUniform, g_context.join);
+        glUniform1f(g_context.miterLimitUniform, g_context.miterLimit);
+
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, g_context.lineCount);
+        g_context.stats.drawCalls += 1;
+    }
+}
+
+Stats GetStats()
+{
+    return g_context.stats;
+}
+
+void ResetStats()
+{
+    g_context.stats = Stats();
+}
+
+} // namespace Line
+
+//-----------------------------------------------------------------------------
+// [SECTION] Particles
+//-----------------------------------------------------------------------------
+
+namespace Particle
+{
+
+// Particle i of an emitter is born every lifetime seconds, i / rate after the
+// start, and everything about one life comes from a hash of i, the life and the
+// emitter seed. Nothing is stored per particle: the instance id is the index.
+const char* VERTEX_SRC = R"text(
+    #version 330 core
+    precision highp float;
+
+    out vec4 inColor;
+    out vec2 inTexCoord;
+
+    uniform mat4 projection;
+    uniform float time;
+
+    // 0: x, y, spawn radius, seed
+    // 1: angle, spread, min speed, max speed, radians and units per second
+    // 2: gravity x, gravity y, lifetime, rate
+    // 3: start, duration, min spin, max spin, seconds and radians per second
+    // 4: start size, end size, unused, unused
+    // 5: start color
+    // 6: end color
+    // 7: s, t, p, q
+    uniform vec4 emitter[8];
+
+    uint hash(uint x) {
+        x ^= x >> 16;
+        x *= 0x7feb352du;
+        x ^= x >> 15;
+        x *= 0x846ca68bu;
+        x ^= x >> 16;
+        return x;
+    }
+
+    float random(inout uint state) {
+        state = hash(state);
+        return float(state >> 8) * (1.0 / 16777216.0);
+    }
+
+    void main() {
+        const ivec2 tlut[4] = ivec2[4] (
+            ivec2(2, 1),
+            ivec2(0, 1),
+            ivec2(2, 3),
+            ivec2(0, 3)
+        );
+
+        const vec2 plut[4] = vec2[4] (
+            vec2(0.5, -0.5),
+            vec2(-0.5, -0.5),
+            vec2(0.5, 0.5),
+            vec2(-0.5, 0.5)
+        );
+
+        float lifetime = emitter[2].z;
+        float delay = float(gl_InstanceID) / emitter[2].w;
+        float elapsed = time - emitter[3].x - delay;
+        float life = floor(elapsed / lifetime);
+        float age = elapsed - life * lifetime;
+        float duration = emitter[3].y;
+
+        inTexCoord = vec2(0.0);
+        inColor = vec4(0.0);
+        if (elapsed < 0.0 || (duration > 0.0 && delay + life * lifetime >= duration)) {
+            // Not born yet or past the emitter duration: a degenerate quad.
+            gl_Position = vec4(0.0, 0.0, 0.0, 1.0);
+            return;
+        }
+
+        uint state = hash(uint(gl_InstanceID) ^ hash(uint(life) + uint(emitter[0].w) * 0x9e3779b9u));
+        float angle = emitter[1].x + (random(state) - 0.5) * emitter[1].y;
+        float speed = mix(emitter[1].z, emitter[1].w, random(state));
+        float spawnAngle = random(state) * 6.2831853;
+        float spawnDistance = sqrt(random(state)) * emitter[0].z;
+        float spin = mix(emitter[3].z, emitter[3].w, random(state));
+
+        float t = age / lifetime;
+        vec2 position = emitter[0].xy
+            + vec2(cos(spawnAngle), sin(spawnAngle)) * spawnDistance
+            + vec2(cos(angle), sin(angle)) * speed * age
+            + 0.5 * emitter[2].xy * age * age;
+
+        float radians = spin * age;
+        vec2 corner = plut[gl_VertexID] * mix(emitter[4].x, emitter[4].y, t);
+        corner = vec2(
+            corner.x * cos(radians) - corner.y * sin(radians),
+            corner.x * sin(radians) + corner.y * cos(radians)
+        );
+
+        gl_Position = projection * vec4(position + corner, 0.0, 1.0);
+        inTexCoord = vec2(emitter[7][tlut[gl_VertexID].x], emitter[7][tlut[gl_VertexID].y]);
+        inColor = mix(emitter[5], emitter[6], t);
+    }
+)text";
+
+const char* FRAGMENT_SRC = R"text(
+    #version 330 core
+    precision lowp float;
+
+    in vec4 inColor;
+    in vec2 inTexCoord;
+
+    out vec4 fragColor;
+
+    uniform sampler2D tex2D;
+
+    void main() {
+        fragColor = inColor * texture(tex2D, inTexCoord);
+    }
+)text";
+
+struct Context
+{
+    GLuint  vertexArrayId           = 0;
+    float   time                    = 0.0f;
+    Stats   stats;
+
+    GLuint  programShaderId         = 0;
+    GLint   matrixUniform           = 0;
+    GLint   textureUniform          = 0;
+    GLint   timeUniform             = 0;
+    GLint   emitterUniform          = 0;
+} g_context;
+
+void Create()
+{
+    auto vertexShader = compileShader(GL_VERTEX_SHADER, VERTEX_SRC);
+    auto fragmentShader = compileShader(GL_FRAGMENT_SHADER, FRAGMENT_SRC);
+
+    g_context.programShaderId = glCreateProgram();
+    glAttachShader(g_context.programShaderId, vertexShader);
+    glAttachShader(g_context.programShaderId, fragmentShader);
+    glLinkProgram(g_context.programShaderId);
+
+    glDeleteShader(vertexShader);
+    glDeleteShader(fragmentShader);
+    checkProgram(g_context.programShaderId);
+
+    g_context.matrixUniform = glGetUniformLocation(g_context.programShaderId, "projection");
+    g_context.textureUniform = glGetUniformLocation(g_context.programShaderId, "tex2D");
+    g_context.timeUniform = glGetUniformLocation(g_context.programShaderId, "time");
+    g_context.emitterUniform = glGetUniformLocation(g_context.programShaderId, "emitter");
+
+    // The core profile wants a vertex array bound even without any attribute.
+    glGenVertexArrays(1, &g_context.vertexArrayId);
+}
+
+void Destroy()
+{
+    glDeleteProgram(g_context.programShaderId);
+    glDeleteVertexArrays(1, &g_context.vertexArrayId);
+}
+
+void Use()
+{
+    glUseProgram(g_context.programShaderId);
+    glBindVertexArray(g_context.vertexArrayId);
+}
+
+void SetTexture(Texture::TextureUnit unit)
+{
+    glUniform1i(g_context.textureUniform, unit);
+}
+
+void SetMatrix(const float* value)
+{
+    glUniformMatrix4fv(g_context.matrixUniform, 1, GL_FALSE, value);
+}
+
+void SetMatrix(const Camera::Camera* camera)
+{
+    SetMatrix(Camera::GetMatrix(camera));
+}
+
+void SetTime(float time)
+{
+    g_context.time = time;
+}
+
+int GetCount(const Emitter& emitter)
+{
+    // One slot per particle alive at once, fewer when the emitter stops first.
+    if (emitter.rate <= 0.0f || emitter.lifetime <= 0.0f)
+    {
+        return 0;
+    }
+
+    auto span = emitter.duration > 0.0f && emitter.duration < emitter.lifetime ? emitter.duration : emitter.lifetime;
+    return static_cast<int>(std::ceil(emitter.rate * span));
+}
+
+void Render(const Emitter& emitter)
+{
+    auto count = GetCount(emitter);
+    if (count == 0)
+    {
+        return;
+    }
+
+    const float values[32] =
+    {
+        emitter.x, emitter.y, emitter.radius, static_cast<float>(emitter.seed & 0xFFFFFF),
+        emitter.angle * M_PI_DIV_180, emitter.spread * M_PI_DIV_180, emitter.minSpeed, emitter.maxSpeed,
+        emitter.gravity_x, emitter.gravity_y, emitter.lifetime, emitter.rate,
+        emitter.start, emitter.duration, emitter.minSpin * M_PI_DIV_180, emitter.maxSpin * M_PI_DIV_180,
+        emitter.startSize, emitter.endSize, 0.0f, 0.0f,
+        emitter.start_r / 255.0f, emitter.start_g / 255.0f, emitter.start_b / 255.0f, emitter.start_a / 255.0f,
+        emitter.end_r / 255.0f, emitter.end_g / 255.0f, emitter.end_b / 255.0f, emitter.end_a / 255.0f,
+        emitter.s, emitter.t, emitter.p, emitter.q
+    };
+
+    glUniform1f(g_context.timeUniform, g_context.time);
+    glUniform4fv(g_context.emitterUniform, 8, values);
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, count);
+
+    g_context.stats.drawCalls += 1;
+    g_context.stats.particleCount += count;
+}
+
+Stats GetStats()
+{
+    return g_context.stats;
+}
+
+void ResetStats()
+{
+    g_context.stats = Stats();
+}
+
+} // namespace Particle
+
+//-----------------------------------------------------------------------------
+// [SECTION] Queue
+//-----------------------------------------------------------------------------
+
+namespace Queue
+{
+
+// Sort key layout, most significant bits first. Everything above DEPTH is render
+// state: consecutive commands sharing it end up in the same draw call.
+//
+//  63        48 47   46 45      45 44          32 31                 0
+// [   layer    ][blend ][program ][texture/type  ][       depth       ]
+
+enum Program : int
+{
+    PROGRAM_SPRITE      = 0,
+    PROGRAM_SHAPE       = 1
+};
+
+struct Command
+{
+    uint64_t    key         = 0;
+    int         index       = 0;
+    int         count       = 0;
+};
+
+struct Context
+{
+    std::vector<Command>                    commands;
+    std::vector<Command>                    sorted;
+    std::vector<Sprite::Sprite>             sprites;
+    std::vector<Shape::Vertex>              vertices;
+    std::vector<const Texture::Texture*>    textures;
+    std::map<const Texture::Texture*, int>  textureSlots;
+} g_context;
+
+static_assert((KEY_STATE_MASK | KEY_FIELD(KEY_LAYER_MASK, KEY_LAYER_SHIFT)) == 0xFFFFFFFF00000000ull, "Sort key fields must tile the upper 32 bits");
+
+uint64_t makeKey(int layer, BlendMode blend, Program program, unsigned int texture, unsigned int depth)
+{
+    auto biasedLayer = layer + 32768;
+    if (biasedLayer < 0)
+    {
+        DEBUG("Queue layer less than -32768, adjusting to -32768.\n");
+        biasedLayer = 0;
+    }
+
+    if (biasedLayer > 65535)
+    {
+        DEBUG("Queue layer greater than 32767, adjusting to 32767.\n");
+        biasedLayer = 65535;
+    }
+
+    return (static_cast<uint64_t>(biasedLayer) << KEY_LAYER_SHIFT)
+        | KEY_FIELD(blend & KEY_BLEND_MASK, KEY_BLEND_SHIFT)
+        | KEY_FIELD(program & KEY_PROGRAM_MASK, KEY_PROGRAM_SHIFT)
+        | KEY_FIELD(texture & KEY_TEXTURE_MASK, KEY_TEXTURE_SHIFT)
+        | static_cast<uint64_t>(depth);
+}
+
+void sort()
+{
+    // LSD radix sort on 8 bit digits. It is stable, so commands sharing a key keep
+    // their submission order. Digits that are the same for every key are skipped,
+    // which is most of them in practice (few layers, few textures, no depth).
+    auto count = g_context.commands.size();
+    g_context.sorted.resize(count);
+
+    size_t histograms[8][256] = { { 0 } };
+    for (const auto& command : g_context.commands)
+    {
+        for (auto pass=0; pass<8; ++pass)
+        {
+            ++histograms[pass][(command.key >> (pass * 8)) & 0xFF];
+        }
+    }
+
+    auto source = &g_context.commands;
+    auto target = &g_context.sorted;
+    for (auto pass=0; pass<8; ++pass)
+    {
+        auto& histogram = histograms[pass];
+        if (histogram[(source->front().key >> (pass * 8)) & 0xFF] == count)
+        {
+            continue;
+        }
+
+        size_t offset = 0;
+        for (auto i=0; i<256; ++i)
+        {
+            auto bucket = histogram[i];
+            histogram[i] = offset;
+            offset += bucket;
+        }
+
+        for (const auto& command : *source)
+        {
+            (*target)[histogram[(command.key >> (pass * 8)) & 0xFF]++] = command;
+        }
+
+        std::swap(source, target);
+    }
+
+    if (source != &g_context.commands)
+    {
+        g_context.commands.swap(g_context.sorted);
+    }
+}
+
+uint64_t getStateMask(const Command& command)
+{
+    // Shapes of any primitive type go through one primitive batch, only the
+    // layer keeps them apart so the batch never reorders across layers.
+    if (((command.key >> KEY_PROGRAM_SHIFT) & KEY_PROGRAM_MASK) == PROGRAM_SPRITE)
+    {
+        return KEY_STATE_MASK;
+    }
+
+    return (KEY_STATE_MASK | KEY_FIELD(KEY_LAYER_MASK, KEY_LAYER_SHIFT)) & ~KEY_FIELD(KEY_TEXTURE_MASK, KEY_TEXTURE_SHIFT);
+}
+
+void Begin()
+{
+    g_context.commands.clear();
+    g_context.sprites.clear();
+    g_context.vertices.clear();
+    g_context.textures.clear();
+    g_context.textureSlots.clear();
+}
+
+void Add(const Sprite::Sprite& sprite, const Texture::Texture* texture, BlendMode blend, int layer, unsigned int depth)
+{
+    if (texture == nullptr)
+    {
+        DEBUG("Queue sprite without a texture\n");
+        return;
+    }
+
+    auto slot = 0;
+    auto it = g_context.textureSlots.find(texture);
+    if (it == g_context.textureSlots.end())
+    {
+        slot = static_cast<int>(g_context.textures.size());
+        if (slot > static_cast<int>(KEY_TEXTURE_MASK))
+        {
+            DEBUG("Too many textures in queue\n");
+            return;
+        }
+
+        g_context.textures.push_back(texture);
+        g_context.textureSlots[texture] = slot;
+    }
+    else
+    {
+        slot = it->second;
+    }
+
+    Command command;
+    command.key = makeKey(layer, blend, PROGRAM_SPRITE, slot, depth);
+    command.index = static_cast<int>(g_context.sprites.size());
+    command.count = 1;
+
+    g_context.sprites.push_back(sprite);
+    g_context.commands.push_back(command);
+}
+
+void Add(const Shape::Vertex* vertices, int count, Shape::DrawType drawType, BlendMode blend, int layer, unsigned int depth)
+{
+    if (vertices == nullptr || count <= 0)
+    {
+        return;
+    }
+
+    Command command;
+    command.key = makeKey(layer, blend, PROGRAM_SHAPE, drawType, depth);
+    command.index = static_cast<int>(g_context.vertices.size());
+    command.count = count;
+
+    g_context.vertices.insert(g_context.vertices.end(), vertices, vertices + count);
+    g_context.commands.push_back(command);
+}
+
+void Flush()
+{
+    if (g_context.commands.empty())
+    {
+        return;
+    }
+
+    sort();
+
+    auto& commands = g_context.commands;
+    auto currentProgram = -1;
+    auto currentBlend = -1;
+    auto commandCount = commands.size();
+    size_t i = 0;
+    while (i < commandCount)
+    {
+        // Find the run of commands sharing the same render state.
+        auto mask = getStateMask(commands[i]);
+        auto state = commands[i].key & mask;
+        auto end = i + 1;
+        while (end < commandCount && (commands[end].key & mask) == state)
+        {
+            ++end;
+        }
+
+        auto program = static_cast<int>((state >> KEY_PROGRAM_SHIFT) & KEY_PROGRAM_MASK);
+        auto blend = static_cast<int>((state >> KEY_BLEND_SHIFT) & KEY_BLEND_MASK);
+        auto texture = static_cast<unsigned int>((state >> KEY_TEXTURE_SHIFT) & KEY_TEXTURE_MASK);
+
+        if (blend != currentBlend)
+        {
+            SetBlending(static_cast<BlendMode>(blend));
+            currentBlend = blend;
+        }
+
+        if (program == PROGRAM_SPRITE)
+        {
+            if (currentProgram != PROGRAM_SPRITE)
+            {
+                Sprite::Use();
+                Sprite::SetTexture(Texture::TextureUnit::UNIT_0);
+                currentProgram = PROGRAM_SPRITE;
+            }
+
+            SetTexture(g_context.textures[texture], Texture::TextureUnit::UNIT_0);
+            Sprite::Begin();
+            for (auto c=i; c<end; ++c)
+            {
+                Sprite::Add(g_context.sprites[commands[c].index]);
+            }
+            Sprite::End();
+            Sprite::Render();
+        }
+        else
+        {
+            if (currentProgram != PROGRAM_SHAPE)
+            {
+                Shape::Use();
+                currentProgram = PROGRAM_SHAPE;
+            }
+
+            Shape::BeginPrimitives();
+            for (auto c=i; c<end; ++c)
+            {
+                const auto& command = commands[c];
+                auto drawType = static_cast<Shape::DrawType>((command.key >> KEY_TEXTURE_SHIFT) & KEY_TEXTURE_MASK);
+                Shape::AddPrimitive(&g_context.vertices[command.index], command.count, drawType);
+            }
+            Shape::EndPrimitives();
+            Shape::RenderPrimitives();
+        }
+
+        i = end;
+    }
+
+    Begin();
+}
+
+int GetCommandCount()
+{
+    return static_cast<int>(g_context.commands.size());
+}
+
+} // namespace Queue
+
+//-----------------------------------------------------------------------------
+// [SECTION] Catalog
+//-----------------------------------------------------------------------------
+
+namespace Catalog
+{
+
+//-----------------------------------------------------------------------------
+// [SECTION] Catalog - Forward declarations and basic types
+//-----------------------------------------------------------------------------
+
+struct Name
+{
+    char    value[32]   = { 0 };
+};
+
+// SPRCAT v2 header. The first 6 bytes match v1, the marker sits where v1 keeps
+// the low half of the image width, which can not be 0xFFFF for a real atlas.
+// Every section is 16 bytes aligned so the file can be used in place once mapped.
+struct FileHeader
+{
+    char        signature[6]    = { 'S', 'P', 'R', 'C', 'A', 'T' };
+    uint16_t    marker          = 0xFFFF;
+    uint32_t    version         = 2;
+    int32_t     imageWidth      = 0;
+    int32_t     imageHeight     = 0;
+    int32_t     spriteCount     = 0;
+    uint32_t    slotCount       = 0;    // Power of two, int32 sprite index per slot, -1 when empty
+    uint32_t    slotsOffset     = 0;
+    uint32_t    namesOffset     = 0;    // 32 bytes per sprite
+    uint32_t    spritesOffset   = 0;    // One SpriteDef per sprite
+};
+
+struct  Catalog
+{
+    int imageWidth      = 0;
+    int imageHeight     = 0;
+    int spriteCount     = 0;
+
+    // Sprites are stored flat, their index is the handle returned by Find(). Names
+    // are looked up through an open-addressed (linear probing) hash index holding
+    // sprite indices, -1 for an empty slot. The slot count is a power of two.
+    // The arrays either point into a mapped v2 file or into the owned vectors.
+    const SpriteDef*    sprites     = nullptr;
+    const Name*         names       = nullptr;
+    const int32_t*      slots       = nullptr;
+    uint32_t            slotCount   = 0;
+
+    MappedFile              file;
+    std::vector<SpriteDef>  ownedSprites;
+    std::vector<Name>       ownedNames;
+    std::vector<int32_t>    ownedSlots;
+};
+
+//-----------------------------------------------------------------------------
+// [SECTION] Catalog - Private functions
+//-----------------------------------------------------------------------------
+
+uint32_t hashName(const char* name)
+{
+    // FNV-1a over at most the 32 bytes a catalog name can hold.
+    uint32_t hash = 2166136261u;
+    for (auto i=0; i<32 && name[i] != 0; ++i)
+    {
+        hash ^= static_cast<unsigned char>(name[i]);
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+void clear(Catalog* catalog)
+{
+    unmapFile(catalog->file);
+    catalog->ownedSprites.clear();
+    catalog->ownedNames.clear();
+    catalog->ownedSlots.clear();
+    catalog->sprites = nullptr;
+    catalog->names = nullptr;
+    catalog->slots = nullptr;
+    catalog->slotCount = 0;
+    catalog->imageWidth = 0;
+    catalog->imageHeight = 0;
+    catalog->spriteCount = 0;
+}
+
+void bindOwned(Catalog* catalog)
+{
+    catalog->sprites = catalog->ownedSprites.data();
+    catalog->names = catalog->ownedNames.data();
+    catalog->slots = catalog->ownedSlots.data();
+    catalog->slotCount = static_cast<uint32_t>(catalog->ownedSlots.size());
+    catalog->spriteCount = static_cast<int>(catalog->ownedSprites.size());
+}
+
+void insertIndex(Catalog* catalog, int index)
+{
+    auto mask = catalog->ownedSlots.size() - 1;
+    auto slot = hashName(catalog->ownedNames[index].value) & mask;
+    while (catalog->ownedSlots[slot] != -1)
+    {
+        slot = (slot + 1) & mask;
+    }
+
+    catalog->ownedSlots[slot] = index;
+}
+
+void buildIndex(Catalog* catalog)
+{
+    size_t slotCount = 1;
+    while (slotCount < catalog->ownedSprites.size() * 2)
+    {
+        slotCount <<= 1;
+    }
+
+    catalog->ownedSlots.assign(slotCount, -1);
+    for (size_t i=0; i<catalog->ownedNames.size(); ++i)
+    {
+        insertIndex(catalog, static_cast<int>(i));
+    }
+    bindOwned(catalog);
+}
+
+void initV1(Catalog* catalog, const unsigned char* data, size_t size)
+{
+    // v1: signature, image width, height, sprite count, then for each sprite a
+    // 32 bytes name followed by its SpriteDef. Nothing is aligned, copy it out.
+    const size_t entrySize = 32 + sizeof(SpriteDef);
+    auto offset = size_t(6);
+    if (size < offset + 3 * sizeof(int32_t))
+    {
+        DEBUG("Truncated catalog header.\n");
+        return;
+    }
+
+    int32_t header[3];
+    memcpy(header, data + offset, sizeof(header));
+    offset += sizeof(header);
+
+    auto spriteCount = header[2];
+    if (spriteCount < 0 || (size - offset) / entrySize < static_cast<size_t>(spriteCount))
+    {
+        DEBUG("Truncated catalog, %d sprites expected.\n", spriteCount);
+        return;
+    }
+
+    catalog->imageWidth = header[0];
+    catalog->imageHeight = header[1];
+    catalog->ownedSprites.reserve(spriteCount);
+    catalog->ownedNames.reserve(spriteCount);
+    catalog->ownedSlots.clear();
+    bindOwned(catalog);
+
+    for (int i=0; i<spriteCount; ++i)
+    {
+        Name name;
+        memcpy(name.value, data + offset, 32);
+        name.value[31] = 0;
+
+        SpriteDef spriteDef;
+        memcpy(&spriteDef, data + offset + 32, sizeof(SpriteDef));
+        offset += entrySize;
+
+        // Keep the first entry when a name is duplicated.
+        if (Find(catalog, name.value) != -1)
+        {
+            continue;
+        }
+
+        catalog->ownedNames.push_back(name);
+        catalog->ownedSprites.push_back(spriteDef);
+        if (catalog->ownedSprites.size() * 2 > catalog->ownedSlots.size())
+        {
+            buildIndex(catalog);
+        }
+        else
+        {
+            insertIndex(catalog, static_cast<int>(catalog->ownedSprites.size() - 1));
+            bindOwned(catalog);
+        }
+    }
+}
+
+bool initV2(Catalog* catalog)
+{
+    auto data = catalog->file.data;
+    auto size = catalog->file.size;
+    if (size < sizeof(FileHeader))
+    {
+        DEBUG("Truncated catalog header.\n");
+        return false;
+    }
+
+    FileHeader header;
+    memcpy(&header, data, sizeof(FileHeader));
+    if (header.version != 2)
+    {
+        DEBUG("Unsupported SPRCAT version %u.\n", header.version);
+        return false;
+    }
+
+    auto fits = [size](uint32_t offset, size_t length)
+    {
+        return (offset % 16) == 0 && offset <= size && length <= size - offset;
+    };
+
+    auto spriteCount = static_cast<size_t>(header.spriteCount < 0 ? 0 : header.spriteCount);
+    if (header.spriteCount < 0
+    || header.slotCount <= spriteCount
+    || (header.slotCount & (header.slotCount - 1)) != 0
+    || !fits(header.slotsOffset, header.slotCount * sizeof(int32_t))
+    || !fits(header.namesOffset, spriteCount * sizeof(Name))
+    || !fits(header.spritesOffset, spriteCount * sizeof(SpriteDef)))
+    {
+        DEBUG("Corrupted SPRCAT v2 header.\n");
+        return false;
+    }
+
+    catalog->imageWidth = header.imageWidth;
+    catalog->imageHeight = header.imageHeight;
+    catalog->spriteCount = header.spriteCount;
+    catalog->slotCount = header.slotCount;
+    catalog->slots = reinterpret_cast<const int32_t*>(data + header.slotsOffset);
+    catalog->names = reinterpret_cast<const Name*>(data + header.namesOffset);
+    catalog->sprites = reinterpret_cast<const SpriteDef*>(data + header.spritesOffset);
+    return true;
+}
+
+void apply(const SpriteDef& spriteDef, Sprite::Sprite& sprite)
+{
+    sprite.s = spriteDef.s;
+    sprite.t = spriteDef.t;
+    sprite.p = spriteDef.p;
+    sprite.q = spriteDef.q;
+}
+
+bool isValid(const Catalog* catalog, int handle)
+{
+    return handle >= 0 && handle < catalog->spriteCount;
+}
+
+//-----------------------------------------------------------------------------
+// [SECTION] Catalog - End-user API functions
+//-----------------------------------------------------------------------------
+
+Catalog* Create()
+{
+    return new Catalog();
+}
+
+void Init(Catalog* catalog, const char* filename)
+{
+    clear(catalog);
+    if (!mapFile(filename, catalog->file))
+    {
+        DEBUG("Catalog not found %s\n", filename);
+        return;
+    }
+
+    auto data = catalog->file.data;
+    auto size = catalog->file.size;
+    if (size <= 6)
+    {
+        DEBUG("Not a catalog file %s\n", filename);
+        clear(catalog);
+        return;
+    }
+
+    if (memcmp(data, "SPRCAT", 6) != 0)
+    {
+        DEBUG("SPRCAT signature not present.\n");
+        clear(catalog);
+        return;
+    }
+
+    uint16_t marker = 0;
+    if (size >= 8)
+    {
+        memcpy(&marker, data + 6, sizeof(marker));
+    }
+
+    if (marker == 0xFFFF)
+    {
+        // v2 is used in place, keep the mapping alive for the catalog lifetime.
+        if (!initV2(catalog))
+        {
+            clear(catalog);
+        }
+        return;
+    }
+
+    initV1(catalog, data, size);
+    unmapFile(catalog->file);
+}
+
+void Save(Catalog* catalog, const char* filename)
+{
+    auto align = [](size_t offset) { return (offset + 15) & ~size_t(15); };
+
+    // An empty catalog still needs one empty slot for lookups to terminate.
+    const int32_t emptySlot = -1;
+    auto slots = catalog->slotCount > 0 ? catalog->slots : &emptySlot;
+
+    FileHeader header;
+    header.imageWidth = catalog->imageWidth;
+    header.imageHeight = catalog->imageHeight;
+    header.spriteCount = catalog->spriteCount;
+    header.slotCount = catalog->slotCount > 0 ? catalog->slotCount : 1;
+    header.slotsOffset = static_cast<uint32_t>(align(sizeof(FileHeader)));
+    header.namesOffset = static_cast<uint32_t>(align(header.slotsOffset + header.slotCount * sizeof(int32_t)));
+    header.spritesOffset = static_cast<uint32_t>(align(header.namesOffset + catalog->spriteCount * sizeof(Name)));
+
+    auto file = std::ofstream(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!file.is_open())
+    {
+        DEBUG("Could not write catalog %s\n", filename);
+        return;
+    }
+
+    const char padding[16] = { 0 };
+    auto write = [&file, &padding](const void* data, size_t size, size_t offset)
+    {
+        auto position = static_cast<size_t>(file.tellp());
+        file.write(padding, offset - position);
+        file.write(reinterpret_cast<const char*>(data), size);
+    };
+
+    write(&header, sizeof(FileHeader), 0);
+    write(slots, header.slotCount * sizeof(int32_t), header.slotsOffset);
+    write(catalog->names, catalog->spriteCount * sizeof(Name), header.namesOffset);
+    write(catalog->sprites, catalog->spriteCount * sizeof(SpriteDef), header.spritesOffset);
+
+    file.close();
+}
+
+void Destroy(Catalog* catalog)
+{
+    if (catalog != nullptr)
+    {
+        clear(catalog);
+        delete(catalog);
+        catalog = nullptr;
+    }
+}
+
+int Find(Catalog* catalog, const char* name)
+{
+    if (catalog->slotCount == 0)
+    {
+        return -1;
+    }
+
+    auto mask = catalog->slotCount - 1;
+    auto slot = hashName(name) & mask;
+    for (uint32_t probe=0; probe<catalog->slotCount; ++probe)
+    {
+        auto index = catalog->slots[slot];
+        if (index < 0 || index >= catalog->spriteCount)
+        {
+            return -1;
+        }
+
+        if (strncmp(catalog->names[index].value, name, 32) == 0)
+        {
+            return index;
+        }
+
+        slot = (slot + 1) & mask;
+    }
+
+    return -1;
+}
+
+void Set(Catalog* catalog, const char* name, Sprite::Sprite& sprite, bool setWidth, bool setHeight)
+{
+    auto handle = Find(catalog, name);
+    if (handle == -1)
+    {
+        DEBUG("Sprite not found: %s\n", name);
+        return;
+    }
+
+    Set(catalog, handle, sprite, setWidth, setHeight);
+}
+
+void Set(Catalog* catalog, const char* name, Sprite::Sprite& sprite, int width, int height)
+{
+    auto handle = Find(catalog, name);
+    if (handle == -1)
+    {
+        DEBUG("Sprite not found: %s\n", name);
+        return;
+    }
+
+    Set(catalog, handle, sprite, width, height);
+}
+
+SpriteDef Get(Catalog* catalog, const char* name)
+{
+    auto handle = Find(catalog, name);
+    if (handle == -1)
+    {
+        DEBUG("Sprite not found: %s\n", name);
+        return SpriteDef();
+    }
+
+    return catalog->sprites[handle];
+}
+
+void Set(Catalog* catalog, int handle, Sprite::Sprite& sprite, bool setWidth, bool setHeight)
+{
+    if (!isValid(catalog, handle))
+    {
+        DEBUG("Invalid sprite handle: %d\n", handle);
+        return;
+    }
+
+    const auto& spriteDef = catalog->sprites[handle];
+    if (setWidth)
+    {
+        sprite.width = spriteDef.width;
+    }
+    if (setHeight)
+    {
+        sprite.height = spriteDef.height;
+    }
+    apply(spriteDef, sprite);
+}
+
+void Set(Catalog* catalog, int handle, Sprite::Sprite& sprite, int width, int height)
+{
+    if (!isValid(catalog, handle))
+    {
+        DEBUG("Invalid sprite handle: %d\n", handle);
+        return;
+    }
+
+    sprite.width = width;
+    sprite.height = height;
+    apply(catalog->sprites[handle], sprite);
+}
+
+SpriteDef Get(Catalog* catalog, int handle)
+{
+    if (!isValid(catalog, handle))
+    {
+        DEBUG("Invalid sprite handle: %d\n", handle);
+        return SpriteDef();
+    }
+
+    return catalog->sprites[handle];
+}
+
+int AddAnimation(Catalog* catalog, const char* const* names, int count, bool loop)
+{
+    std::vector<float> frames;
+    frames.reserve(count * 4);
+    for (auto i=0; i<count; ++i)
+    {
+        auto handle = Find(catalog, names[i]);
+        if (handle == -1)
+        {
+            DEBUG("Sprite not found: %s\n", names[i]);
+            return -1;
+        }
+
+        const auto& spriteDef = catalog->sprites[handle];
+        frames.push_back(spriteDef.s);
+        frames.push_back(spriteDef.t);
+        frames.push_back(spriteDef.p);
+        frames.push_back(spriteDef.q);
+    }
+
+    return Sprite::AddAnimation(frames.data(), count, loop);
+}
+
+void PopulateFontGlyphs(std::vector<SpriteDef>& glyphs, const SpriteDef& spriteDef)
+{
+    auto glyphWidth = (spriteDef.p - spriteDef.s) / 16.0f;
+    auto glyphHeight = (spriteDef.q - spriteDef.t)  / 16.0f;
+    auto fontWidth = spriteDef.width / 16;
+    auto fontHeight = spriteDef.height / 16;
+    for (auto y=0; y<16; ++y)
+    {
+        for (auto x=0; x<16; ++x)
+        {
+            glyphs.emplace_back((SpriteDef) {
+                .width = fontWidth,
+                .height = fontHeight,
+                .s = spriteDef.s + (x * glyphWidth),
+                .t = spriteDef.t + (y * glyphHeight),
+                .p = spriteDef.s + ((x * glyphWidth) + glyphWidth),
+                .q = spriteDef.t + ((y * glyphHeight) + glyphHeight)
+            });
+        }
+    }
+}
+
+} // namespace Catalog
+
+//-----------------------------------------------------------------------------
+// [SECTION] Tilemap
+//-----------------------------------------------------------------------------
+
+namespace Tilemap
+{
+
+// Chunks keep one sprite instance per tile slot, empty tiles are zero sized, so
+// an edit rewrites its own slot and nothing else. GPU buffers are built the
+// first time a chunk is drawn.
+struct Chunk
+{
+    GLuint  vertexBufferId          = 0;
+    GLuint  vertexArrayId           = 0;
+    int     tileCount               = 0;
+    int     dirtyFirst              = -1;
+    int     dirtyLast               = -1;
+};
+
+struct Tilemap
+{
+    Catalog::Catalog*   catalog         = nullptr;
+    int                 columns         = 0;
+    int                 rows            = 0;
+    int                 tileWidth       = 0;
+    int                 tileHeight      = 0;
+    int                 chunkSize       = 0;
+    int                 chunkColumns    = 0;
+    int                 chunkRows       = 0;
+    std::vector<int>    tiles;
+    std::vector<Chunk>  chunks;
+    Stats               stats;
+};
+
+struct Context
+{
+    std::vector<unsigned char>  instances;
+} g_context;
+
+void clear(Tilemap* tilemap)
 {
-    glUniformMatrix4fv(g_context.matrixUniform, 1, GL_FALSE, value);
+    for (auto& chunk : tilemap->chunks)
+    {
+        if (chunk.vertexBufferId != 0)
+        {
+            glDeleteBuffers(1, &chunk.vertexBufferId);
+            glDeleteVertexArrays(1, &chunk.vertexArrayId);
+        }
+    }
+
+    tilemap->tiles.clear();
+    tilemap->chunks.clear();
 }
 
-void SetPointSize(float size)
+void packTiles(Tilemap* tilemap, int chunkIndex, int first, int last)
 {
-    if (size < 0)
+    // Packs slots first to last of a chunk into the scratch buffer.
+    auto stride = Sprite::g_context.stride;
+    auto chunkColumn = chunkIndex % tilemap->chunkColumns;
+    auto chunkRow = chunkIndex / tilemap->chunkColumns;
+    g_context.instances.resize(stride * (last - first + 1));
+
+    for (auto slot=first; slot<=last; ++slot)
     {
-        DEBUG("Point size less than 0, adjusting to 0.\n");
-        size = 0;
+        auto column = chunkColumn * tilemap->chunkSize + slot % tilemap->chunkSize;
+        auto row = chunkRow * tilemap->chunkSize + slot / tilemap->chunkSize;
 
-    }
+        Sprite::Sprite sprite;
+        sprite.width = 0;
+        sprite.height = 0;
+        if (column < tilemap->columns && row < tilemap->rows)
+        {
+            auto tile = tilemap->tiles[row * tilemap->columns + column];
+            if (tile >= 0)
+            {
+                sprite.x = (column + 0.5f) * tilemap->tileWidth;
+                sprite.y = (row + 0.5f) * tilemap->tileHeight;
+                Catalog::Set(tilemap->catalog, tile, sprite, tilemap->tileWidth, tilemap->tileHeight);
+            }
+        }
 
-    if (size > 32)
-    {
-        DEBUG("Point size greater than 32, adjusting to 32.\n");
-        size = 32;
+        Sprite::packInstance(sprite, g_context.instances.data() + stride * (slot - first));
     }
+}
 
-    g_context.pointSize = size;
-    glPointSize(size);
+int chunkAt(float position, float chunkSize, int chunkCount)
+{
+    auto index = static_cast<int>(std::floor(position / chunkSize));
+    return index < 0 ? 0 : (index >= chunkCount ? chunkCount - 1 : index);
 }
 
-float GetPointSize()
+void build(Tilemap* tilemap, int chunkIndex)
 {
-    return g_context.pointSize;
+    auto& chunk = tilemap->chunks[chunkIndex];
+    auto slots = tilemap->chunkSize * tilemap->chunkSize;
+    packTiles(tilemap, chunkIndex, 0, slots - 1);
+
+    glGenBuffers(1, &chunk.vertexBufferId);
+    glBindBuffer(GL_ARRAY_BUFFER, chunk.vertexBufferId);
+    glBufferData(GL_ARRAY_BUFFER, g_context.instances.size(), g_context.instances.data(), GL_STATIC_DRAW);
+    chunk.vertexArrayId = Sprite::createVertexArray(chunk.vertexBufferId);
+    chunk.dirtyFirst = -1;
+    chunk.dirtyLast = -1;
+
+    tilemap->stats.uploadedBytes += static_cast<int>(g_context.instances.size());
 }
 
-void SetLineWidth(float width)
+void upload(Tilemap* tilemap, int chunkIndex)
 {
-    if (width < 0)
-    {
-        DEBUG("Line width less than 0, adjusting to 0.\n");
-        width = 0;
+    auto& chunk = tilemap->chunks[chunkIndex];
+    packTiles(tilemap, chunkIndex, chunk.dirtyFirst, chunk.dirtyLast);
 
-    }
+    glBindBuffer(GL_ARRAY_BUFFER, chunk.vertexBufferId);
+    glBufferSubData(GL_ARRAY_BUFFER, Sprite::g_context.stride * chunk.dirtyFirst, g_context.instances.size(), g_context.instances.data());
+    chunk.dirtyFirst = -1;
+    chunk.dirtyLast = -1;
 
-    if (width > 32)
-    {
-        DEBUG("Line width greater than 32, adjusting to 32.\n");
-        width = 32;
-    }
+    tilemap->stats.uploadedBytes += static_cast<int>(g_context.instances.size());
+}
 
-    g_context.lineWidth = width;
-    glLineWidth(width);
+Tilemap* Create()
+{
+    return new Tilemap();
 }
 
-float GetLineWidth()
+void Destroy(Tilemap* tilemap)
 {
-    return g_context.lineWidth;
+    if (tilemap != nullptr)
+    {
+        clear(tilemap);
+        delete(tilemap);
+        tilemap = nullptr;
+    }
 }
 
-void Begin()
+void Init(Tilemap* tilemap, Catalog::Catalog* catalog, int columns, int rows, int tileWidth, int tileHeight, int chunkSize)
 {
-    if (g_context.maxVertices < g_context.verticesCount)
+    clear(tilemap);
+    if (columns <= 0 || rows <= 0)
     {
-        g_context.maxVertices = g_context.verticesCount;
+        DEBUG("Invalid tilemap size %dx%d\n", columns, rows);
+        return;
     }
 
-    g_context.verticesCount = 0;
-    g_context.storage = glMapBufferRange
-    (
-        GL_ARRAY_BUFFER,
-        0,
-        sizeof(Vertex) * MAX_VERTICES_PER_SHAPE_BATCH,
-        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_FLUSH_EXPLICIT_BIT
-    );
+    if (chunkSize < 1)
+    {
+        DEBUG("Chunk size less than 1, adjusting to 1.\n");
+        chunkSize = 1;
+    }
+
+    tilemap->catalog = catalog;
+    tilemap->columns = columns;
+    tilemap->rows = rows;
+    tilemap->tileWidth = tileWidth;
+    tilemap->tileHeight = tileHeight;
+    tilemap->chunkSize = chunkSize;
+    tilemap->chunkColumns = (columns + chunkSize - 1) / chunkSize;
+    tilemap->chunkRows = (rows + chunkSize - 1) / chunkSize;
+    tilemap->tiles.assign(columns * rows, -1);
+    tilemap->chunks.resize(tilemap->chunkColumns * tilemap->chunkRows);
 }
 
-void Add(const Vertex& vertex)
+void SetTile(Tilemap* tilemap, int column, int row, int tile)
 {
-    if (g_context.storage == nullptr)
+    if (column < 0 || row < 0 || column >= tilemap->columns || row >= tilemap->rows)
     {
-        DEBUG("Shape storage nullptr\n");
+        DEBUG("Tile %d, %d out of the tilemap\n", column, row);
         return;
     }
 
-    if (g_context.verticesCount >= MAX_VERTICES_PER_SHAPE_BATCH)
+    auto& current = tilemap->tiles[row * tilemap->columns + column];
+    if (current == tile)
     {
-        DEBUG("verticesCount >= MAX_VERTICES_PER_SHAPE_BATCH\n");
         return;
     }
 
-    auto storage = static_cast<Vertex*>(g_context.storage);
-    auto index = g_context.verticesCount;
-        
-    storage[index].x = vertex.x;
-    storage[index].y = vertex.y;
-    storage[index].r = vertex.r;
-    storage[index].g = vertex.g;
-    storage[index].b = vertex.b;
-    storage[index].a = vertex.a;
-
-    ++g_context.verticesCount;
-}
+    auto chunkIndex = (row / tilemap->chunkSize) * tilemap->chunkColumns + column / tilemap->chunkSize;
+    auto& chunk = tilemap->chunks[chunkIndex];
+    chunk.tileCount += (tile >= 0 ? 1 : 0) - (current >= 0 ? 1 : 0);
+    current = tile < 0 ? -1 : tile;
 
-void End()
-{
-    glFlushMappedBufferRange(GL_ARRAY_BUFFER, 0, sizeof(Vertex) * g_context.verticesCount);
-    glUnmapBuffer(GL_ARRAY_BUFFER);
+    // Built chunks remember the span of edited slots, uploaded once on the next draw.
+    if (chunk.vertexBufferId != 0)
+    {
+        auto slot = (row % tilemap->chunkSize) * tilemap->chunkSize + column % tilemap->chunkSize;
+        chunk.dirtyFirst = chunk.dirtyFirst < 0 || slot < chunk.dirtyFirst ? slot : chunk.dirtyFirst;
+        chunk.dirtyLast = slot > chunk.dirtyLast ? slot : chunk.dirtyLast;
+    }
 }
 
-void Render(const DrawType drawType)
+void SetTile(Tilemap* tilemap, int column, int row, const char* name)
 {
-    if (g_context.verticesCount > 0)
+    auto handle = Catalog::Find(tilemap->catalog, name);
+    if (handle == -1)
     {
-        glDrawArrays(getDrawType(drawType), 0, g_context.verticesCount);
+        DEBUG("Sprite not found: %s\n", name);
+        return;
     }
-}
 
-int GetMaxVertices()
-{
-    return g_context.maxVertices;
+    SetTile(tilemap, column, row, handle);
 }
 
-} // namespace Shape
-
-//-----------------------------------------------------------------------------
-// [SECTION] Catalog
-//-----------------------------------------------------------------------------
-
-namespace Catalog
+int GetTile(const Tilemap* tilemap, int column, int row)
 {
+    if (column < 0 || row < 0 || column >= tilemap->columns || row >= tilemap->rows)
+    {
+        return -1;
+    }
 
-//-----------------------------------------------------------------------------
-// [SECTION] Catalog - Forward declarations and basic types
-//-----------------------------------------------------------------------------
+    return tilemap->tiles[row * tilemap->columns + column];
+}
 
-struct  Catalog
+void Render(Tilemap* tilemap)
 {
-    int imageWidth      = 0;
-    int imageHeight     = 0;
-    int spriteCount     = 0;
-    std::map<std::string, SpriteDef> sprites;
-};
-
-//-----------------------------------------------------------------------------
-// [SECTION] Catalog - End-user API functions
-//-----------------------------------------------------------------------------
+    Rect view;
+    view.right = static_cast<float>(tilemap->columns * tilemap->tileWidth);
+    view.bottom = static_cast<float>(tilemap->rows * tilemap->tileHeight);
+    Render(tilemap, view);
+}
 
-Catalog* Create()
+void Render(Tilemap* tilemap, const Camera::Camera* camera)
 {
-    return new Catalog();
+    Render(tilemap, Camera::GetView(camera));
 }
 
-void Init(Catalog* catalog, const char* filename)
+void Render(Tilemap* tilemap, const Rect& view)
 {
-    auto file = std::ifstream(filename, std::ios::in | std::ios::binary | std::ios::ate);
-    if (!file.is_open())
+    if (tilemap->chunks.empty())
     {
-        DEBUG("Catalog not found %s\n", filename);
         return;
     }
 
-    if (file.tellg() <= 6)
+    auto chunkWidth = static_cast<float>(tilemap->chunkSize * tilemap->tileWidth);
+    auto chunkHeight = static_cast<float>(tilemap->chunkSize * tilemap->tileHeight);
+    if (view.right < 0.0f || view.bottom < 0.0f || view.left > chunkWidth * tilemap->chunkColumns || view.top > chunkHeight * tilemap->chunkRows)
     {
-        DEBUG("Not a catalog file %s\n", filename);
         return;
     }
 
-    char check[7] = { 0 };
-    file.seekg(std::ios::beg);
-    file.read(check, 6);
-
-    if (std::string(check) != "SPRCAT")
+    auto slots = tilemap->chunkSize * tilemap->chunkSize;
+    if (Sprite::g_context.animated)
     {
-        file.close();
-        DEBUG("SPRCAT signature not present.\n");
-        return;
+        glUniform1f(Sprite::g_context.program->timeUniform, Sprite::g_context.time);
     }
 
-    file.read(reinterpret_cast<char*>(&catalog->imageWidth), sizeof(catalog->imageWidth));
-    file.read(reinterpret_cast<char*>(&catalog->imageHeight), sizeof(catalog->imageHeight));
-    file.read(reinterpret_cast<char*>(&catalog->spriteCount), sizeof(catalog->spriteCount));
-
-    catalog->sprites.clear();
-    for (int i=0; i<catalog->spriteCount; ++i)
+    for (auto chunkRow=chunkAt(view.top, chunkHeight, tilemap->chunkRows); chunkRow<=chunkAt(view.bottom, chunkHeight, tilemap->chunkRows); ++chunkRow)
     {
-        char name[32] = { 0 };
-        file.read(name, 32);
-
-        SpriteDef spriteDef;
-        file.read(reinterpret_cast<char*>(&spriteDef), sizeof(SpriteDef));
-        
-        catalog->sprites.insert(
-            std::pair<std::string, SpriteDef>(std::string(name), spriteDef)
-        );
+        for (auto chunkColumn=chunkAt(view.left, chunkWidth, tilemap->chunkColumns); chunkColumn<=chunkAt(view.right, chunkWidth, tilemap->chunkColumns); ++chunkColumn)
+        {
+            auto chunkIndex = chunkRow * tilemap->chunkColumns + chunkColumn;
+            auto& chunk = tilemap->chunks[chunkIndex];
+            if (chunk.tileCount == 0 && chunk.vertexBufferId == 0)
+            {
+                continue;
+            }
+
+            if (chunk.vertexBufferId == 0)
+            {
+                build(tilemap, chunkIndex);
+            }
+            else if (chunk.dirtyFirst >= 0)
+            {
+                upload(tilemap, chunkIndex);
+            }
+
+            if (chunk.tileCount > 0)
+            {
+                glBindVertexArray(chunk.vertexArrayId);
+                glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, slots);
+                tilemap->stats.drawCalls += 1;
+            }
+        }
     }
 
-    file.close();
+    // Leave the sprite batch state as Sprite::Use set it.
+    glBindBuffer(GL_ARRAY_BUFFER, Sprite::g_context.vertexBufferId);
+    glBindVertexArray(Sprite::g_context.vertexArrayId);
 }
 
-void Destroy(Catalog* catalog)
+Stats GetStats(const Tilemap* tilemap)
 {
-    if (catalog != nullptr)
-    {
-        catalog->sprites.clear();
-        delete(catalog);
-        catalog = nullptr;
-    }
+    return tilemap->stats;
 }
 
-void Set(Catalog* catalog, const char* name, Sprite::Sprite& sprite, bool setWidth, bool setHeight)
+void ResetStats(Tilemap* tilemap)
 {
-    if (catalog->sprites.find(name) == catalog->sprites.end())
-    {
-        DEBUG("Sprite not found: %s\n", name);
-        return;
-    }
-
-    const auto& spriteDef = catalog->sprites[name];
-    if (setWidth)
-    {
-        sprite.width = spriteDef.width;
-    }
-    if (setHeight)
-    {
-        sprite.height = spriteDef.height;
-    }
-    sprite.s = spriteDef.s;
-    sprite.t = spriteDef.t;
-    sprite.p = spriteDef.p;
-    sprite.q = spriteDef.q;
+    tilemap->stats = Stats();
 }
 
-void Set(Catalog* catalog, const char* name, Sprite::Sprite& sprite, int width, int height)
+} // namespace Tilemap
+
+//-----------------------------------------------------------------------------
+// [SECTION] File
+//-----------------------------------------------------------------------------
+
+namespace File
+{
+
+struct File
+{
+    MappedFile  mappedFile;
+};
+
+File* Map(const char* filename)
 {
-    if (catalog->sprites.find(name) == catalog->sprites.end())
+    auto file = new File();
+    if (!mapFile(filename, file->mappedFile))
     {
-        DEBUG("Sprite not found: %s\n", name);
-        return;
+        DEBUG("Could not map %s\n", filename);
+        delete(file);
+        return nullptr;
     }
 
-    const auto& spriteDef = catalog->sprites[name];
-    sprite.width = width;
-    sprite.height = height;
-    sprite.s = spriteDef.s;
-    sprite.t = spriteDef.t;
-    sprite.p = spriteDef.p;
-    sprite.q = spriteDef.q;
+    return file;
 }
 
-SpriteDef Get(Catalog* catalog, const char* name)
+void Unmap(File* file)
 {
-    if (catalog->sprites.find(name) == catalog->sprites.end())
+    if (file != nullptr)
     {
-        DEBUG("Sprite not found: %s\n", name);
-        return SpriteDef();
+        unmapFile(file->mappedFile);
+        delete(file);
+        file = nullptr;
     }
+}
 
-    return catalog->sprites[name];
+const void* GetData(const File* file)
+{
+    return file->mappedFile.data;
 }
 
-void PopulateFontGlyphs(std::vector<SpriteDef>& glyphs, const SpriteDef& spriteDef)
+size_t GetSize(const File* file)
 {
-    auto glyphWidth = (spriteDef.p - spriteDef.s) / 16.0f;
-    auto glyphHeight = (spriteDef.q - spriteDef.t)  / 16.0f;
-    auto fontWidth = spriteDef.width / 16;
-    auto fontHeight = spriteDef.height / 16;
-    for (auto y=0; y<16; ++y)
-    {
-        for (auto x=0; x<16; ++x)
-        {
-            glyphs.emplace_back((SpriteDef) {
-                .width = fontWidth,
-                .height = fontHeight,
-                .s = spriteDef.s + (x * glyphWidth),
-                .t = spriteDef.t + (y * glyphHeight),
-                .p = spriteDef.s + ((x * glyphWidth) + glyphWidth),
-                .q = spriteDef.t + ((y * glyphHeight) + glyphHeight)
-            });
-        }
-    }
+    return file->mappedFile.size;
 }
 
-} // namespace Catalog
+} // namespace File
 
 //-----------------------------------------------------------------------------
 // [SECTION] Petit2D
 //-----------------------------------------------------------------------------
 
 void Create()
+{
+    Create(Config());
+}
+
+void Create(const Config& config)
 {
     glCullFace(GL_BACK);
     glEnable(GL_CULL_FACE);
@@ -902,16 +5252,22 @@ void Create()
     glDisable(GL_DEPTH_TEST);
     glDisable(GL_PROGRAM_POINT_SIZE);
 
-    Shape::Create();
+    Texture::Create(config);
+    Shape::Create(config);
     Shape::SetPointSize(1.0f);
     Shape::SetLineWidth(1.0f);
-    Sprite::Create();
+    Line::Create(config);
+    Particle::Create();
+    Sprite::Create(config);
 }
 
 void Destroy()
 {
     Shape::Destroy();
+    Line::Destroy();
+    Particle::Destroy();
     Sprite::Destroy();
+    Texture::Destroy();
 }
 
 void SetClearColor(float r, float g, float b, float a)
@@ -927,6 +5283,7 @@ void Clear()
 void SetViewport(int x, int y, int width, int height)
 {
     glViewport(x, y, width, height);
+    Line::setViewport(width, height);
 }
 
 void SetBlending(BlendMode mode)
@@ -975,11 +5332,17 @@ void SetTexture(const Texture::Texture* texture, Texture::TextureUnit unit)
 //-----------------------------------------------------------------------------
 
 GLuint compileShader(GLenum type, const char* src)
+{
+    return compileShader(type, "", src);
+}
+
+GLuint compileShader(GLenum type, const char* header, const char* src)
 {
     GLint success;
     auto id = glCreateShader(type);
 
-    glShaderSource(id, 1, &src, nullptr);
+    const char* sources[] = { header, src };
+    glShaderSource(id, 2, sources, nullptr);
     glCompileShader(id);
 
     glGetShaderiv(id, GL_COMPILE_STATUS, &success);
@@ -994,6 +5357,90 @@ GLuint compileShader(GLenum type, const char* src)
     return id;
 }
 
+bool mapFile(const char* filename, MappedFile& mappedFile)
+{
+#ifdef _WIN32
+    auto file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+    {
+        CloseHandle(file);
+        return false;
+    }
+
+    auto mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping == nullptr)
+    {
+        CloseHandle(file);
+        return false;
+    }
+
+    auto data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (data == nullptr)
+    {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+
+    mappedFile.file = file;
+    mappedFile.mapping = mapping;
+    mappedFile.data = static_cast<const unsigned char*>(data);
+    mappedFile.size = static_cast<size_t>(size.QuadPart);
+#else
+    auto file = open(filename, O_RDONLY);
+    if (file == -1)
+    {
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(file, &info) != 0 || info.st_size == 0)
+    {
+        close(file);
+        return false;
+    }
+
+    auto data = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+    close(file);
+    if (data == MAP_FAILED)
+    {
+        return false;
+    }
+
+    mappedFile.data = static_cast<const unsigned char*>(data);
+    mappedFile.size = static_cast<size_t>(info.st_size);
+#endif
+
+    return true;
+}
+
+void unmapFile(MappedFile& mappedFile)
+{
+    if (mappedFile.data == nullptr)
+    {
+        return;
+    }
+
+#ifdef _WIN32
+    UnmapViewOfFile(mappedFile.data);
+    CloseHandle(mappedFile.mapping);
+    CloseHandle(mappedFile.file);
+    mappedFile.file = INVALID_HANDLE_VALUE;
+    mappedFile.mapping = nullptr;
+#else
+    munmap(const_cast<unsigned char*>(mappedFile.data), mappedFile.size);
+#endif
+
+    mappedFile.data = nullptr;
+    mappedFile.size = 0;
+}
+
 void checkProgram(GLuint id)
 {
     GLint success;
@@ -1006,6 +5453,31 @@ void checkProgram(GLuint id)
     }
 }
 
+bool hasBufferStorage()
+{
+    GLint major = 0;
+    GLint minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    if (major > 4 || (major == 4 && minor >= 4))
+    {
+        return true;
+    }
+
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (auto i=0; i<count; ++i)
+    {
+        auto name = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+        if (name != nullptr && strcmp(name, "GL_ARB_buffer_storage") == 0)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
 constexpr GLenum getTextureFilter(Petit2D::Texture::Filter filter)
 {
     switch (filter)
@@ -1029,8 +5501,31 @@ constexpr GLenum getInternalFormat(Petit2D::Texture::InternalFormat format)
 {
     switch (format)
     {
-    case Petit2D::Texture::InternalFormat::RGBA8:   return GL_RGBA8;
-    default:                                        return format;
+    case Petit2D::Texture::InternalFormat::RGBA8:                       return GL_RGBA8;
+    case Petit2D::Texture::InternalFormat::R8:                          return GL_R8;
+    case Petit2D::Texture::InternalFormat::RG8:                         return GL_RG8;
+    case Petit2D::Texture::InternalFormat::RGB565:                      return GL_RGB565;
+    case Petit2D::Texture::InternalFormat::RGBA4:                       return GL_RGBA4;
+    case Petit2D::Texture::InternalFormat::RGB5_A1:                     return GL_RGB5_A1;
+    case Petit2D::Texture::InternalFormat::COMPRESSED_RGB8_ETC2:        return GL_COMPRESSED_RGB8_ETC2;
+    case Petit2D::Texture::InternalFormat::COMPRESSED_RGB8_A1_ETC2:     return GL_COMPRESSED_RGB8_PUNCHTHROUGH_ALPHA1_ETC2;
+    case Petit2D::Texture::InternalFormat::COMPRESSED_RGBA8_ETC2_EAC:   return GL_COMPRESSED_RGBA8_ETC2_EAC;
+    case Petit2D::Texture::InternalFormat::COMPRESSED_R11_EAC:          return GL_COMPRESSED_R11_EAC;
+    case Petit2D::Texture::InternalFormat::COMPRESSED_RG11_EAC:         return GL_COMPRESSED_RG11_EAC;
+    default:                                                            return format;
+    }
+}
+
+constexpr int getBlockSize(Petit2D::Texture::InternalFormat format)
+{
+    switch (format)
+    {
+    case Petit2D::Texture::InternalFormat::COMPRESSED_RGB8_ETC2:        return 8;
+    case Petit2D::Texture::InternalFormat::COMPRESSED_RGB8_A1_ETC2:     return 8;
+    case Petit2D::Texture::InternalFormat::COMPRESSED_R11_EAC:          return 8;
+    case Petit2D::Texture::InternalFormat::COMPRESSED_RGBA8_ETC2_EAC:   return 16;
+    case Petit2D::Texture::InternalFormat::COMPRESSED_RG11_EAC:         return 16;
+    default:                                                            return 0;
     }
 }
 
@@ -1039,6 +5534,9 @@ constexpr GLenum getFormat(Petit2D::Texture::Format format)
     switch (format)
     {
     case Petit2D::Texture::Format::RGBA:    return GL_RGBA;
+    case Petit2D::Texture::Format::RED:     return GL_RED;
+    case Petit2D::Texture::Format::RG:      return GL_RG;
+    case Petit2D::Texture::Format::RGB:     return GL_RGB;
     default:                                return format;
     }
 }
@@ -1047,8 +5545,11 @@ constexpr GLenum getDataType(Petit2D::Texture::DataType dataType)
 {
     switch (dataType)
     {
-    case Petit2D::Texture::DataType::UNSIGNED_BYTE: return GL_UNSIGNED_BYTE;
-    default:                                        return dataType;
+    case Petit2D::Texture::DataType::UNSIGNED_BYTE:             return GL_UNSIGNED_BYTE;
+    case Petit2D::Texture::DataType::UNSIGNED_SHORT_5_6_5:      return GL_UNSIGNED_SHORT_5_6_5;
+    case Petit2D::Texture::DataType::UNSIGNED_SHORT_4_4_4_4:    return GL_UNSIGNED_SHORT_4_4_4_4;
+    case Petit2D::Texture::DataType::UNSIGNED_SHORT_5_5_5_1:    return GL_UNSIGNED_SHORT_5_5_5_1;
+    default:                                                    return dataType;
     }
 }
 
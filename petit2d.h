@@ -1,6 +1,7 @@
 #pragma once
 
 #include <vector>
+#include <cstddef>
 
 namespace Petit2D
 {
@@ -9,7 +10,12 @@ namespace Petit2D
 // [SECTION] Petit2D - Forward declarations and basic types
 //-----------------------------------------------------------------------------
 
+struct          Config;
+struct          Rect;
+
 enum            BlendMode           : int;
+enum            StreamMode          : int;
+enum            SpriteLayout        : int;
 
 //-----------------------------------------------------------------------------
 // [SECTION] Texture
@@ -37,12 +43,26 @@ namespace Texture
     Texture*        Create          ();
     void            Destroy         (Texture* texture);
     void            Init            (Texture* texture, const char* filename);
+    void            Init            (Texture* texture, const char* filename, InternalFormat internalFormat);
     void            Init            (Texture* texture, int width, int height, InternalFormat internalFormat, Format format, DataType type, void* pixels);
+    void            InitCompressed  (Texture* texture, int width, int height, InternalFormat internalFormat, int size, const void* data);
+    void            InitAsync       (Texture* texture, const char* filename);
+    void            InitAsync       (Texture* texture, const char* filename, InternalFormat internalFormat);
+    void            Update          (float budget = 0.0f);
+    bool            IsReady         (const Texture* texture);
+    int             GetPendingCount ();
     void            SetWrap         (Texture* texture, Wrap s, Wrap t);
     void            SetFilter       (Texture* texture, Filter min, Filter mag);
     int             GetWidth        (const Texture* texture);
     int             GetHeight       (const Texture* texture);
 
+    // Distance fields of the alpha channel, one byte per pixel: 128 on the edge,
+    // 255 and 0 spread pixels inside and outside. Atlas sprites need spread
+    // pixels of padding. InitDistanceField loads an RGBA image as an R8 field
+    // for Sprite::UseDistanceField.
+    void            GenerateDistanceField   (const unsigned char* pixels, int width, int height, int spread, unsigned char* distances);
+    void            InitDistanceField       (Texture* texture, const char* filename, int spread);
+
 } // namespace Texture
 
 //-----------------------------------------------------------------------------
@@ -67,6 +87,34 @@ namespace FrameBuffer
 
 } // namespace FrameBuffer
 
+//-----------------------------------------------------------------------------
+// [SECTION] Camera
+//-----------------------------------------------------------------------------
+
+namespace Camera
+{
+    //-----------------------------------------------------------------------------
+    // [SECTION] Camera - Forward declarations and basic types
+    //-----------------------------------------------------------------------------
+
+    struct          Camera;
+
+    //-----------------------------------------------------------------------------
+    // [SECTION] Camera - End-user API functions
+    //-----------------------------------------------------------------------------
+
+    Camera*         Create          ();
+    void            Destroy         (Camera* camera);
+    void            Init            (Camera* camera, float width, float height);
+    void            SetPosition     (Camera* camera, float x, float y);
+    void            SetZoom         (Camera* camera, float zoom);
+    void            SetRotation     (Camera* camera, float rotation);
+    const float*    GetMatrix       (const Camera* camera);
+    Rect            GetView         (const Camera* camera);
+    void            ScreenToWorld   (const Camera* camera, float screenX, float screenY, float& worldX, float& worldY);
+
+} // namespace Camera
+
 //-----------------------------------------------------------------------------
 // [SECTION] Sprites
 //-----------------------------------------------------------------------------
@@ -79,19 +127,63 @@ namespace Sprite
     //-----------------------------------------------------------------------------
 
     struct          Sprite;
+    struct          SpriteArrays;
+    struct          Stats;
+    struct          Recorder;
+    struct          Batch;
     
     //-----------------------------------------------------------------------------
     // [SECTION] Sprites - End-user API functions
     //-----------------------------------------------------------------------------
 
     void            Use             ();
+    void            UseDistanceField();
     void            SetTexture      (Texture::TextureUnit unit);
     void            SetMatrix       (const float* value);
+    void            SetMatrix       (const Camera::Camera* camera);
+    void            SetTime         (float time);
+    int             AddAnimation    (const float* frames, int frameCount, bool loop = true);
+    void            ClearAnimations ();
     void            Begin           ();
     void            Add             (const Sprite& sprite);
+    void            AddRange        (const Sprite* sprites, std::size_t count);
+    void            AddRange        (const SpriteArrays& sprites, std::size_t count);
     void            End             ();
     void            Render          ();
     int             GetMaxSprites   ();
+    Stats           GetStats        ();
+    void            ResetStats      ();
+    bool            IsVisible       (const Sprite& sprite, const Rect& view);
+    Rect            GetBounds       (const Sprite& sprite);
+    std::size_t     Cull            (const Rect& view, const Sprite* sprites, std::size_t count, Sprite* visible);
+
+    // Recorders pack instances on any thread once Petit2D is created, Submit
+    // copies them to the current batch on the GL thread in the order it is
+    // called, optionally moved by x, y. While a recorder is set on a thread, Add
+    // and AddRange from that thread record into it, and SetBatch and DrawBatch
+    // are kept for Submit to run in order with the recorded instances. Batches
+    // must outlive the recorders that reference them until Submit.
+    Recorder*       CreateRecorder  ();
+    void            DestroyRecorder (Recorder* recorder);
+    void            Clear           (Recorder* recorder);
+    void            SetRecorder     (Recorder* recorder);
+    int             GetCount        (const Recorder* recorder);
+    void            Record          (Recorder* recorder, const Sprite& sprite);
+    void            Record          (Recorder* recorder, const Sprite* sprites, std::size_t count);
+    void            Record          (Recorder* recorder, const SpriteArrays& sprites, std::size_t count);
+    void            Submit          (const Recorder* recorder);
+    void            Submit          (const Recorder* recorder, float x, float y);
+
+    // Batches keep packed instances on the GPU until set again, for sprites that
+    // rarely change. SetBatch uploads right away, DrawBatch draws the current
+    // batch first then the whole batch in one call, with model applied before
+    // the projection, identity when nullptr.
+    Batch*          CreateBatch     ();
+    void            DestroyBatch    (Batch* batch);
+    void            SetBatch        (Batch* batch, const Sprite* sprites, std::size_t count);
+    void            SetBatch        (Batch* batch, const SpriteArrays& sprites, std::size_t count);
+    void            DrawBatch       (const Batch* batch, const float* model = nullptr);
+    int             GetCount        (const Batch* batch);
 
 } // namespace Sprite
 
@@ -107,6 +199,7 @@ namespace Shape
     //-----------------------------------------------------------------------------
 
     struct      Vertex;
+    struct      Stats;
 
     enum        DrawType            : int;
     
@@ -116,18 +209,120 @@ namespace Shape
 
     void        Use                 ();
     void        SetMatrix           (const float* value);
+    void        SetMatrix           (const Camera::Camera* camera);
     void        SetPointSize        (float size);
     float       GetPointSize        ();
     void        SetLineWidth        (float width);
     float       GetLineWidth        ();
     void        Begin               ();
+    void        Begin               (const DrawType drawType);
     void        Add                 (const Vertex& vertex);
     void        End                 ();
     void        Render              (const DrawType drawType);
+
+    // Primitive batches take whole shapes of any DrawType and draw them in at
+    // most three calls: triangles, then lines, then points.
+    void        BeginPrimitives     ();
+    void        AddPrimitive        (const Vertex* vertices, int count, const DrawType drawType);
+    void        AddIndexed          (const Vertex* vertices, int count, const unsigned int* indices, int indexCount, const DrawType drawType);
+    void        EndPrimitives       ();
+    void        RenderPrimitives    ();
     int         GetMaxVertices      ();
+    Stats       GetStats            ();
+    void        ResetStats          ();
 
 } // namespace Shape
 
+//-----------------------------------------------------------------------------
+// [SECTION] Lines
+//-----------------------------------------------------------------------------
+
+namespace Line
+{
+
+    //-----------------------------------------------------------------------------
+    // [SECTION] Lines - Forward declarations and basic types
+    //-----------------------------------------------------------------------------
+
+    struct      Stats;
+
+    enum        Cap                 : int;
+    enum        Join                : int;
+
+    //-----------------------------------------------------------------------------
+    // [SECTION] Lines - End-user API functions
+    //-----------------------------------------------------------------------------
+
+    // Segments are drawn as instanced quads with anti-aliased edges, width is in
+    // world units. Polylines join their segments, colors blend along each one.
+    void        Use                 ();
+    void        SetMatrix           (const float* value);
+    void        SetMatrix           (const Camera::Camera* camera);
+    void        SetCap              (Cap cap);
+    void        SetJoin             (Join join);
+    void        SetMiterLimit       (float limit);
+    void        Begin               ();
+    void        Add                 (const Shape::Vertex& from, const Shape::Vertex& to, float width);
+    void        AddPolyline         (const Shape::Vertex* vertices, int count, float width, bool closed = false);
+    void        End                 ();
+    void        Render              ();
+    Stats       GetStats            ();
+    void        ResetStats          ();
+
+} // namespace Line
+
+//-----------------------------------------------------------------------------
+// [SECTION] Particles
+//-----------------------------------------------------------------------------
+
+namespace Particle
+{
+
+    //-----------------------------------------------------------------------------
+    // [SECTION] Particles - Forward declarations and basic types
+    //-----------------------------------------------------------------------------
+
+    struct      Emitter;
+    struct      Stats;
+
+    //-----------------------------------------------------------------------------
+    // [SECTION] Particles - End-user API functions
+    //-----------------------------------------------------------------------------
+
+    // Particles are evaluated in the vertex shader from their emitter, their
+    // index and the time: Render uploads the emitter alone and draws all of its
+    // particles in one call. Emitter times are in the same clock as SetTime.
+    void        Use                 ();
+    void        SetTexture          (Texture::TextureUnit unit);
+    void        SetMatrix           (const float* value);
+    void        SetMatrix           (const Camera::Camera* camera);
+    void        SetTime             (float time);
+    int         GetCount            (const Emitter& emitter);
+    void        Render              (const Emitter& emitter);
+    Stats       GetStats            ();
+    void        ResetStats          ();
+
+} // namespace Particle
+
+//-----------------------------------------------------------------------------
+// [SECTION] Queue
+//-----------------------------------------------------------------------------
+
+namespace Queue
+{
+
+    //-----------------------------------------------------------------------------
+    // [SECTION] Queue - End-user API functions
+    //-----------------------------------------------------------------------------
+
+    void        Begin               ();
+    void        Add                 (const Sprite::Sprite& sprite, const Texture::Texture* texture, BlendMode blend, int layer = 0, unsigned int depth = 0);
+    void        Add                 (const Shape::Vertex* vertices, int count, Shape::DrawType drawType, BlendMode blend, int layer = 0, unsigned int depth = 0);
+    void        Flush               ();
+    int         GetCommandCount     ();
+
+} // namespace Queue
+
 //-----------------------------------------------------------------------------
 // [SECTION] Catalog
 //-----------------------------------------------------------------------------
@@ -148,19 +343,87 @@ namespace Catalog
 
     Catalog*    Create              ();
     void        Init                (Catalog* catalog, const char* filename);
+    void        Save                (Catalog* catalog, const char* filename);
     void        Destroy             (Catalog* catalog);
     void        Set                 (Catalog* catalog, const char* name, Sprite::Sprite& sprite, bool setWidth = true, bool setHeight = true);
     void        Set                 (Catalog* catalog, const char* name, Sprite::Sprite& sprite, int width, int height);
     SpriteDef   Get                 (Catalog* catalog, const char* name);
+    int         Find                (Catalog* catalog, const char* name);
+    void        Set                 (Catalog* catalog, int handle, Sprite::Sprite& sprite, bool setWidth = true, bool setHeight = true);
+    void        Set                 (Catalog* catalog, int handle, Sprite::Sprite& sprite, int width, int height);
+    SpriteDef   Get                 (Catalog* catalog, int handle);
+    int         AddAnimation        (Catalog* catalog, const char* const* names, int count, bool loop = true);
     void        PopulateFontGlyphs  (std::vector<SpriteDef>& glyphs, const SpriteDef& spriteDef);
 
 } // namespace Catalog
 
+//-----------------------------------------------------------------------------
+// [SECTION] Tilemap
+//-----------------------------------------------------------------------------
+
+namespace Tilemap
+{
+
+    //-----------------------------------------------------------------------------
+    // [SECTION] Tilemap - Forward declarations and basic types
+    //-----------------------------------------------------------------------------
+
+    struct      Tilemap;
+    struct      Stats;
+
+    //-----------------------------------------------------------------------------
+    // [SECTION] Tilemap - End-user API functions
+    //-----------------------------------------------------------------------------
+
+    // Static layers of catalog sprites, split in square chunks kept on the GPU.
+    // Tiles are catalog handles, -1 is empty. Render draws with the sprite
+    // program, after Sprite::Use and its texture and matrix, only the chunks
+    // overlapping the view.
+    Tilemap*    Create              ();
+    void        Destroy             (Tilemap* tilemap);
+    void        Init                (Tilemap* tilemap, Catalog::Catalog* catalog, int columns, int rows, int tileWidth, int tileHeight, int chunkSize = 32);
+    void        SetTile             (Tilemap* tilemap, int column, int row, int tile);
+    void        SetTile             (Tilemap* tilemap, int column, int row, const char* name);
+    int         GetTile             (const Tilemap* tilemap, int column, int row);
+    void        Render              (Tilemap* tilemap);
+    void        Render              (Tilemap* tilemap, const Rect& view);
+    void        Render              (Tilemap* tilemap, const Camera::Camera* camera);
+    Stats       GetStats            (const Tilemap* tilemap);
+    void        ResetStats          (Tilemap* tilemap);
+
+} // namespace Tilemap
+
+//-----------------------------------------------------------------------------
+// [SECTION] File
+//-----------------------------------------------------------------------------
+
+namespace File
+{
+
+    //-----------------------------------------------------------------------------
+    // [SECTION] File - Forward declarations and basic types
+    //-----------------------------------------------------------------------------
+
+    struct      File;
+
+    //-----------------------------------------------------------------------------
+    // [SECTION] File - End-user API functions
+    //-----------------------------------------------------------------------------
+
+    // Read only memory mapping of a whole file, for formats used in place.
+    File*               Map         (const char* filename);
+    void                Unmap       (File* file);
+    const void*         GetData     (const File* file);
+    std::size_t         GetSize     (const File* file);
+
+} // namespace File
+
 //-----------------------------------------------------------------------------
 // [SECTION] Petit2D - End-user API functions
 //-----------------------------------------------------------------------------
 
 void            Create              ();
+void            Create              (const Config& config);
 void            Destroy             ();
 void            SetClearColor       (float r, float g, float b, float a);
 void            Clear               ();
@@ -182,6 +445,42 @@ enum Petit2D::BlendMode : int
     ADDITIVE            = 2
 };
 
+enum Petit2D::StreamMode : int
+{
+    MAP_RANGE           = 0,    // Map / unmap the whole buffer every Begin / End
+    ORPHAN              = 1,    // Orphan the buffer store then map it unsynchronized
+    PERSISTENT          = 2     // Keep the buffer mapped, one fenced region per frame
+};
+
+enum Petit2D::SpriteLayout : int
+{
+    PRECISE             = 0,    // 44 bytes per sprite, float coordinates, UVs, scale and angle
+    COMPACT             = 1     // 32 bytes per sprite, float coordinates, unorm16 UVs, half scale, 16 bits angle
+};
+
+// World space axis aligned rectangle, top is the smallest y.
+struct Petit2D::Rect
+{
+    float           left        = 0.0f;
+    float           top         = 0.0f;
+    float           right       = 0.0f;
+    float           bottom      = 0.0f;
+};
+
+struct Petit2D::Config
+{
+    SpriteLayout    spriteLayout        = SpriteLayout::PRECISE;
+    bool            spriteAnimation     = false;    // Adds flipbook animation to sprite instances, 12 more bytes each
+    bool            spriteDistanceField = false;    // Adds Sprite::UseDistanceField and outlines to sprite instances, 8 more bytes each
+    StreamMode      spriteStreamMode    = StreamMode::MAP_RANGE;
+    int             spriteStreamRegions = 3;
+    int             maxSpritesPerBatch  = 16384;    // Sprite batches flush on their own when full
+    int             maxVerticesPerBatch = 4096;     // Shape batches flush on their own when full
+    int             maxLinesPerBatch    = 16384;    // Line batches flush on their own when full
+    int             textureLoaderThreads    = 0;        // Decode threads for Texture::InitAsync, 0 picks from the core count
+    int             textureUploadBufferSize = 1 << 22;  // Bytes uploaded per staging buffer, large textures span several
+};
+
 //-----------------------------------------------------------------------------
 // [SECTION] Sprites - Public declarations and basic types
 //-----------------------------------------------------------------------------
@@ -203,6 +502,55 @@ struct Petit2D::Sprite::Sprite
     float           rotation    = 0.0f;
     int             width       = 0.0f;
     int             height      = 0.0f;
+    int             animation       = -1;       // From Sprite::AddAnimation, -1 keeps s, t, p, q
+    float           animation_start = 0.0f;     // Sprite::SetTime time the animation started at
+    float           animation_rate  = 0.0f;     // Frames per second
+    unsigned char   outline_r       = 0;        // Distance field outline color, drawn under the fill
+    unsigned char   outline_g       = 0;
+    unsigned char   outline_b       = 0;
+    unsigned char   outline_a       = 0;
+    float           outline         = 0.0f;     // Outline width, 0 to 1 of the distance field spread
+    float           smoothing       = 0.0f;     // Edge softness added to the antialiasing, same unit
+};
+
+// Structure of arrays view of sprites for Sprite::AddRange, every array holds
+// at least the count of sprites passed along.
+struct Petit2D::Sprite::SpriteArrays
+{
+    const float*            x           = nullptr;
+    const float*            y           = nullptr;
+    const float*            s           = nullptr;
+    const float*            t           = nullptr;
+    const float*            p           = nullptr;
+    const float*            q           = nullptr;
+    const unsigned char*    r           = nullptr;
+    const unsigned char*    g           = nullptr;
+    const unsigned char*    b           = nullptr;
+    const unsigned char*    a           = nullptr;
+    const float*            scale_x     = nullptr;
+    const float*            scale_y     = nullptr;
+    const float*            rotation    = nullptr;
+    const int*              width       = nullptr;
+    const int*              height      = nullptr;
+    const int*              animation       = nullptr;  // Optional, animations are off without it
+    const float*            animation_start = nullptr;
+    const float*            animation_rate  = nullptr;
+    const unsigned char*    outline_r       = nullptr;  // Optional, outline colors are transparent without it
+    const unsigned char*    outline_g       = nullptr;
+    const unsigned char*    outline_b       = nullptr;
+    const unsigned char*    outline_a       = nullptr;
+    const float*            outline         = nullptr;  // Optional
+    const float*            smoothing       = nullptr;  // Optional
+};
+
+struct Petit2D::Sprite::Stats
+{
+    StreamMode      streamMode  = StreamMode::MAP_RANGE;    // Mode in use, after fallback
+    int             waitCount   = 0;                        // Begin() calls that had to wait on a fence
+    double          waitTime    = 0.0;                      // Total time spent waiting, in milliseconds
+    double          maxWaitTime = 0.0;                      // Longest single wait, in milliseconds
+    int             drawCalls   = 0;                        // Instanced draws issued, including automatic flushes
+    int             batchBytes  = 0;                        // Instances sent by SetBatch
 };
 
 //-----------------------------------------------------------------------------
@@ -219,6 +567,11 @@ struct Petit2D::Shape::Vertex
     unsigned char   a   = 255;
 };
 
+struct Petit2D::Shape::Stats
+{
+    int     drawCalls   = 0;    // Draws issued, including automatic flushes
+};
+
 enum Petit2D::Shape::DrawType : int
 {
     POINTS              = 0,
@@ -230,6 +583,74 @@ enum Petit2D::Shape::DrawType : int
     TRIANGLES_FAN       = 6
 };
 
+//-----------------------------------------------------------------------------
+// [SECTION] Lines - Public declarations and basic types
+//-----------------------------------------------------------------------------
+
+struct Petit2D::Line::Stats
+{
+    int     drawCalls   = 0;    // Instanced draws issued, including automatic flushes
+};
+
+// Ends of a segment without a neighbour.
+enum Petit2D::Line::Cap : int
+{
+    CAP_BUTT            = 0,    // Flat, at the end point
+    CAP_SQUARE          = 1,    // Flat, half the width past the end point
+    CAP_ROUND           = 2
+};
+
+// Ends shared by two segments of a polyline.
+enum Petit2D::Line::Join : int
+{
+    JOIN_MITER          = 0,    // Sharp corner, round past the miter limit
+    JOIN_ROUND          = 1
+};
+
+//-----------------------------------------------------------------------------
+// [SECTION] Particles - Public declarations and basic types
+//-----------------------------------------------------------------------------
+
+struct Petit2D::Particle::Emitter
+{
+    float           x           = 0.0f;
+    float           y           = 0.0f;
+    float           radius      = 0.0f;     // Particles spawn in this disc around x, y
+    unsigned int    seed        = 0;        // Emitters with other seeds look different, 24 bits
+    float           angle       = 0.0f;     // Direction in degrees, spread is the full range around it
+    float           spread      = 360.0f;
+    float           minSpeed    = 0.0f;     // Units per second
+    float           maxSpeed    = 0.0f;
+    float           gravity_x   = 0.0f;     // Units per second squared
+    float           gravity_y   = 0.0f;
+    float           minSpin     = 0.0f;     // Degrees per second
+    float           maxSpin     = 0.0f;
+    float           lifetime    = 1.0f;     // Seconds, every particle is reborn at the end of it
+    float           rate        = 100.0f;   // Particles per second, rate * lifetime are alive at once
+    float           start       = 0.0f;     // SetTime time the first particle is born at
+    float           duration    = 0.0f;     // Seconds of emission, 0 emits forever
+    float           startSize   = 1.0f;
+    float           endSize     = 1.0f;
+    unsigned char   start_r     = 255;
+    unsigned char   start_g     = 255;
+    unsigned char   start_b     = 255;
+    unsigned char   start_a     = 255;
+    unsigned char   end_r       = 255;
+    unsigned char   end_g       = 255;
+    unsigned char   end_b       = 255;
+    unsigned char   end_a       = 0;
+    float           s           = 0.0f;
+    float           t           = 0.0f;
+    float           p           = 1.0f;
+    float           q           = 1.0f;
+};
+
+struct Petit2D::Particle::Stats
+{
+    int     drawCalls       = 0;    // One per rendered emitter
+    int     particleCount   = 0;    // Instances drawn, alive or not
+};
+
 //-----------------------------------------------------------------------------
 // [SECTION] Texture - Public declarations and basic types
 //-----------------------------------------------------------------------------
@@ -245,17 +666,33 @@ enum Petit2D::Texture::TextureUnit : int
 
 enum Petit2D::Texture::InternalFormat : int
 {
-    RGBA8               = 0
+    RGBA8                       = 0,
+    R8                          = 1,
+    RG8                         = 2,
+    RGB565                      = 3,
+    RGBA4                       = 4,
+    RGB5_A1                     = 5,
+    COMPRESSED_RGB8_ETC2        = 6,    // Compressed formats only load through InitCompressed
+    COMPRESSED_RGB8_A1_ETC2     = 7,
+    COMPRESSED_RGBA8_ETC2_EAC   = 8,
+    COMPRESSED_R11_EAC          = 9,
+    COMPRESSED_RG11_EAC         = 10
 };
 
 enum Petit2D::Texture::Format : int
 {
-    RGBA                = 0
+    RGBA                = 0,
+    RED                 = 1,
+    RG                  = 2,
+    RGB                 = 3
 };
 
 enum Petit2D::Texture::DataType : int
 {
-    UNSIGNED_BYTE       = 0
+    UNSIGNED_BYTE           = 0,
+    UNSIGNED_SHORT_5_6_5    = 1,
+    UNSIGNED_SHORT_4_4_4_4  = 2,
+    UNSIGNED_SHORT_5_5_5_1  = 3
 };
 
 enum Petit2D::Texture::Wrap : int
@@ -283,3 +720,13 @@ struct Petit2D::Catalog::SpriteDef
     float   p           = 1.0f;
     float   q           = 1.0f;
 };
+
+//-----------------------------------------------------------------------------
+// [SECTION] Tilemap - Public declarations and basic types
+//-----------------------------------------------------------------------------
+
+struct Petit2D::Tilemap::Stats
+{
+    int     drawCalls       = 0;    // One per visible chunk holding tiles
+    int     uploadedBytes   = 0;    // Chunk builds and tile edits sent to the GPU
+};
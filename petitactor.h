@@ -1,7 +1,15 @@
 #pragma once
 
 #include "petit2d.h"
+#include "petittask.h"
 
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <tuple>
+#include <algorithm>
+#include <functional>
+#include <unordered_map>
 #include <vector>
 #include <list>
 
@@ -31,6 +39,38 @@ namespace Actor
 
 } // namespace Actor
 
+//-----------------------------------------------------------------------------
+// [SECTION] Spatial
+//-----------------------------------------------------------------------------
+
+namespace Spatial
+{
+
+    //-----------------------------------------------------------------------------
+    // [SECTION] Spatial - Forward declarations and basic types
+    //-----------------------------------------------------------------------------
+
+    template <typename T> struct  Grid;
+
+} // namespace Spatial
+
+//-----------------------------------------------------------------------------
+// [SECTION] Pool
+//-----------------------------------------------------------------------------
+
+namespace Pool
+{
+
+    //-----------------------------------------------------------------------------
+    // [SECTION] Pool - Forward declarations and basic types
+    //-----------------------------------------------------------------------------
+
+    struct                  Handle;
+    struct                  SpriteColumns;
+    template <typename T>   struct  Pool;
+
+} // namespace Pool
+
 //-----------------------------------------------------------------------------
 // [SECTION] Layer
 //-----------------------------------------------------------------------------
@@ -43,6 +83,8 @@ namespace Layer
     //-----------------------------------------------------------------------------
 
     template <typename A> struct  Layer;
+    template <typename... T> struct  PoolLayer;
+    struct Schedule;
     struct SpriteLayer;
     struct VertexLayer;
 
@@ -58,6 +100,7 @@ struct PetitActor::Actor::Actor
 {
     bool isAlive = false;
     bool isVisible = false;
+    int proxy = -1;     // Spatial index entry, owned by the SpriteLayer the actor is in
   
     Actor()
     {
@@ -69,6 +112,20 @@ struct PetitActor::Actor::Actor
 
     virtual void update(float dt) = 0;
     virtual void render() = 0;
+
+    // Called by Layer::render(camera), actors that can tell they are off screen
+    // override it to skip the batch.
+    virtual void render(const Petit2D::Rect&)
+    {
+        render();
+    }
+
+    // World space bounds for the spatial index, actors without any are reported by
+    // every query.
+    virtual bool getBounds(Petit2D::Rect&) const
+    {
+        return false;
+    }
 };
 
 template<typename T, typename R>
@@ -104,8 +161,27 @@ public PetitActor::Actor::TypedActor<Petit2D::Sprite::Sprite, Petit2D::Sprite::S
     {
         Petit2D::Sprite::Add(target);
     }
+
+    virtual void render(const Petit2D::Rect& view) override
+    {
+        if (Petit2D::Sprite::IsVisible(target, view))
+        {
+            Petit2D::Sprite::Add(target);
+        }
+    }
+
+    virtual bool getBounds(Petit2D::Rect& bounds) const override
+    {
+        bounds = Petit2D::Sprite::GetBounds(target);
+        return true;
+    }
 };
 
+// Retained actors keep their sprites in a Sprite::Batch drawn in one call, for
+// content that rarely changes: call markDirty after editing target so the next
+// render uploads it again. They are culled as a whole, not sprite by sprite.
+// Under SpriteLayer::renderParallel the upload and draw are recorded and run
+// when the layer submits.
 struct PetitActor::Actor::SpriteVectorActor :
 public PetitActor::Actor::TypedActor<std::vector<Petit2D::Sprite::Sprite>, Petit2D::Sprite::Sprite>
 {
@@ -114,18 +190,122 @@ public PetitActor::Actor::TypedActor<std::vector<Petit2D::Sprite::Sprite>, Petit
     {
     }
 
+    // Copies get their own batch, uploaded on their first render.
+    SpriteVectorActor(const SpriteVectorActor& other) :
+    TypedActor(other),
+    retained(other.retained)
+    {
+    }
+
+    SpriteVectorActor& operator=(const SpriteVectorActor& other)
+    {
+        TypedActor::operator=(other);
+        setRetained(other.retained);
+        markDirty();
+        return *this;
+    }
+
     virtual ~SpriteVectorActor()
     {
         target.clear();
+        Petit2D::Sprite::DestroyBatch(batch);
     }
 
-    virtual void render()
+    void setRetained(bool value)
+    {
+        retained = value;
+        if (!retained)
+        {
+            Petit2D::Sprite::DestroyBatch(batch);
+            batch = nullptr;
+        }
+        dirty = true;
+    }
+
+    void markDirty()
+    {
+        dirty = true;
+    }
+
+    virtual void render() override
     {
+        if (retained)
+        {
+            upload();
+            Petit2D::Sprite::DrawBatch(batch);
+            return;
+        }
+
         for (const auto& sprite : target)
         {
             Petit2D::Sprite::Add(sprite);
         }
     }
+
+    virtual void render(const Petit2D::Rect& view) override
+    {
+        if (retained)
+        {
+            upload();
+            if (hasBounds && bounds.right >= view.left && bounds.left <= view.right && bounds.bottom >= view.top && bounds.top <= view.bottom)
+            {
+                Petit2D::Sprite::DrawBatch(batch);
+            }
+            return;
+        }
+
+        for (const auto& sprite : target)
+        {
+            if (Petit2D::Sprite::IsVisible(sprite, view))
+            {
+                Petit2D::Sprite::Add(sprite);
+            }
+        }
+    }
+
+    virtual bool getBounds(Petit2D::Rect& bounds) const override
+    {
+        if (target.empty())
+        {
+            return false;
+        }
+
+        bounds = Petit2D::Sprite::GetBounds(target.front());
+        for (const auto& sprite : target)
+        {
+            auto spriteBounds = Petit2D::Sprite::GetBounds(sprite);
+            bounds.left = std::min(bounds.left, spriteBounds.left);
+            bounds.top = std::min(bounds.top, spriteBounds.top);
+            bounds.right = std::max(bounds.right, spriteBounds.right);
+            bounds.bottom = std::max(bounds.bottom, spriteBounds.bottom);
+        }
+
+        return true;
+    }
+
+private:
+    void upload()
+    {
+        if (!dirty && batch != nullptr)
+        {
+            return;
+        }
+
+        if (batch == nullptr)
+        {
+            batch = Petit2D::Sprite::CreateBatch();
+        }
+
+        Petit2D::Sprite::SetBatch(batch, target.data(), target.size());
+        hasBounds = getBounds(bounds);
+        dirty = false;
+    }
+
+    Petit2D::Sprite::Batch* batch       = nullptr;
+    Petit2D::Rect           bounds;
+    bool                    retained    = false;
+    bool                    dirty       = true;
+    bool                    hasBounds   = false;
 };
 
 struct PetitActor::Actor::SpriteListActor :
@@ -141,13 +321,44 @@ public PetitActor::Actor::TypedActor<std::list<Petit2D::Sprite::Sprite>, Petit2D
         target.clear();
     }
 
-    virtual void render()
+    virtual void render() override
     {
         for (const auto& sprite : target)
         {
             Petit2D::Sprite::Add(sprite);
         }
     }
+
+    virtual void render(const Petit2D::Rect& view) override
+    {
+        for (const auto& sprite : target)
+        {
+            if (Petit2D::Sprite::IsVisible(sprite, view))
+            {
+                Petit2D::Sprite::Add(sprite);
+            }
+        }
+    }
+
+    virtual bool getBounds(Petit2D::Rect& bounds) const override
+    {
+        if (target.empty())
+        {
+            return false;
+        }
+
+        bounds = Petit2D::Sprite::GetBounds(target.front());
+        for (const auto& sprite : target)
+        {
+            auto spriteBounds = Petit2D::Sprite::GetBounds(sprite);
+            bounds.left = std::min(bounds.left, spriteBounds.left);
+            bounds.top = std::min(bounds.top, spriteBounds.top);
+            bounds.right = std::max(bounds.right, spriteBounds.right);
+            bounds.bottom = std::max(bounds.bottom, spriteBounds.bottom);
+        }
+
+        return true;
+    }
 };
 
 struct PetitActor::Actor::VertexActor :
@@ -213,57 +424,1230 @@ public PetitActor::Actor::TypedActor<std::list<Petit2D::Shape::Vertex>, Petit2D:
 };
 
 //-----------------------------------------------------------------------------
-// [SECTION] Layer
+// [SECTION] Spatial
 //-----------------------------------------------------------------------------
 
-template <typename A>
-struct PetitActor::Layer::Layer
+// Sparse uniform grid: items are registered in every cell their bounds touch,
+// only cells holding something are allocated so the world can be any size.
+// Items covering too many cells are kept in a separate list tested by every
+// query instead.
+template <typename T>
+struct PetitActor::Spatial::Grid
 {
-    std::vector<A> actors = std::vector<A>();
+    Grid(float cellSize = 256.0f) :
+    cellSize(cellSize > 0.0f ? cellSize : 256.0f)
+    {
+    }
 
-    Layer()
+    virtual ~Grid()
     {
+        clear();
     }
 
-    virtual ~Layer()
+    int insert(T item, const Petit2D::Rect& bounds)
     {
-        actors.clear();
+        int id;
+        if (freeProxies.empty())
+        {
+            id = static_cast<int>(proxies.size());
+            proxies.push_back(Proxy());
+        }
+        else
+        {
+            id = freeProxies.back();
+            freeProxies.pop_back();
+        }
+
+        auto& proxy = proxies[id];
+        proxy.item = item;
+        proxy.used = true;
+        proxy.stamp = 0;
+        proxy.bounds = bounds;
+        getRange(bounds, proxy);
+        link(id);
+
+        return id;
     }
 
+    void update(int id, const Petit2D::Rect& bounds)
+    {
+        auto& proxy = proxies[id];
+        proxy.bounds = bounds;
 
-    virtual void update(float dt)
+        // Moving inside the same cells, the common case, touches nothing else.
+        Proxy range;
+        getRange(bounds, range);
+        if (range.x0 == proxy.x0 && range.y0 == proxy.y0 && range.x1 == proxy.x1 && range.y1 == proxy.y1 && range.large == proxy.large)
+        {
+            return;
+        }
+
+        unlink(id);
+        proxy.x0 = range.x0;
+        proxy.y0 = range.y0;
+        proxy.x1 = range.x1;
+        proxy.y1 = range.y1;
+        proxy.large = range.large;
+        link(id);
+    }
+
+    void remove(int id)
     {
-        for(const auto actor : actors)
+        unlink(id);
+        proxies[id] = Proxy();
+        freeProxies.push_back(id);
+    }
+
+    void clear()
+    {
+        cells.clear();
+        large.clear();
+        proxies.clear();
+        freeProxies.clear();
+    }
+
+    bool isValid(int id) const
+    {
+        return id >= 0 && id < static_cast<int>(proxies.size()) && proxies[id].used;
+    }
+
+    T get(int id) const
+    {
+        return proxies[id].item;
+    }
+
+    const Petit2D::Rect& getBounds(int id) const
+    {
+        return proxies[id].bounds;
+    }
+
+    int getCapacity() const
+    {
+        return static_cast<int>(proxies.size());
+    }
+
+    // Appends the items whose bounds overlap the rectangle, each item once.
+    void query(const Petit2D::Rect& rect, std::vector<T>& result)
+    {
+        visit(rect, [&](const Proxy& proxy)
         {
-            if (actor->isAlive)
+            return overlaps(proxy.bounds, rect);
+        }, result);
+    }
+
+    // Appends the items whose bounds overlap the circle.
+    void query(float x, float y, float radius, std::vector<T>& result)
+    {
+        Petit2D::Rect rect;
+        rect.left = x - radius;
+        rect.top = y - radius;
+        rect.right = x + radius;
+        rect.bottom = y + radius;
+
+        auto radiusSquared = radius * radius;
+        visit(rect, [&](const Proxy& proxy)
+        {
+            auto dx = x - std::max(proxy.bounds.left, std::min(x, proxy.bounds.right));
+            auto dy = y - std::max(proxy.bounds.top, std::min(y, proxy.bounds.bottom));
+            return dx * dx + dy * dy <= radiusSquared;
+        }, result);
+    }
+
+    // Appends the items whose bounds contain the point.
+    void query(float x, float y, std::vector<T>& result)
+    {
+        Petit2D::Rect rect;
+        rect.left = x;
+        rect.top = y;
+        rect.right = x;
+        rect.bottom = y;
+
+        query(rect, result);
+    }
+
+private:
+    static constexpr int    MAX_CELLS_PER_ITEM  = 64;
+    static constexpr float  MAX_CELL_INDEX      = 1073741824.0f;
+
+    struct Proxy
+    {
+        T               item    = T();
+        Petit2D::Rect   bounds;
+        int             x0      = 0;
+        int             y0      = 0;
+        int             x1      = -1;
+        int             y1      = -1;
+        unsigned int    stamp   = 0;
+        bool            large   = false;
+        bool            used    = false;
+    };
+
+    struct CellHash
+    {
+        std::size_t operator()(uint64_t key) const
+        {
+            key ^= key >> 33;
+            key *= 0xFF51AFD7ED558CCDull;
+            key ^= key >> 33;
+            return static_cast<std::size_t>(key);
+        }
+    };
+
+    float                                                       cellSize;
+    std::unordered_map<uint64_t, std::vector<int>, CellHash>    cells;
+    std::vector<int>                                            large;
+    std::vector<Proxy>                                          proxies;
+    std::vector<int>                                            freeProxies;
+    unsigned int                                                stamp = 0;
+
+    static uint64_t getKey(int x, int y)
+    {
+        return (static_cast<uint64_t>(static_cast<uint32_t>(x)) << 32) | static_cast<uint32_t>(y);
+    }
+
+    static bool overlaps(const Petit2D::Rect& a, const Petit2D::Rect& b)
+    {
+        return a.right >= b.left && a.left <= b.right && a.bottom >= b.top && a.top <= b.bottom;
+    }
+
+    int getCell(float value) const
+    {
+        auto cell = std::floor(value / cellSize);
+        cell = std::max(-MAX_CELL_INDEX, std::min(cell, MAX_CELL_INDEX));
+        return static_cast<int>(cell);
+    }
+
+    void getRange(const Petit2D::Rect& bounds, Proxy& range) const
+    {
+        range.x0 = getCell(bounds.left);
+        range.y0 = getCell(bounds.top);
+        range.x1 = getCell(bounds.right);
+        range.y1 = getCell(bounds.bottom);
+
+        auto width = static_cast<int64_t>(range.x1) - range.x0 + 1;
+        auto height = static_cast<int64_t>(range.y1) - range.y0 + 1;
+        range.large = width * height > MAX_CELLS_PER_ITEM;
+    }
+
+    void link(int id)
+    {
+        const auto& proxy = proxies[id];
+        if (proxy.large)
+        {
+            large.push_back(id);
+            return;
+        }
+
+        for (auto y=proxy.y0; y<=proxy.y1; ++y)
+        {
+            for (auto x=proxy.x0; x<=proxy.x1; ++x)
             {
-                actor->update(dt);
+                cells[getKey(x, y)].push_back(id);
             }
         }
     }
 
-    virtual void render()
+    static void erase(std::vector<int>& ids, int id)
     {
-        for(const auto actor : actors)
+        auto it = std::find(ids.begin(), ids.end(), id);
+        if (it != ids.end())
         {
-            if (actor->isVisible)
+            *it = ids.back();
+            ids.pop_back();
+        }
+    }
+
+    void unlink(int id)
+    {
+        const auto& proxy = proxies[id];
+        if (proxy.large)
+        {
+            erase(large, id);
+            return;
+        }
+
+        for (auto y=proxy.y0; y<=proxy.y1; ++y)
+        {
+            for (auto x=proxy.x0; x<=proxy.x1; ++x)
             {
-                actor->render();
+                auto cell = cells.find(getKey(x, y));
+                if (cell != cells.end())
+                {
+                    erase(cell->second, id);
+                    if (cell->second.empty())
+                    {
+                        cells.erase(cell);
+                    }
+                }
+            }
+        }
+    }
+
+    template <typename F>
+    void visit(const Petit2D::Rect& rect, F test, std::vector<T>& result)
+    {
+        // Stamps make an item spanning several cells come out once per query.
+        stamp += 1;
+        if (stamp == 0)
+        {
+            for (auto& proxy : proxies)
+            {
+                proxy.stamp = 0;
+            }
+            stamp = 1;
+        }
+
+        auto check = [&](int id)
+        {
+            auto& proxy = proxies[id];
+            if (proxy.stamp != stamp)
+            {
+                proxy.stamp = stamp;
+                if (test(proxy))
+                {
+                    result.push_back(proxy.item);
+                }
+            }
+        };
+
+        for (auto id : large)
+        {
+            check(id);
+        }
+
+        auto x0 = getCell(rect.left);
+        auto y0 = getCell(rect.top);
+        auto x1 = getCell(rect.right);
+        auto y1 = getCell(rect.bottom);
+        auto area = (static_cast<int64_t>(x1) - x0 + 1) * (static_cast<int64_t>(y1) - y0 + 1);
+
+        // A query wider than the populated part of the world walks the cells
+        // instead of the range.
+        if (area > static_cast<int64_t>(cells.size()))
+        {
+            for (const auto& cell : cells)
+            {
+                auto x = static_cast<int32_t>(static_cast<uint32_t>(cell.first >> 32));
+                auto y = static_cast<int32_t>(static_cast<uint32_t>(cell.first));
+                if (x >= x0 && x <= x1 && y >= y0 && y <= y1)
+                {
+                    for (auto id : cell.second)
+                    {
+                        check(id);
+                    }
+                }
+            }
+            return;
+        }
+
+        for (auto y=y0; y<=y1; ++y)
+        {
+            for (auto x=x0; x<=x1; ++x)
+            {
+                auto cell = cells.find(getKey(x, y));
+                if (cell != cells.end())
+                {
+                    for (auto id : cell->second)
+                    {
+                        check(id);
+                    }
+                }
             }
         }
     }
 };
 
-struct PetitActor::Layer::SpriteLayer :
-public PetitActor::Layer::Layer<PetitActor::Actor::Actor<Petit2D::Sprite::Sprite>*>
+//-----------------------------------------------------------------------------
+// [SECTION] Pool
+//-----------------------------------------------------------------------------
+
+struct PetitActor::Pool::Handle
 {
-    SpriteLayer() :
-    Layer()
+    int     id          = -1;
+    int     generation  = 0;
+};
+
+// Sprites of a pool split by field, one array each, so updates walk only the
+// fields they touch and render hands them to the Sprite::AddRange kernels as
+// they are.
+struct PetitActor::Pool::SpriteColumns
+{
+    std::vector<float>             x;
+    std::vector<float>             y;
+    std::vector<float>             s;
+    std::vector<float>             t;
+    std::vector<float>             p;
+    std::vector<float>             q;
+    std::vector<unsigned char>     r;
+    std::vector<unsigned char>     g;
+    std::vector<unsigned char>     b;
+    std::vector<unsigned char>     a;
+    std::vector<float>             scale_x;
+    std::vector<float>             scale_y;
+    std::vector<float>             rotation;
+    std::vector<int>               width;
+    std::vector<int>               height;
+    std::vector<int>               animation;
+    std::vector<float>             animation_start;
+    std::vector<float>             animation_rate;
+    std::vector<unsigned char>     outline_r;
+    std::vector<unsigned char>     outline_g;
+    std::vector<unsigned char>     outline_b;
+    std::vector<unsigned char>     outline_a;
+    std::vector<float>             outline;
+    std::vector<float>             smoothing;
+
+    template <typename F>
+    void each(F f)
     {
+        f(x);
+        f(y);
+        f(s);
+        f(t);
+        f(p);
+        f(q);
+        f(r);
+        f(g);
+        f(b);
+        f(a);
+        f(scale_x);
+        f(scale_y);
+        f(rotation);
+        f(width);
+        f(height);
+        f(animation);
+        f(animation_start);
+        f(animation_rate);
+        f(outline_r);
+        f(outline_g);
+        f(outline_b);
+        f(outline_a);
+        f(outline);
+        f(smoothing);
     }
 
-    virtual ~SpriteLayer()
+    void push(const Petit2D::Sprite::Sprite& sprite)
+    {
+        x.push_back(sprite.x);
+        y.push_back(sprite.y);
+        s.push_back(sprite.s);
+        t.push_back(sprite.t);
+        p.push_back(sprite.p);
+        q.push_back(sprite.q);
+        r.push_back(sprite.r);
+        g.push_back(sprite.g);
+        b.push_back(sprite.b);
+        a.push_back(sprite.a);
+        scale_x.push_back(sprite.scale_x);
+        scale_y.push_back(sprite.scale_y);
+        rotation.push_back(sprite.rotation);
+        width.push_back(sprite.width);
+        height.push_back(sprite.height);
+        animation.push_back(sprite.animation);
+        animation_start.push_back(sprite.animation_start);
+        animation_rate.push_back(sprite.animation_rate);
+        outline_r.push_back(sprite.outline_r);
+        outline_g.push_back(sprite.outline_g);
+        outline_b.push_back(sprite.outline_b);
+        outline_a.push_back(sprite.outline_a);
+        outline.push_back(sprite.outline);
+        smoothing.push_back(sprite.smoothing);
+    }
+
+    Petit2D::Sprite::Sprite get(int index) const
+    {
+        Petit2D::Sprite::Sprite sprite;
+        sprite.x = x[index];
+        sprite.y = y[index];
+        sprite.s = s[index];
+        sprite.t = t[index];
+        sprite.p = p[index];
+        sprite.q = q[index];
+        sprite.r = r[index];
+        sprite.g = g[index];
+        sprite.b = b[index];
+        sprite.a = a[index];
+        sprite.scale_x = scale_x[index];
+        sprite.scale_y = scale_y[index];
+        sprite.rotation = rotation[index];
+        sprite.width = width[index];
+        sprite.height = height[index];
+        sprite.animation = animation[index];
+        sprite.animation_start = animation_start[index];
+        sprite.animation_rate = animation_rate[index];
+        sprite.outline_r = outline_r[index];
+        sprite.outline_g = outline_g[index];
+        sprite.outline_b = outline_b[index];
+        sprite.outline_a = outline_a[index];
+        sprite.outline = outline[index];
+        sprite.smoothing = smoothing[index];
+        return sprite;
+    }
+
+    void set(int index, const Petit2D::Sprite::Sprite& sprite)
     {
+        x[index] = sprite.x;
+        y[index] = sprite.y;
+        s[index] = sprite.s;
+        t[index] = sprite.t;
+        p[index] = sprite.p;
+        q[index] = sprite.q;
+        r[index] = sprite.r;
+        g[index] = sprite.g;
+        b[index] = sprite.b;
+        a[index] = sprite.a;
+        scale_x[index] = sprite.scale_x;
+        scale_y[index] = sprite.scale_y;
+        rotation[index] = sprite.rotation;
+        width[index] = sprite.width;
+        height[index] = sprite.height;
+        animation[index] = sprite.animation;
+        animation_start[index] = sprite.animation_start;
+        animation_rate[index] = sprite.animation_rate;
+        outline_r[index] = sprite.outline_r;
+        outline_g[index] = sprite.outline_g;
+        outline_b[index] = sprite.outline_b;
+        outline_a[index] = sprite.outline_a;
+        outline[index] = sprite.outline;
+        smoothing[index] = sprite.smoothing;
+    }
+
+    void swap(int a, int b)
+    {
+        each([&](auto& column) { std::swap(column[a], column[b]); });
+    }
+
+    void pop()
+    {
+        each([](auto& column) { column.pop_back(); });
+    }
+
+    void clear()
+    {
+        each([](auto& column) { column.clear(); });
+    }
+
+    Petit2D::Sprite::SpriteArrays arrays() const
+    {
+        Petit2D::Sprite::SpriteArrays arrays;
+        arrays.x = x.data();
+        arrays.y = y.data();
+        arrays.s = s.data();
+        arrays.t = t.data();
+        arrays.p = p.data();
+        arrays.q = q.data();
+        arrays.r = r.data();
+        arrays.g = g.data();
+        arrays.b = b.data();
+        arrays.a = a.data();
+        arrays.scale_x = scale_x.data();
+        arrays.scale_y = scale_y.data();
+        arrays.rotation = rotation.data();
+        arrays.width = width.data();
+        arrays.height = height.data();
+        arrays.animation = animation.data();
+        arrays.animation_start = animation_start.data();
+        arrays.animation_rate = animation_rate.data();
+        arrays.outline_r = outline_r.data();
+        arrays.outline_g = outline_g.data();
+        arrays.outline_b = outline_b.data();
+        arrays.outline_a = outline_a.data();
+        arrays.outline = outline.data();
+        arrays.smoothing = smoothing.data();
+        return arrays;
+    }
+};
+
+// Dense storage for one actor type: the actor state in one array and its sprite
+// in SpriteColumns, the visible actors first. Handles go through a sparse array
+// so actors can move inside the dense arrays when others are removed.
+//
+// The actor type provides the update for all its instances at once:
+//
+//      static void update(PetitActor::Pool::Pool<T>& pool, float dt);
+//
+// walking actors() and the sprites() columns up to size(), and calling kill()
+// on the actors to remove once the update is over.
+template <typename T>
+struct PetitActor::Pool::Pool
+{
+    Pool()
+    {
+    }
+
+    virtual ~Pool()
+    {
+        clear();
+    }
+
+    Handle create(const T& actor, const Petit2D::Sprite::Sprite& sprite, bool visible = true)
+    {
+        Handle handle;
+        if (freeIds.empty())
+        {
+            handle.id = static_cast<int>(sparse.size());
+            sparse.push_back(-1);
+            generations.push_back(0);
+        }
+        else
+        {
+            handle.id = freeIds.back();
+            freeIds.pop_back();
+        }
+        handle.generation = generations[handle.id];
+
+        auto index = static_cast<int>(actorData.size());
+        actorData.push_back(actor);
+        spriteData.push(sprite);
+        ids.push_back(handle.id);
+        sparse[handle.id] = index;
+
+        if (visible)
+        {
+            swap(index, visibleCount);
+            visibleCount += 1;
+        }
+
+        return handle;
+    }
+
+    void destroy(Handle handle)
+    {
+        if (!isValid(handle))
+        {
+            return;
+        }
+
+        remove(sparse[handle.id]);
+    }
+
+    bool isValid(Handle handle) const
+    {
+        return handle.id >= 0 && handle.id < static_cast<int>(sparse.size()) &&
+               generations[handle.id] == handle.generation && sparse[handle.id] >= 0;
+    }
+
+    T& get(Handle handle)
+    {
+        return actorData[sparse[handle.id]];
+    }
+
+    Petit2D::Sprite::Sprite getSprite(Handle handle) const
+    {
+        return spriteData.get(sparse[handle.id]);
+    }
+
+    void setSprite(Handle handle, const Petit2D::Sprite::Sprite& sprite)
+    {
+        spriteData.set(sparse[handle.id], sprite);
+    }
+
+    bool isVisible(Handle handle) const
+    {
+        return sparse[handle.id] < visibleCount;
+    }
+
+    void setVisible(Handle handle, bool visible)
+    {
+        auto index = sparse[handle.id];
+        if (visible && index >= visibleCount)
+        {
+            swap(index, visibleCount);
+            visibleCount += 1;
+        }
+        else if (!visible && index < visibleCount)
+        {
+            visibleCount -= 1;
+            swap(index, visibleCount);
+        }
+    }
+
+    void clear()
+    {
+        for (auto id : ids)
+        {
+            sparse[id] = -1;
+            generations[id] += 1;
+            freeIds.push_back(id);
+        }
+
+        actorData.clear();
+        spriteData.clear();
+        ids.clear();
+        killed.clear();
+        visibleCount = 0;
+    }
+
+    // Dense arrays, valid until the next create, destroy or visibility change.
+    T* actors()
+    {
+        return actorData.data();
+    }
+
+    SpriteColumns& sprites()
+    {
+        return spriteData;
+    }
+
+    Handle getHandle(int index) const
+    {
+        Handle handle;
+        handle.id = ids[index];
+        handle.generation = generations[handle.id];
+        return handle;
+    }
+
+    int size() const
+    {
+        return static_cast<int>(actorData.size());
+    }
+
+    int getVisibleCount() const
+    {
+        return visibleCount;
+    }
+
+    // Marks the actor at a dense index for removal, safe to call while walking
+    // the arrays: removals happen in flush().
+    void kill(int index)
+    {
+        killed.push_back(ids[index]);
+    }
+
+    void flush()
+    {
+        for (auto id : killed)
+        {
+            if (sparse[id] >= 0)
+            {
+                remove(sparse[id]);
+            }
+        }
+        killed.clear();
+    }
+
+    void update(float dt)
+    {
+        if (!actorData.empty())
+        {
+            T::update(*this, dt);
+        }
+        flush();
+    }
+
+    void render()
+    {
+        Petit2D::Sprite::AddRange(spriteData.arrays(), visibleCount);
+    }
+
+    void render(const Petit2D::Rect& view)
+    {
+        for (auto i=0; i<visibleCount; ++i)
+        {
+            auto sprite = spriteData.get(i);
+            if (Petit2D::Sprite::IsVisible(sprite, view))
+            {
+                Petit2D::Sprite::Add(sprite);
+            }
+        }
+    }
+
+private:
+    std::vector<T>                          actorData;
+    SpriteColumns                           spriteData;
+    std::vector<int>                        ids;            // dense index to handle id
+    std::vector<int>                        sparse;         // handle id to dense index, -1 when free
+    std::vector<int>                        generations;
+    std::vector<int>                        freeIds;
+    std::vector<int>                        killed;
+    int                                     visibleCount = 0;
+
+    void swap(int a, int b)
+    {
+        if (a == b)
+        {
+            return;
+        }
+
+        std::swap(actorData[a], actorData[b]);
+        spriteData.swap(a, b);
+        std::swap(ids[a], ids[b]);
+        sparse[ids[a]] = a;
+        sparse[ids[b]] = b;
+    }
+
+    void remove(int index)
+    {
+        // Keep the visible actors packed: fill the hole from the end of the
+        // visible range, then that slot from the end of the arrays.
+        if (index < visibleCount)
+        {
+            visibleCount -= 1;
+            swap(index, visibleCount);
+            index = visibleCount;
+        }
+        swap(index, size() - 1);
+
+        auto id = ids.back();
+        sparse[id] = -1;
+        generations[id] += 1;
+        freeIds.push_back(id);
+
+        actorData.pop_back();
+        spriteData.pop();
+        ids.pop_back();
+    }
+};
+
+//-----------------------------------------------------------------------------
+// [SECTION] Layer
+//-----------------------------------------------------------------------------
+
+template <typename A>
+struct PetitActor::Layer::Layer
+{
+    std::vector<A> actors = std::vector<A>();
+
+    Layer()
+    {
+    }
+
+    virtual ~Layer()
+    {
+        actors.clear();
+    }
+
+
+    virtual void update(float dt)
+    {
+        for(const auto actor : actors)
+        {
+            if (actor->isAlive)
+            {
+                actor->update(dt);
+            }
+        }
+    }
+
+    // Same as update, with the actors split in chunks over the PetitTask
+    // threads. Actors must only touch their own state in update, and no GL
+    // call is allowed: rendering stays on the thread owning the context.
+    virtual void updateParallel(float dt, int grain = 256)
+    {
+        PetitTask::ParallelFor(static_cast<int>(actors.size()), grain, [this, dt](int begin, int end)
+        {
+            for (auto i=begin; i<end; ++i)
+            {
+                auto actor = actors[i];
+                if (actor->isAlive)
+                {
+                    actor->update(dt);
+                }
+            }
+        });
+    }
+
+    virtual void render()
+    {
+        for(const auto actor : actors)
+        {
+            if (actor->isVisible)
+            {
+                actor->render();
+            }
+        }
+    }
+    virtual void render(const Petit2D::Camera::Camera* camera)
+    {
+        auto view = Petit2D::Camera::GetView(camera);
+        for(const auto actor : actors)
+        {
+            if (actor->isVisible)
+            {
+                actor->render(view);
+            }
+        }
+    }
+};
+
+// Layer holding one Pool per actor type, updated and rendered type after type
+// with no virtual call and no per actor branch.
+template <typename... T>
+struct PetitActor::Layer::PoolLayer
+{
+    PoolLayer()
+    {
+    }
+
+    virtual ~PoolLayer()
+    {
+    }
+
+    template <typename A>
+    PetitActor::Pool::Pool<A>& getPool()
+    {
+        return std::get<PetitActor::Pool::Pool<A>>(pools);
+    }
+
+    template <typename A>
+    PetitActor::Pool::Handle create(const A& actor, const Petit2D::Sprite::Sprite& sprite, bool visible = true)
+    {
+        return getPool<A>().create(actor, sprite, visible);
+    }
+
+    template <typename A>
+    void destroy(PetitActor::Pool::Handle handle)
+    {
+        getPool<A>().destroy(handle);
+    }
+
+    virtual void update(float dt)
+    {
+        std::apply([dt](auto&... pool)
+        {
+            (pool.update(dt), ...);
+        }, pools);
+    }
+
+    virtual void render()
+    {
+        std::apply([](auto&... pool)
+        {
+            (pool.render(), ...);
+        }, pools);
+    }
+
+    virtual void render(const Petit2D::Camera::Camera* camera)
+    {
+        auto view = Petit2D::Camera::GetView(camera);
+        std::apply([&view](auto&... pool)
+        {
+            (pool.render(view), ...);
+        }, pools);
+    }
+
+    void clear()
+    {
+        std::apply([](auto&... pool)
+        {
+            (pool.clear(), ...);
+        }, pools);
+    }
+
+protected:
+    std::tuple<PetitActor::Pool::Pool<T>...> pools;
+};
+
+// Orders the update of several layers: stages update one after the other, the
+// layers of a stage update at the same time on the PetitTask threads, so they
+// must not depend on each other. Rendering goes through the layers on the
+// calling thread, stage after stage, in the order they were added.
+struct PetitActor::Layer::Schedule
+{
+    Schedule()
+    {
+    }
+
+    virtual ~Schedule()
+    {
+        stages.clear();
+    }
+
+    template <typename L>
+    void add(L* layer, int stage = 0, bool parallel = false)
+    {
+        if (stage < 0)
+        {
+            return;
+        }
+
+        if (stage >= static_cast<int>(stages.size()))
+        {
+            stages.resize(stage + 1);
+        }
+
+        Entry entry;
+        entry.update = [layer, parallel](float dt)
+        {
+            updateLayer(layer, dt, parallel);
+        };
+        entry.render = [layer]()
+        {
+            layer->render();
+        };
+        entry.renderCamera = [layer](const Petit2D::Camera::Camera* camera)
+        {
+            layer->render(camera);
+        };
+        stages[stage].push_back(entry);
+    }
+
+    void update(float dt)
+    {
+        auto group = PetitTask::CreateGroup();
+        for (auto& stage : stages)
+        {
+            for (auto i=1; i<static_cast<int>(stage.size()); ++i)
+            {
+                auto& entry = stage[i];
+                PetitTask::Run(group, [&entry, dt]()
+                {
+                    entry.update(dt);
+                });
+            }
+
+            if (!stage.empty())
+            {
+                stage[0].update(dt);
+            }
+            PetitTask::Wait(group);
+        }
+        PetitTask::DestroyGroup(group);
+    }
+
+    void render()
+    {
+        for (auto& stage : stages)
+        {
+            for (auto& entry : stage)
+            {
+                entry.render();
+            }
+        }
+    }
+
+    void render(const Petit2D::Camera::Camera* camera)
+    {
+        for (auto& stage : stages)
+        {
+            for (auto& entry : stage)
+            {
+                entry.renderCamera(camera);
+            }
+        }
+    }
+
+private:
+    struct Entry
+    {
+        std::function<void(float)>                          update;
+        std::function<void()>                               render;
+        std::function<void(const Petit2D::Camera::Camera*)> renderCamera;
+    };
+
+    std::vector<std::vector<Entry>> stages;
+
+    template <typename L>
+    static auto updateLayer(L* layer, float dt, bool parallel) -> decltype(layer->updateParallel(dt), void())
+    {
+        if (parallel)
+        {
+            layer->updateParallel(dt);
+        }
+        else
+        {
+            layer->update(dt);
+        }
+    }
+
+    template <typename L, typename... Unused>
+    static void updateLayer(L* layer, float dt, bool, Unused...)
+    {
+        layer->update(dt);
+    }
+};
+
+// Keeps a spatial index of its actors next to the list. The index follows the
+// actors on update(), call refresh() after moving, adding or removing actors
+// outside of it. An actor belongs to a single SpriteLayer at a time.
+struct PetitActor::Layer::SpriteLayer :
+public PetitActor::Layer::Layer<PetitActor::Actor::Actor<Petit2D::Sprite::Sprite>*>
+{
+    using SpriteActor = PetitActor::Actor::Actor<Petit2D::Sprite::Sprite>;
+
+    SpriteLayer(float cellSize = 256.0f) :
+    Layer(),
+    grid(cellSize)
+    {
+    }
+
+    virtual ~SpriteLayer()
+    {
+        for (auto recorder : recorders)
+        {
+            Petit2D::Sprite::DestroyRecorder(recorder);
+        }
+        recorders.clear();
+    }
+
+    using Layer::render;
+
+    virtual void update(float dt) override
+    {
+        Layer::update(dt);
+        refresh();
+    }
+
+    virtual void updateParallel(float dt, int grain = 256) override
+    {
+        Layer::updateParallel(dt, grain);
+        refresh();
+    }
+
+    void refresh()
+    {
+        order.resize(grid.getCapacity());
+        std::fill(order.begin(), order.end(), -1);
+
+        Petit2D::Rect bounds;
+        for (auto i=0; i<static_cast<int>(actors.size()); ++i)
+        {
+            auto actor = actors[i];
+            if (!actor->getBounds(bounds))
+            {
+                bounds.left = -FLT_MAX;
+                bounds.top = -FLT_MAX;
+                bounds.right = FLT_MAX;
+                bounds.bottom = FLT_MAX;
+            }
+
+            if (grid.isValid(actor->proxy) && grid.get(actor->proxy) == actor)
+            {
+                grid.update(actor->proxy, bounds);
+            }
+            else
+            {
+                actor->proxy = grid.insert(actor, bounds);
+                if (actor->proxy >= static_cast<int>(order.size()))
+                {
+                    order.resize(actor->proxy + 1, -1);
+                }
+            }
+
+            order[actor->proxy] = i;
+        }
+
+        // Entries no actor claimed this time were removed from the layer.
+        for (auto id=0; id<static_cast<int>(order.size()); ++id)
+        {
+            if (order[id] < 0 && grid.isValid(id))
+            {
+                grid.remove(id);
+            }
+        }
+    }
+
+    // Only the actors overlapping the camera view are rendered, in layer order.
+    virtual void render(const Petit2D::Camera::Camera* camera) override
+    {
+        auto view = Petit2D::Camera::GetView(camera);
+        collect(view);
+
+        for (auto actor : visible)
+        {
+            if (actor->isVisible)
+            {
+                actor->render(view);
+            }
+        }
+    }
+
+    // Same as render, with the actors recording their sprites on the PetitTask
+    // threads. Chunks are submitted in order, so the result matches render.
+    // Actors must only add sprites or use sprite batches from render, batch
+    // uploads and draws happen at submit.
+    void renderParallel(int grain = 256)
+    {
+        record(actors, nullptr, grain);
+    }
+
+    void renderParallel(const Petit2D::Camera::Camera* camera, int grain = 256)
+    {
+        auto view = Petit2D::Camera::GetView(camera);
+        collect(view);
+        record(visible, &view, grain);
+    }
+
+    void query(const Petit2D::Rect& rect, std::vector<SpriteActor*>& result)
+    {
+        grid.query(rect, result);
+    }
+
+    void query(float x, float y, float radius, std::vector<SpriteActor*>& result)
+    {
+        grid.query(x, y, radius, result);
+    }
+
+    void query(float x, float y, std::vector<SpriteActor*>& result)
+    {
+        grid.query(x, y, result);
+    }
+
+protected:
+    PetitActor::Spatial::Grid<SpriteActor*> grid;
+    std::vector<int>                        order;
+    std::vector<SpriteActor*>               visible;
+    std::vector<Petit2D::Sprite::Recorder*> recorders;
+
+    void collect(const Petit2D::Rect& view)
+    {
+        visible.clear();
+        grid.query(view, visible);
+        std::sort(visible.begin(), visible.end(), [&](const SpriteActor* a, const SpriteActor* b)
+        {
+            return order[a->proxy] < order[b->proxy];
+        });
+    }
+
+    void record(const std::vector<SpriteActor*>& list, const Petit2D::Rect* view, int grain)
+    {
+        if (grain < 1)
+        {
+            grain = 1;
+        }
+
+        // Fixed chunks, one recorder each, so the submit order does not depend
+        // on which thread ran what.
+        auto count = static_cast<int>(list.size());
+        auto chunkCount = (count + grain - 1) / grain;
+        while (static_cast<int>(recorders.size()) < chunkCount)
+        {
+            recorders.push_back(Petit2D::Sprite::CreateRecorder());
+        }
+
+        PetitTask::ParallelFor(chunkCount, 1, [&](int begin, int end)
+        {
+            for (auto chunk=begin; chunk<end; ++chunk)
+            {
+                auto recorder = recorders[chunk];
+                Petit2D::Sprite::Clear(recorder);
+                Petit2D::Sprite::SetRecorder(recorder);
+
+                auto last = std::min(count, (chunk + 1) * grain);
+                for (auto i=chunk * grain; i<last; ++i)
+                {
+                    auto actor = list[i];
+                    if (actor->isVisible)
+                    {
+                        if (view != nullptr)
+                        {
+                            actor->render(*view);
+                        }
+                        else
+                        {
+                            actor->render();
+                        }
+                    }
+                }
+
+                Petit2D::Sprite::SetRecorder(nullptr);
+            }
+        });
+
+        for (auto chunk=0; chunk<chunkCount; ++chunk)
+        {
+            Petit2D::Sprite::Submit(recorders[chunk]);
+        }
     }
 };
 
@@ -0,0 +1,483 @@
+#include "petitanim.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+
+#ifdef _DEBUG
+#  include <cstdio>
+#  define DEBUG(...) printf(__VA_ARGS__)
+#else
+#  define DEBUG(...)
+#endif
+
+namespace PetitAnim
+{
+
+//-----------------------------------------------------------------------------
+// [SECTION] Clip
+//-----------------------------------------------------------------------------
+
+namespace Clip
+{
+
+//-----------------------------------------------------------------------------
+// [SECTION] Clip - Forward declarations and basic types
+//-----------------------------------------------------------------------------
+
+// PETCLP v1. Sections are 16 bytes aligned so a mapped file is used in place:
+// the track table, then every key time of every track, then the key values,
+// GetComponents(type) floats per key.
+struct FileHeader
+{
+    char        signature[6]    = { 'P', 'E', 'T', 'C', 'L', 'P' };
+    uint16_t    version         = 1;
+    float       duration        = 0.0f;
+    uint32_t    trackCount      = 0;
+    uint32_t    keyCount        = 0;
+    uint32_t    valueCount      = 0;
+    uint32_t    tracksOffset    = 0;
+    uint32_t    timesOffset     = 0;
+    uint32_t    valuesOffset    = 0;
+};
+
+struct Track
+{
+    uint16_t    type            = 0;
+    uint16_t    interpolation   = 0;
+    uint32_t    keyCount        = 0;
+    uint32_t    firstKey        = 0;
+    uint32_t    firstValue      = 0;
+};
+
+struct Clip
+{
+    float           duration    = 0.0f;
+    uint32_t        trackCount  = 0;
+    uint32_t        keyCount    = 0;
+    uint32_t        valueCount  = 0;
+
+    // Views either into the mapped file, memory given to Init, or the owned
+    // vectors when the clip is built with AddTrack.
+    const Track*    tracks      = nullptr;
+    const float*    times       = nullptr;
+    const float*    values      = nullptr;
+
+    Petit2D::File::File*    file    = nullptr;
+    std::vector<Track>      ownedTracks;
+    std::vector<float>      ownedTimes;
+    std::vector<float>      ownedValues;
+};
+
+//-----------------------------------------------------------------------------
+// [SECTION] Clip - Private functions
+//-----------------------------------------------------------------------------
+
+void clear(Clip* clip)
+{
+    Petit2D::File::Unmap(clip->file);
+    clip->file = nullptr;
+    clip->ownedTracks.clear();
+    clip->ownedTimes.clear();
+    clip->ownedValues.clear();
+    clip->tracks = nullptr;
+    clip->times = nullptr;
+    clip->values = nullptr;
+    clip->duration = 0.0f;
+    clip->trackCount = 0;
+    clip->keyCount = 0;
+    clip->valueCount = 0;
+}
+
+void bindOwned(Clip* clip)
+{
+    clip->tracks = clip->ownedTracks.data();
+    clip->times = clip->ownedTimes.data();
+    clip->values = clip->ownedValues.data();
+    clip->trackCount = static_cast<uint32_t>(clip->ownedTracks.size());
+    clip->keyCount = static_cast<uint32_t>(clip->ownedTimes.size());
+    clip->valueCount = static_cast<uint32_t>(clip->ownedValues.size());
+}
+
+bool initInPlace(Clip* clip, const unsigned char* data, size_t size)
+{
+    if (size < sizeof(FileHeader) || memcmp(data, "PETCLP", 6) != 0)
+    {
+        DEBUG("PETCLP signature not present.\n");
+        return false;
+    }
+
+    FileHeader header;
+    memcpy(&header, data, sizeof(FileHeader));
+    if (header.version != 1)
+    {
+        DEBUG("Unsupported PETCLP version %u.\n", header.version);
+        return false;
+    }
+
+    auto fits = [size](uint32_t offset, size_t length)
+    {
+        return (offset % 16) == 0 && offset <= size && length <= size - offset;
+    };
+
+    if (!fits(header.tracksOffset, static_cast<size_t>(header.trackCount) * sizeof(Track))
+    || !fits(header.timesOffset, static_cast<size_t>(header.keyCount) * sizeof(float))
+    || !fits(header.valuesOffset, static_cast<size_t>(header.valueCount) * sizeof(float))
+    || reinterpret_cast<uintptr_t>(data) % 4 != 0)
+    {
+        DEBUG("Corrupted PETCLP header.\n");
+        return false;
+    }
+
+    // Check every track once here so sampling never has to.
+    auto tracks = reinterpret_cast<const Track*>(data + header.tracksOffset);
+    for (uint32_t i=0; i<header.trackCount; ++i)
+    {
+        const auto& track = tracks[i];
+        auto components = GetComponents(static_cast<TrackType>(track.type));
+        if (components == 0 || track.keyCount == 0
+        || track.firstKey > header.keyCount || track.keyCount > header.keyCount - track.firstKey
+        || track.firstValue > header.valueCount
+        || static_cast<uint64_t>(track.keyCount) * components > header.valueCount - track.firstValue)
+        {
+            DEBUG("Corrupted PETCLP track %u.\n", i);
+            return false;
+        }
+    }
+
+    clip->duration = header.duration;
+    clip->trackCount = header.trackCount;
+    clip->keyCount = header.keyCount;
+    clip->valueCount = header.valueCount;
+    clip->tracks = tracks;
+    clip->times = reinterpret_cast<const float*>(data + header.timesOffset);
+    clip->values = reinterpret_cast<const float*>(data + header.valuesOffset);
+    return true;
+}
+
+// Index of the key starting the segment holding time, -1 before the first key.
+int findKey(const float* times, int keyCount, int cursor, float time)
+{
+    if (cursor < 0 || cursor >= keyCount)
+    {
+        cursor = 0;
+    }
+
+    // Forward playback: the cursor key or one of the next couple.
+    if (times[cursor] <= time)
+    {
+        for (auto step=0; step<4; ++step)
+        {
+            if (cursor + 1 >= keyCount || time < times[cursor + 1])
+            {
+                return cursor;
+            }
+            cursor += 1;
+        }
+    }
+
+    // Seek or loop: binary search for the last key not after time.
+    auto low = 0;
+    auto high = keyCount;
+    while (low < high)
+    {
+        auto middle = (low + high) / 2;
+        if (times[middle] <= time)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    return low - 1;
+}
+
+//-----------------------------------------------------------------------------
+// [SECTION] Clip - End-user API functions
+//-----------------------------------------------------------------------------
+
+Clip* Create()
+{
+    return new Clip();
+}
+
+void Destroy(Clip* clip)
+{
+    if (clip != nullptr)
+    {
+        clear(clip);
+        delete(clip);
+        clip = nullptr;
+    }
+}
+
+void Init(Clip* clip, const char* filename)
+{
+    clear(clip);
+    clip->file = Petit2D::File::Map(filename);
+    if (clip->file == nullptr)
+    {
+        DEBUG("Clip not found %s\n", filename);
+        return;
+    }
+
+    // Used in place, the mapping lives as long as the clip.
+    auto data = static_cast<const unsigned char*>(Petit2D::File::GetData(clip->file));
+    if (!initInPlace(clip, data, Petit2D::File::GetSize(clip->file)))
+    {
+        clear(clip);
+    }
+}
+
+void Init(Clip* clip, const void* data, size_t size)
+{
+    clear(clip);
+    if (!initInPlace(clip, static_cast<const unsigned char*>(data), size))
+    {
+        clear(clip);
+    }
+}
+
+void Save(const Clip* clip, const char* filename)
+{
+    auto align = [](size_t offset) { return (offset + 15) & ~size_t(15); };
+
+    FileHeader header;
+    header.duration = clip->duration;
+    header.trackCount = clip->trackCount;
+    header.keyCount = clip->keyCount;
+    header.valueCount = clip->valueCount;
+    header.tracksOffset = static_cast<uint32_t>(align(sizeof(FileHeader)));
+    header.timesOffset = static_cast<uint32_t>(align(header.tracksOffset + clip->trackCount * sizeof(Track)));
+    header.valuesOffset = static_cast<uint32_t>(align(header.timesOffset + clip->keyCount * sizeof(float)));
+
+    auto file = std::ofstream(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!file.is_open())
+    {
+        DEBUG("Could not write clip %s\n", filename);
+        return;
+    }
+
+    const char padding[16] = { 0 };
+    auto write = [&file, &padding](const void* data, size_t size, size_t offset)
+    {
+        auto position = static_cast<size_t>(file.tellp());
+        file.write(padding, offset - position);
+        file.write(reinterpret_cast<const char*>(data), size);
+    };
+
+    write(&header, sizeof(FileHeader), 0);
+    write(clip->tracks, clip->trackCount * sizeof(Track), header.tracksOffset);
+    write(clip->times, clip->keyCount * sizeof(float), header.timesOffset);
+    write(clip->values, clip->valueCount * sizeof(float), header.valuesOffset);
+
+    file.close();
+}
+
+int AddTrack(Clip* clip, TrackType type, Interpolation interpolation, const float* times, const float* values, int keyCount)
+{
+    auto components = GetComponents(type);
+    if (components == 0 || keyCount <= 0)
+    {
+        DEBUG("Invalid clip track, type %d with %d keys\n", type, keyCount);
+        return -1;
+    }
+
+    for (auto i=1; i<keyCount; ++i)
+    {
+        if (times[i] < times[i - 1])
+        {
+            DEBUG("Clip track keys must be sorted by time\n");
+            return -1;
+        }
+    }
+
+    // A clip built in code, or loaded then extended, moves to owned storage.
+    if (clip->tracks != clip->ownedTracks.data() || clip->file != nullptr)
+    {
+        clip->ownedTracks.assign(clip->tracks, clip->tracks + clip->trackCount);
+        clip->ownedTimes.assign(clip->times, clip->times + clip->keyCount);
+        clip->ownedValues.assign(clip->values, clip->values + clip->valueCount);
+        Petit2D::File::Unmap(clip->file);
+        clip->file = nullptr;
+    }
+
+    Track track;
+    track.type = static_cast<uint16_t>(type);
+    track.interpolation = static_cast<uint16_t>(type == TrackType::FRAME ? Interpolation::STEP : interpolation);
+    track.keyCount = static_cast<uint32_t>(keyCount);
+    track.firstKey = static_cast<uint32_t>(clip->ownedTimes.size());
+    track.firstValue = static_cast<uint32_t>(clip->ownedValues.size());
+
+    clip->ownedTracks.push_back(track);
+    clip->ownedTimes.insert(clip->ownedTimes.end(), times, times + keyCount);
+    clip->ownedValues.insert(clip->ownedValues.end(), values, values + keyCount * components);
+    bindOwned(clip);
+
+    if (clip->duration < times[keyCount - 1])
+    {
+        clip->duration = times[keyCount - 1];
+    }
+
+    return static_cast<int>(clip->trackCount) - 1;
+}
+
+float GetDuration(const Clip* clip)
+{
+    return clip->duration;
+}
+
+int GetTrackCount(const Clip* clip)
+{
+    return static_cast<int>(clip->trackCount);
+}
+
+int FindTrack(const Clip* clip, TrackType type)
+{
+    for (uint32_t i=0; i<clip->trackCount; ++i)
+    {
+        if (clip->tracks[i].type == type)
+        {
+            return static_cast<int>(i);
+        }
+    }
+
+    return -1;
+}
+
+int GetComponents(TrackType type)
+{
+    switch (type)
+    {
+    case TrackType::POSITION:   return 2;
+    case TrackType::ROTATION:   return 1;
+    case TrackType::SCALE:      return 2;
+    case TrackType::COLOR:      return 4;
+    case TrackType::FRAME:      return 6;
+    default:                    return 0;
+    }
+}
+
+void Update(const Clip* clip, Player& player, float dt)
+{
+    player.time += dt * player.speed;
+    if (clip->duration <= 0.0f)
+    {
+        player.time = 0.0f;
+    }
+    else if (player.loop)
+    {
+        player.time = fmodf(player.time, clip->duration);
+        if (player.time < 0.0f)
+        {
+            player.time += clip->duration;
+        }
+    }
+    else if (player.time > clip->duration)
+    {
+        player.time = clip->duration;
+    }
+    else if (player.time < 0.0f)
+    {
+        player.time = 0.0f;
+    }
+}
+
+void Sample(const Clip* clip, Player& player, int index, float* values)
+{
+    if (index < 0 || index >= static_cast<int>(clip->trackCount))
+    {
+        DEBUG("Invalid clip track: %d\n", index);
+        return;
+    }
+
+    const auto& track = clip->tracks[index];
+    auto components = GetComponents(static_cast<TrackType>(track.type));
+    auto times = clip->times + track.firstKey;
+    auto keys = clip->values + track.firstValue;
+    auto keyCount = static_cast<int>(track.keyCount);
+
+    auto cursor = index < Player::MAX_TRACKS ? player.cursors[index] : 0;
+    auto key = findKey(times, keyCount, cursor, player.time);
+    if (index < Player::MAX_TRACKS)
+    {
+        player.cursors[index] = key < 0 ? 0 : key;
+    }
+
+    // Before the first key or after the last one, hold the value.
+    if (key < 0 || key + 1 >= keyCount)
+    {
+        auto source = keys + (key < 0 ? 0 : key) * components;
+        memcpy(values, source, components * sizeof(float));
+        return;
+    }
+
+    auto from = keys + key * components;
+    if (track.interpolation == Interpolation::STEP)
+    {
+        memcpy(values, from, components * sizeof(float));
+        return;
+    }
+
+    auto to = from + components;
+    auto span = times[key + 1] - times[key];
+    auto t = span > 0.0f ? (player.time - times[key]) / span : 1.0f;
+    for (auto i=0; i<components; ++i)
+    {
+        values[i] = from[i] + (to[i] - from[i]) * t;
+    }
+}
+
+void Apply(const Clip* clip, Player& player, Petit2D::Sprite::Sprite& sprite)
+{
+    auto toByte = [](float value)
+    {
+        return static_cast<unsigned char>(value < 0.0f ? 0.0f : value > 255.0f ? 255.0f : value + 0.5f);
+    };
+
+    float values[6];
+    for (uint32_t i=0; i<clip->trackCount; ++i)
+    {
+        Sample(clip, player, static_cast<int>(i), values);
+        switch (clip->tracks[i].type)
+        {
+        case TrackType::POSITION:
+            sprite.x = values[0];
+            sprite.y = values[1];
+        break;
+
+        case TrackType::ROTATION:
+            sprite.rotation = values[0];
+        break;
+
+        case TrackType::SCALE:
+            sprite.scale_x = values[0];
+            sprite.scale_y = values[1];
+        break;
+
+        case TrackType::COLOR:
+            sprite.r = toByte(values[0]);
+            sprite.g = toByte(values[1]);
+            sprite.b = toByte(values[2]);
+            sprite.a = toByte(values[3]);
+        break;
+
+        case TrackType::FRAME:
+            sprite.s = values[0];
+            sprite.t = values[1];
+            sprite.p = values[2];
+            sprite.q = values[3];
+            sprite.width = static_cast<int>(values[4]);
+            sprite.height = static_cast<int>(values[5]);
+        break;
+        }
+    }
+}
+
+} // namespace Clip
+
+} // namespace PetitAnim
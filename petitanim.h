@@ -1,5 +1,15 @@
 #pragma once
 
+#include "petit2d.h"
+
+#include <vector>
+#include <cstddef>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  include <emmintrin.h>
+#  define PETITANIM_SSE2
+#endif
+
 namespace PetitAnim
 {
 
@@ -21,6 +31,61 @@ namespace Anim
 
 } // namespace Anim
 
+//-----------------------------------------------------------------------------
+// [SECTION] Tween
+//-----------------------------------------------------------------------------
+
+namespace Tween
+{
+
+    //-----------------------------------------------------------------------------
+    // [SECTION] Tween - Forward declarations and basic types
+    //-----------------------------------------------------------------------------
+
+    struct                  Handle;
+    struct                  Engine;
+
+    enum                    Easing          : int;
+
+} // namespace Tween
+
+//-----------------------------------------------------------------------------
+// [SECTION] Clip
+//-----------------------------------------------------------------------------
+
+namespace Clip
+{
+
+    //-----------------------------------------------------------------------------
+    // [SECTION] Clip - Forward declarations and basic types
+    //-----------------------------------------------------------------------------
+
+    struct          Clip;
+    struct          Player;
+
+    enum            TrackType       : int;
+    enum            Interpolation   : int;
+
+    //-----------------------------------------------------------------------------
+    // [SECTION] Clip - End-user API functions
+    //-----------------------------------------------------------------------------
+
+    Clip*           Create          ();
+    void            Destroy         (Clip* clip);
+    void            Init            (Clip* clip, const char* filename);
+    void            Init            (Clip* clip, const void* data, std::size_t size);
+    void            Save            (const Clip* clip, const char* filename);
+    int             AddTrack        (Clip* clip, TrackType type, Interpolation interpolation, const float* times, const float* values, int keyCount);
+    float           GetDuration     (const Clip* clip);
+    int             GetTrackCount   (const Clip* clip);
+    int             FindTrack       (const Clip* clip, TrackType type);
+    int             GetComponents   (TrackType type);
+    void            Update          (const Clip* clip, Player& player, float dt);
+    void            Sample          (const Clip* clip, Player& player, int track, float* values);
+    void            Apply           (const Clip* clip, Player& player, Petit2D::Sprite::Sprite& sprite);
+
+} // namespace Clip
+
 } // namespace PetitAnim
 
 //-----------------------------------------------------------------------------
@@ -170,3 +235,321 @@ PetitAnim::Anim::Animation<float>
 	    return -this->endValue * t * (t - 2) + this->startValue;
     }
 };
+
+//-----------------------------------------------------------------------------
+// [SECTION] Tween - Public declarations and basic types
+//-----------------------------------------------------------------------------
+
+enum PetitAnim::Tween::Easing : int
+{
+    LINEAR              = 0,
+    EASE_IN             = 1,
+    EASE_OUT            = 2,
+    EASE_IN_OUT         = 3,
+    EASING_COUNT        = 4
+};
+
+struct PetitAnim::Tween::Handle
+{
+    int     id          = -1;
+    int     generation  = 0;
+};
+
+// Float tweens writing straight into their target. Tweens are stored by easing
+// in contiguous arrays, so update() runs one branch free SIMD pass per easing
+// and moves the finished tweens out of the active arrays. Targets must outlive
+// their tween or be cancelled first.
+struct PetitAnim::Tween::Engine
+{
+    Engine()
+    {
+    }
+
+    virtual ~Engine()
+    {
+        clear();
+    }
+
+    // A positive delay holds the start value back for that long first.
+    Handle add(float* target, float startValue, float endValue, float duration, Easing easing = Easing::LINEAR, float delay = 0.0f)
+    {
+        if (easing < 0 || easing >= Easing::EASING_COUNT)
+        {
+            easing = Easing::LINEAR;
+        }
+
+        Handle handle;
+        if (freeIds.empty())
+        {
+            handle.id = static_cast<int>(locations.size());
+            locations.push_back(Location());
+            generations.push_back(0);
+        }
+        else
+        {
+            handle.id = freeIds.back();
+            freeIds.pop_back();
+        }
+        handle.generation = generations[handle.id];
+
+        auto& tweens = buckets[easing];
+        locations[handle.id].easing = easing;
+        locations[handle.id].index = static_cast<int>(tweens.ids.size());
+
+        tweens.start.push_back(startValue);
+        tweens.delta.push_back(endValue - startValue);
+        tweens.end.push_back(endValue);
+        tweens.time.push_back(-delay);
+        tweens.inverseDuration.push_back(duration > 0.0f ? 1.0f / duration : 0.0f);
+        tweens.value.push_back(startValue);
+        tweens.targets.push_back(target);
+        tweens.ids.push_back(handle.id);
+
+        *target = startValue;
+        return handle;
+    }
+
+    void cancel(Handle handle)
+    {
+        if (isActive(handle))
+        {
+            const auto& location = locations[handle.id];
+            remove(buckets[location.easing], location.index);
+        }
+    }
+
+    bool isActive(Handle handle) const
+    {
+        return handle.id >= 0 && handle.id < static_cast<int>(locations.size()) &&
+               generations[handle.id] == handle.generation && locations[handle.id].index >= 0;
+    }
+
+    int getCount() const
+    {
+        auto count = 0;
+        for (const auto& tweens : buckets)
+        {
+            count += static_cast<int>(tweens.ids.size());
+        }
+        return count;
+    }
+
+    void clear()
+    {
+        for (auto& tweens : buckets)
+        {
+            while (!tweens.ids.empty())
+            {
+                remove(tweens, static_cast<int>(tweens.ids.size()) - 1);
+            }
+        }
+    }
+
+    void update(float dt)
+    {
+        advance<Easing::LINEAR>(buckets[Easing::LINEAR], dt);
+        advance<Easing::EASE_IN>(buckets[Easing::EASE_IN], dt);
+        advance<Easing::EASE_OUT>(buckets[Easing::EASE_OUT], dt);
+        advance<Easing::EASE_IN_OUT>(buckets[Easing::EASE_IN_OUT], dt);
+    }
+
+    template <int E>
+    static float ease(float t)
+    {
+        switch (E)
+        {
+        case Easing::EASE_IN:       return t * t;
+        case Easing::EASE_OUT:      return t * (2.0f - t);
+        case Easing::EASE_IN_OUT:   return t < 0.5f ? 2.0f * t * t : t * (4.0f - 2.0f * t) - 1.0f;
+        default:
+        case Easing::LINEAR:        return t;
+        }
+    }
+
+private:
+    struct Tweens
+    {
+        std::vector<float>      start;
+        std::vector<float>      delta;
+        std::vector<float>      end;
+        std::vector<float>      time;
+        std::vector<float>      inverseDuration;
+        std::vector<float>      value;
+        std::vector<float*>     targets;
+        std::vector<int>        ids;
+        std::vector<int>        finished;
+    };
+
+    struct Location
+    {
+        int     easing  = 0;
+        int     index   = -1;
+    };
+
+    Tweens                  buckets[Easing::EASING_COUNT];
+    std::vector<Location>   locations;
+    std::vector<int>        generations;
+    std::vector<int>        freeIds;
+
+#if defined(PETITANIM_SSE2)
+    template <int E>
+    static __m128 ease(__m128 t)
+    {
+        switch (E)
+        {
+        case Easing::EASE_IN:
+            return _mm_mul_ps(t, t);
+        case Easing::EASE_OUT:
+            return _mm_mul_ps(t, _mm_sub_ps(_mm_set1_ps(2.0f), t));
+        case Easing::EASE_IN_OUT:
+        {
+            auto in = _mm_mul_ps(_mm_set1_ps(2.0f), _mm_mul_ps(t, t));
+            auto out = _mm_sub_ps(_mm_mul_ps(t, _mm_sub_ps(_mm_set1_ps(4.0f), _mm_add_ps(t, t))), _mm_set1_ps(1.0f));
+            auto mask = _mm_cmplt_ps(t, _mm_set1_ps(0.5f));
+            return _mm_or_ps(_mm_and_ps(mask, in), _mm_andnot_ps(mask, out));
+        }
+        default:
+        case Easing::LINEAR:
+            return t;
+        }
+    }
+#endif
+
+    template <int E>
+    void advance(Tweens& tweens, float dt)
+    {
+        auto count = static_cast<int>(tweens.ids.size());
+        if (count == 0)
+        {
+            return;
+        }
+
+        auto start = tweens.start.data();
+        auto delta = tweens.delta.data();
+        auto time = tweens.time.data();
+        auto inverseDuration = tweens.inverseDuration.data();
+        auto value = tweens.value.data();
+        tweens.finished.clear();
+
+        auto i = 0;
+#if defined(PETITANIM_SSE2)
+        auto step = _mm_set1_ps(dt);
+        auto zero = _mm_setzero_ps();
+        auto one = _mm_set1_ps(1.0f);
+        for (; i + 4 <= count; i += 4)
+        {
+            auto current = _mm_add_ps(_mm_loadu_ps(time + i), step);
+            _mm_storeu_ps(time + i, current);
+
+            // A zero inverse duration means an instant tween: it is done.
+            auto inverse = _mm_loadu_ps(inverseDuration + i);
+            auto t = _mm_mul_ps(current, inverse);
+            auto instant = _mm_and_ps(_mm_cmpeq_ps(inverse, zero), _mm_cmpge_ps(current, zero));
+            t = _mm_or_ps(_mm_min_ps(_mm_max_ps(t, zero), one), _mm_and_ps(instant, one));
+
+            auto result = _mm_add_ps(_mm_loadu_ps(start + i), _mm_mul_ps(_mm_loadu_ps(delta + i), ease<E>(t)));
+            _mm_storeu_ps(value + i, result);
+
+            auto done = _mm_movemask_ps(_mm_cmpge_ps(t, one));
+            if (done != 0)
+            {
+                for (auto lane=0; lane<4; ++lane)
+                {
+                    if (done & (1 << lane))
+                    {
+                        tweens.finished.push_back(i + lane);
+                    }
+                }
+            }
+        }
+#endif
+        for (; i < count; ++i)
+        {
+            time[i] += dt;
+            auto t = inverseDuration[i] > 0.0f ? time[i] * inverseDuration[i] : (time[i] >= 0.0f ? 1.0f : 0.0f);
+            t = t < 0.0f ? 0.0f : t > 1.0f ? 1.0f : t;
+            value[i] = start[i] + delta[i] * ease<E>(t);
+            if (t >= 1.0f)
+            {
+                tweens.finished.push_back(i);
+            }
+        }
+
+        auto targets = tweens.targets.data();
+        for (i = 0; i < count; ++i)
+        {
+            *targets[i] = value[i];
+        }
+
+        // Finished tweens land exactly on their end value, then leave the
+        // active arrays, the highest index first so the others stay put.
+        for (auto index = tweens.finished.rbegin(); index != tweens.finished.rend(); ++index)
+        {
+            *tweens.targets[*index] = tweens.end[*index];
+            remove(tweens, *index);
+        }
+    }
+
+    void remove(Tweens& tweens, int index)
+    {
+        auto last = static_cast<int>(tweens.ids.size()) - 1;
+        auto id = tweens.ids[index];
+        locations[id].index = -1;
+        generations[id] += 1;
+        freeIds.push_back(id);
+
+        if (index != last)
+        {
+            tweens.start[index] = tweens.start[last];
+            tweens.delta[index] = tweens.delta[last];
+            tweens.end[index] = tweens.end[last];
+            tweens.time[index] = tweens.time[last];
+            tweens.inverseDuration[index] = tweens.inverseDuration[last];
+            tweens.value[index] = tweens.value[last];
+            tweens.targets[index] = tweens.targets[last];
+            tweens.ids[index] = tweens.ids[last];
+            locations[tweens.ids[index]].index = index;
+        }
+
+        tweens.start.pop_back();
+        tweens.delta.pop_back();
+        tweens.end.pop_back();
+        tweens.time.pop_back();
+        tweens.inverseDuration.pop_back();
+        tweens.value.pop_back();
+        tweens.targets.pop_back();
+        tweens.ids.pop_back();
+    }
+};
+
+//-----------------------------------------------------------------------------
+// [SECTION] Clip - Public declarations and basic types
+//-----------------------------------------------------------------------------
+
+enum PetitAnim::Clip::TrackType : int
+{
+    POSITION            = 0,    // x, y
+    ROTATION            = 1,    // degrees
+    SCALE               = 2,    // scale_x, scale_y
+    COLOR               = 3,    // r, g, b, a from 0 to 255
+    FRAME               = 4     // s, t, p, q, width, height, never interpolated
+};
+
+enum PetitAnim::Clip::Interpolation : int
+{
+    STEP                = 0,
+    LINEAR              = 1
+};
+
+// Playback state of one instance, clips are shared and never written. The
+// cursor of a track remembers the last key used so playing forward does not
+// search the keys again.
+struct PetitAnim::Clip::Player
+{
+    static constexpr int MAX_TRACKS = 8;
+
+    float           time                = 0.0f;
+    float           speed               = 1.0f;
+    bool            loop                = true;
+    int             cursors[MAX_TRACKS] = { 0 };
+};
@@ -0,0 +1,518 @@
+#include "petitgeom.h"
+
+#include <cmath>
+#include <string>
+#include <cstring>
+#include <utility>
+#include <unordered_map>
+
+#ifdef _DEBUG
+#  include <cstdio>
+#  define DEBUG(...) printf(__VA_ARGS__)
+#else
+#  define DEBUG(...)
+#endif
+
+#define MAX_CURVE_SEGMENTS              1024
+#define MIN_TOLERANCE                   1e-4f
+#define PI                              3.14159265f
+
+namespace PetitGeom
+{
+
+//-----------------------------------------------------------------------------
+// [SECTION] PetitGeom - Private declarations and basic types
+//-----------------------------------------------------------------------------
+
+enum Kind : int
+{
+    KIND_CIRCLE         = 0,
+    KIND_ARC            = 1,
+    KIND_ROUNDED_RECT   = 2,
+    KIND_POLYGON        = 3,
+    KIND_QUADRATIC      = 4,
+    KIND_CUBIC          = 5
+};
+
+// Keys are the raw bytes of the kind and every parameter, points included, so
+// equal parameters always find the same mesh. The key buffer is reused, a hit
+// does not allocate.
+struct Cache
+{
+    std::unordered_map<std::string, Mesh*>  meshes;
+    std::string                             key;
+};
+
+struct Context
+{
+    std::vector<Petit2D::Shape::Vertex>     vertices;
+    std::vector<unsigned int>               indices;
+} g_context;
+
+//-----------------------------------------------------------------------------
+// [SECTION] PetitGeom - Private functions
+//-----------------------------------------------------------------------------
+
+int getArcSegments(float radius, float angle, float tolerance)
+{
+    // Largest step whose chord stays within tolerance of the arc.
+    radius = std::fabs(radius);
+    if (tolerance < MIN_TOLERANCE)
+    {
+        tolerance = MIN_TOLERANCE;
+    }
+
+    if (radius <= tolerance)
+    {
+        return 1;
+    }
+
+    auto step = 2.0f * std::acos(1.0f - tolerance / radius);
+    auto segments = static_cast<int>(std::ceil(std::fabs(angle) / step));
+    return segments < 1 ? 1 : (segments > MAX_CURVE_SEGMENTS ? MAX_CURVE_SEGMENTS : segments);
+}
+
+int getCurveSegments(float bound, float tolerance)
+{
+    // Wang's formula: bound is the largest second difference of the control
+    // points scaled by the degree, the error of n segments is bound / (8 n^2).
+    if (tolerance < MIN_TOLERANCE)
+    {
+        tolerance = MIN_TOLERANCE;
+    }
+
+    auto segments = static_cast<int>(std::ceil(std::sqrt(bound / (8.0f * tolerance))));
+    return segments < 1 ? 1 : (segments > MAX_CURVE_SEGMENTS ? MAX_CURVE_SEGMENTS : segments);
+}
+
+void addArc(std::vector<Point>& points, float cx, float cy, float radius, float start, float end, int segments)
+{
+    for (auto i=0; i<=segments; ++i)
+    {
+        auto angle = start + (end - start) * i / segments;
+        points.push_back({ cx + std::cos(angle) * radius, cy + std::sin(angle) * radius });
+    }
+}
+
+void fan(Mesh& mesh)
+{
+    auto count = static_cast<unsigned int>(mesh.points.size());
+    for (unsigned int i=1; i+1<count; ++i)
+    {
+        mesh.indices.insert(mesh.indices.end(), { 0, i, i + 1 });
+    }
+}
+
+float cross(const Point& a, const Point& b, const Point& c)
+{
+    return (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+}
+
+void orient(Mesh& mesh)
+{
+    // Front faces with the default culling and y down projection turn clockwise
+    // on screen, a negative cross product in world space.
+    auto& indices = mesh.indices;
+    for (size_t i=0; i+2<indices.size(); i+=3)
+    {
+        if (cross(mesh.points[indices[i]], mesh.points[indices[i + 1]], mesh.points[indices[i + 2]]) > 0.0f)
+        {
+            std::swap(indices[i + 1], indices[i + 2]);
+        }
+    }
+}
+
+bool contains(const Point& a, const Point& b, const Point& c, const Point& p)
+{
+    // Counter clockwise triangle, points on an edge count as inside.
+    return cross(a, b, p) >= 0.0f && cross(b, c, p) >= 0.0f && cross(c, a, p) >= 0.0f;
+}
+
+bool triangulate(const std::vector<Point>& points, std::vector<unsigned int>& indices)
+{
+    // Ear clipping, O(n^2). Works on a counter clockwise ring of indices and
+    // drops collinear vertices when no ear is left.
+    auto count = static_cast<int>(points.size());
+    auto area = 0.0f;
+    for (auto i=0, j=count-1; i<count; j=i++)
+    {
+        area += points[j].x * points[i].y - points[i].x * points[j].y;
+    }
+
+    if (area == 0.0f)
+    {
+        return false;
+    }
+
+    std::vector<unsigned int> ring(count);
+    for (auto i=0; i<count; ++i)
+    {
+        ring[i] = area > 0.0f ? i : count - 1 - i;
+    }
+
+    while (ring.size() > 3)
+    {
+        auto size = static_cast<int>(ring.size());
+        auto ear = -1;
+        auto flat = -1;
+        for (auto i=0; i<size && ear < 0; ++i)
+        {
+            const auto& a = points[ring[(i + size - 1) % size]];
+            const auto& b = points[ring[i]];
+            const auto& c = points[ring[(i + 1) % size]];
+            auto turn = cross(a, b, c);
+            if (turn <= 0.0f)
+            {
+                flat = turn == 0.0f ? i : flat;
+                continue;
+            }
+
+            auto empty = true;
+            for (auto j=0; j<size && empty; ++j)
+            {
+                if (j == i || j == (i + size - 1) % size || j == (i + 1) % size)
+                {
+                    continue;
+                }
+
+                const auto& p = points[ring[j]];
+                if (p.x == b.x && p.y == b.y)
+                {
+                    continue;
+                }
+                empty = !contains(a, b, c, p);
+            }
+
+            ear = empty ? i : ear;
+        }
+
+        if (ear >= 0)
+        {
+            indices.insert(indices.end(), { ring[(ear + size - 1) % size], ring[ear], ring[(ear + 1) % size] });
+            ring.erase(ring.begin() + ear);
+        }
+        else if (flat >= 0)
+        {
+            ring.erase(ring.begin() + flat);
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    if (cross(points[ring[0]], points[ring[1]], points[ring[2]]) != 0.0f)
+    {
+        indices.insert(indices.end(), { ring[0], ring[1], ring[2] });
+    }
+    return true;
+}
+
+template<typename... T>
+void makeKey(Cache* cache, Kind kind, T... values)
+{
+    const float floats[] = { static_cast<float>(values)... };
+    cache->key.assign(reinterpret_cast<const char*>(&kind), sizeof(kind));
+    cache->key.append(reinterpret_cast<const char*>(floats), sizeof(floats));
+}
+
+template<typename Builder>
+const Mesh* findMesh(Cache* cache, Builder build)
+{
+    auto it = cache->meshes.find(cache->key);
+    if (it != cache->meshes.end())
+    {
+        return it->second;
+    }
+
+    auto mesh = new Mesh();
+    build(*mesh);
+    cache->meshes.emplace(cache->key, mesh);
+    return mesh;
+}
+
+void transformMesh(const Mesh* mesh, const Transform& transform, unsigned char r, unsigned char g, unsigned char b, unsigned char a)
+{
+    // Same rotation as the sprite vertex shader.
+    auto radians = transform.rotation * PI / 180.0f;
+    auto c = std::cos(radians);
+    auto s = std::sin(radians);
+
+    auto& vertices = g_context.vertices;
+    vertices.resize(mesh->points.size());
+    for (size_t i=0; i<mesh->points.size(); ++i)
+    {
+        auto x = mesh->points[i].x * transform.scale_x;
+        auto y = mesh->points[i].y * transform.scale_y;
+
+        auto& vertex = vertices[i];
+        vertex.x = transform.x + c * x + s * y;
+        vertex.y = transform.y - s * x + c * y;
+        vertex.r = r;
+        vertex.g = g;
+        vertex.b = b;
+        vertex.a = a;
+    }
+}
+
+//-----------------------------------------------------------------------------
+// [SECTION] PetitGeom - End-user API functions
+//-----------------------------------------------------------------------------
+
+void BuildCircle(Mesh& mesh, float radius, float tolerance)
+{
+    mesh = Mesh();
+
+    auto segments = getArcSegments(radius, 2.0f * PI, tolerance);
+    segments = segments < 3 ? 3 : segments;
+    addArc(mesh.points, 0.0f, 0.0f, radius, 0.0f, 2.0f * PI, segments);
+    mesh.points.pop_back();
+    fan(mesh);
+    orient(mesh);
+}
+
+void BuildArc(Mesh& mesh, float innerRadius, float outerRadius, float startAngle, float endAngle, float tolerance)
+{
+    mesh = Mesh();
+
+    auto start = startAngle * PI / 180.0f;
+    auto end = endAngle * PI / 180.0f;
+    auto segments = getArcSegments(outerRadius, end - start, tolerance);
+
+    if (innerRadius <= 0.0f)
+    {
+        // Pie slice, fanned from the center.
+        mesh.points.push_back({ 0.0f, 0.0f });
+        addArc(mesh.points, 0.0f, 0.0f, outerRadius, start, end, segments);
+        fan(mesh);
+        orient(mesh);
+        return;
+    }
+
+    // Band: the outer arc forward then the inner arc backward, quads in between.
+    addArc(mesh.points, 0.0f, 0.0f, outerRadius, start, end, segments);
+    addArc(mesh.points, 0.0f, 0.0f, innerRadius, end, start, segments);
+
+    auto last = static_cast<unsigned int>(mesh.points.size()) - 1;
+    for (unsigned int i=0; i<static_cast<unsigned int>(segments); ++i)
+    {
+        auto outer = i;
+        auto inner = last - i;
+        mesh.indices.insert(mesh.indices.end(), { outer, outer + 1, inner, inner, outer + 1, inner - 1 });
+    }
+    orient(mesh);
+}
+
+void BuildRoundedRect(Mesh& mesh, float width, float height, float radius, float tolerance)
+{
+    mesh = Mesh();
+
+    auto halfWidth = width * 0.5f;
+    auto halfHeight = height * 0.5f;
+    auto limit = halfWidth < halfHeight ? halfWidth : halfHeight;
+    radius = radius < 0.0f ? 0.0f : (radius > limit ? limit : radius);
+
+    if (radius <= 0.0f)
+    {
+        mesh.points = { { -halfWidth, -halfHeight }, { halfWidth, -halfHeight }, { halfWidth, halfHeight }, { -halfWidth, halfHeight } };
+        fan(mesh);
+        orient(mesh);
+        return;
+    }
+
+    // One quarter arc per corner, convex so a fan covers it.
+    auto segments = getArcSegments(radius, PI * 0.5f, tolerance);
+    auto x = halfWidth - radius;
+    auto y = halfHeight - radius;
+    addArc(mesh.points, x, y, radius, 0.0f, PI * 0.5f, segments);
+    addArc(mesh.points, -x, y, radius, PI * 0.5f, PI, segments);
+    addArc(mesh.points, -x, -y, radius, PI, PI * 1.5f, segments);
+    addArc(mesh.points, x, -y, radius, PI * 1.5f, PI * 2.0f, segments);
+    fan(mesh);
+    orient(mesh);
+}
+
+bool BuildPolygon(Mesh& mesh, const Point* points, int count)
+{
+    mesh = Mesh();
+    if (points == nullptr || count < 3)
+    {
+        return false;
+    }
+
+    mesh.points.assign(points, points + count);
+    if (!triangulate(mesh.points, mesh.indices))
+    {
+        DEBUG("Polygon with %d points could not be triangulated\n", count);
+        mesh.indices.clear();
+        return false;
+    }
+
+    orient(mesh);
+    return true;
+}
+
+void BuildQuadratic(Mesh& mesh, const Point& p0, const Point& p1, const Point& p2, float tolerance)
+{
+    mesh = Mesh();
+    mesh.closed = false;
+
+    auto dx = p0.x - 2.0f * p1.x + p2.x;
+    auto dy = p0.y - 2.0f * p1.y + p2.y;
+    auto segments = getCurveSegments(2.0f * std::sqrt(dx * dx + dy * dy), tolerance);
+
+    for (auto i=0; i<=segments; ++i)
+    {
+        auto t = static_cast<float>(i) / segments;
+        auto u = 1.0f - t;
+        mesh.points.push_back
+        ({
+            u * u * p0.x + 2.0f * u * t * p1.x + t * t * p2.x,
+            u * u * p0.y + 2.0f * u * t * p1.y + t * t * p2.y
+        });
+    }
+}
+
+void BuildCubic(Mesh& mesh, const Point& p0, const Point& p1, const Point& p2, const Point& p3, float tolerance)
+{
+    mesh = Mesh();
+    mesh.closed = false;
+
+    auto ax = p0.x - 2.0f * p1.x + p2.x;
+    auto ay = p0.y - 2.0f * p1.y + p2.y;
+    auto bx = p1.x - 2.0f * p2.x + p3.x;
+    auto by = p1.y - 2.0f * p2.y + p3.y;
+    auto a = std::sqrt(ax * ax + ay * ay);
+    auto b = std::sqrt(bx * bx + by * by);
+    auto segments = getCurveSegments(6.0f * (a > b ? a : b), tolerance);
+
+    for (auto i=0; i<=segments; ++i)
+    {
+        auto t = static_cast<float>(i) / segments;
+        auto u = 1.0f - t;
+        auto w0 = u * u * u;
+        auto w1 = 3.0f * u * u * t;
+        auto w2 = 3.0f * u * t * t;
+        auto w3 = t * t * t;
+        mesh.points.push_back
+        ({
+            w0 * p0.x + w1 * p1.x + w2 * p2.x + w3 * p3.x,
+            w0 * p0.y + w1 * p1.y + w2 * p2.y + w3 * p3.y
+        });
+    }
+}
+
+Cache* CreateCache()
+{
+    return new Cache();
+}
+
+void DestroyCache(Cache* cache)
+{
+    if (cache != nullptr)
+    {
+        ClearCache(cache);
+        delete(cache);
+        cache = nullptr;
+    }
+}
+
+void ClearCache(Cache* cache)
+{
+    for (auto& entry : cache->meshes)
+    {
+        delete(entry.second);
+    }
+    cache->meshes.clear();
+}
+
+int GetMeshCount(const Cache* cache)
+{
+    return static_cast<int>(cache->meshes.size());
+}
+
+const Mesh* Circle(Cache* cache, float radius, float tolerance)
+{
+    makeKey(cache, KIND_CIRCLE, radius, tolerance);
+    return findMesh(cache, [&](Mesh& mesh) { BuildCircle(mesh, radius, tolerance); });
+}
+
+const Mesh* Arc(Cache* cache, float innerRadius, float outerRadius, float startAngle, float endAngle, float tolerance)
+{
+    makeKey(cache, KIND_ARC, innerRadius, outerRadius, startAngle, endAngle, tolerance);
+    return findMesh(cache, [&](Mesh& mesh) { BuildArc(mesh, innerRadius, outerRadius, startAngle, endAngle, tolerance); });
+}
+
+const Mesh* RoundedRect(Cache* cache, float width, float height, float radius, float tolerance)
+{
+    makeKey(cache, KIND_ROUNDED_RECT, width, height, radius, tolerance);
+    return findMesh(cache, [&](Mesh& mesh) { BuildRoundedRect(mesh, width, height, radius, tolerance); });
+}
+
+const Mesh* Polygon(Cache* cache, const Point* points, int count)
+{
+    if (points == nullptr || count <= 0)
+    {
+        return nullptr;
+    }
+
+    makeKey(cache, KIND_POLYGON, count);
+    cache->key.append(reinterpret_cast<const char*>(points), sizeof(Point) * count);
+    return findMesh(cache, [&](Mesh& mesh) { BuildPolygon(mesh, points, count); });
+}
+
+const Mesh* Quadratic(Cache* cache, const Point& p0, const Point& p1, const Point& p2, float tolerance)
+{
+    makeKey(cache, KIND_QUADRATIC, p0.x, p0.y, p1.x, p1.y, p2.x, p2.y, tolerance);
+    return findMesh(cache, [&](Mesh& mesh) { BuildQuadratic(mesh, p0, p1, p2, tolerance); });
+}
+
+const Mesh* Cubic(Cache* cache, const Point& p0, const Point& p1, const Point& p2, const Point& p3, float tolerance)
+{
+    makeKey(cache, KIND_CUBIC, p0.x, p0.y, p1.x, p1.y, p2.x, p2.y, p3.x, p3.y, tolerance);
+    return findMesh(cache, [&](Mesh& mesh) { BuildCubic(mesh, p0, p1, p2, p3, tolerance); });
+}
+
+void Fill(const Mesh* mesh, const Transform& transform, unsigned char r, unsigned char g, unsigned char b, unsigned char a)
+{
+    if (mesh == nullptr || mesh->indices.empty())
+    {
+        return;
+    }
+
+    transformMesh(mesh, transform, r, g, b, a);
+
+    // A mirroring scale flips the winding, swap it back so culling keeps the mesh.
+    auto indices = mesh->indices.data();
+    if (transform.scale_x * transform.scale_y < 0.0f)
+    {
+        g_context.indices.assign(mesh->indices.begin(), mesh->indices.end());
+        for (size_t i=0; i+2<g_context.indices.size(); i+=3)
+        {
+            std::swap(g_context.indices[i + 1], g_context.indices[i + 2]);
+        }
+        indices = g_context.indices.data();
+    }
+
+    Petit2D::Shape::AddIndexed
+    (
+        g_context.vertices.data(),
+        static_cast<int>(g_context.vertices.size()),
+        indices,
+        static_cast<int>(mesh->indices.size()),
+        Petit2D::Shape::DrawType::TRIANGLES
+    );
+}
+
+void Stroke(const Mesh* mesh, const Transform& transform, float width, unsigned char r, unsigned char g, unsigned char b, unsigned char a)
+{
+    if (mesh == nullptr || mesh->points.size() < 2)
+    {
+        return;
+    }
+
+    transformMesh(mesh, transform, r, g, b, a);
+    Petit2D::Line::AddPolyline(g_context.vertices.data(), static_cast<int>(g_context.vertices.size()), width, mesh->closed);
+}
+
+} // namespace PetitGeom
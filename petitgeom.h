@@ -0,0 +1,81 @@
+#pragma once
+
+#include "petit2d.h"
+
+#include <vector>
+
+namespace PetitGeom
+{
+
+//-----------------------------------------------------------------------------
+// [SECTION] PetitGeom - Forward declarations and basic types
+//-----------------------------------------------------------------------------
+
+struct          Point;
+struct          Mesh;
+struct          Transform;
+struct          Cache;
+
+//-----------------------------------------------------------------------------
+// [SECTION] PetitGeom - End-user API functions
+//-----------------------------------------------------------------------------
+
+// Builders clear the mesh then fill it, in local units. Tolerance is the largest
+// distance allowed between a curve and its segments, in the same units.
+// Circles, arcs and rounded rectangles are centered on the origin, angles are
+// in degrees.
+void            BuildCircle         (Mesh& mesh, float radius, float tolerance = 0.25f);
+void            BuildArc            (Mesh& mesh, float innerRadius, float outerRadius, float startAngle, float endAngle, float tolerance = 0.25f);
+void            BuildRoundedRect    (Mesh& mesh, float width, float height, float radius, float tolerance = 0.25f);
+bool            BuildPolygon        (Mesh& mesh, const Point* points, int count);
+void            BuildQuadratic      (Mesh& mesh, const Point& p0, const Point& p1, const Point& p2, float tolerance = 0.25f);
+void            BuildCubic          (Mesh& mesh, const Point& p0, const Point& p1, const Point& p2, const Point& p3, float tolerance = 0.25f);
+
+// Same shapes built once per set of parameters, the cache owns the meshes and
+// they stay valid until ClearCache or DestroyCache.
+Cache*          CreateCache         ();
+void            DestroyCache        (Cache* cache);
+void            ClearCache          (Cache* cache);
+int             GetMeshCount        (const Cache* cache);
+const Mesh*     Circle              (Cache* cache, float radius, float tolerance = 0.25f);
+const Mesh*     Arc                 (Cache* cache, float innerRadius, float outerRadius, float startAngle, float endAngle, float tolerance = 0.25f);
+const Mesh*     RoundedRect         (Cache* cache, float width, float height, float radius, float tolerance = 0.25f);
+const Mesh*     Polygon             (Cache* cache, const Point* points, int count);
+const Mesh*     Quadratic           (Cache* cache, const Point& p0, const Point& p1, const Point& p2, float tolerance = 0.25f);
+const Mesh*     Cubic               (Cache* cache, const Point& p0, const Point& p1, const Point& p2, const Point& p3, float tolerance = 0.25f);
+
+// Fill goes between Shape::BeginPrimitives and Shape::EndPrimitives, Stroke
+// between Line::Begin and Line::End.
+void            Fill                (const Mesh* mesh, const Transform& transform, unsigned char r = 255, unsigned char g = 255, unsigned char b = 255, unsigned char a = 255);
+void            Stroke              (const Mesh* mesh, const Transform& transform, float width, unsigned char r = 255, unsigned char g = 255, unsigned char b = 255, unsigned char a = 255);
+
+} // namespace PetitGeom
+
+//-----------------------------------------------------------------------------
+// [SECTION] PetitGeom - Public declarations and basic types
+//-----------------------------------------------------------------------------
+
+struct PetitGeom::Point
+{
+    float           x           = 0.0f;
+    float           y           = 0.0f;
+};
+
+// Points run along the outline, triangles index them. Curves have no
+// triangles and an open outline.
+struct PetitGeom::Mesh
+{
+    std::vector<Point>          points;
+    std::vector<unsigned int>   indices;
+    bool                        closed      = true;
+};
+
+// Applied like a sprite: scale, then rotation in degrees, then translation.
+struct PetitGeom::Transform
+{
+    float           x           = 0.0f;
+    float           y           = 0.0f;
+    float           rotation    = 0.0f;
+    float           scale_x     = 1.0f;
+    float           scale_y     = 1.0f;
+};
@@ -0,0 +1,312 @@
+#include "petittask.h"
+
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <condition_variable>
+
+#ifdef _DEBUG
+#  include <cstdio>
+#  define DEBUG(...) printf(__VA_ARGS__)
+#else
+#  define DEBUG(...)
+#endif
+
+#define MAX_WORKER_THREADS              64
+
+namespace PetitTask
+{
+
+//-----------------------------------------------------------------------------
+// [SECTION] PetitTask - Private declarations and basic types
+//-----------------------------------------------------------------------------
+
+struct Group
+{
+    std::atomic<int>    pending     { 0 };
+};
+
+struct Job
+{
+    Task    task;
+    Group*  group   = nullptr;
+};
+
+// Owner pushes and pops at the back, thieves take from the front so they
+// grab the oldest, usually largest, pieces of work.
+struct Queue
+{
+    std::mutex          mutex;
+    std::deque<Job>     jobs;
+};
+
+struct Context
+{
+    std::vector<std::thread>                threads;
+    std::vector<std::unique_ptr<Queue>>     queues;         // one per worker, the last one is shared by outside threads
+    std::atomic<int>                        queued          { 0 };
+    std::atomic<unsigned int>               next            { 0 };
+    std::mutex                              sleepMutex;
+    std::condition_variable                 sleepCondition;
+    bool                                    running         = false;
+    int                                     spinCount       = 0;
+} g_context;
+
+thread_local int t_worker = -1;
+
+void push(Job&& job)
+{
+    auto index = t_worker >= 0 ? t_worker : static_cast<int>(g_context.queues.size()) - 1;
+    auto& queue = *g_context.queues[index];
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.jobs.push_back(std::move(job));
+    }
+
+    // Taking the sleep mutex orders the count against a worker about to wait.
+    g_context.queued.fetch_add(1, std::memory_order_release);
+    {
+        std::lock_guard<std::mutex> lock(g_context.sleepMutex);
+    }
+    g_context.sleepCondition.notify_one();
+}
+
+bool pop(Job& job)
+{
+    auto count = static_cast<int>(g_context.queues.size());
+    if (t_worker >= 0)
+    {
+        auto& queue = *g_context.queues[t_worker];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.jobs.empty())
+        {
+            job = std::move(queue.jobs.back());
+            queue.jobs.pop_back();
+            g_context.queued.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+
+    // Steal, starting from a different victim every time to spread contention.
+    auto start = g_context.next.fetch_add(1, std::memory_order_relaxed);
+    for (auto i=0; i<count; ++i)
+    {
+        auto& queue = *g_context.queues[(start + i) % count];
+        std::unique_lock<std::mutex> lock(queue.mutex, std::try_to_lock);
+        if (lock.owns_lock() && !queue.jobs.empty())
+        {
+            job = std::move(queue.jobs.front());
+            queue.jobs.pop_front();
+            g_context.queued.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void execute(Job& job)
+{
+    job.task();
+    job.group->pending.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+void work(int index)
+{
+    t_worker = index;
+
+    Job job;
+    auto idle = 0;
+    while (true)
+    {
+        if (pop(job))
+        {
+            execute(job);
+            job = Job();
+            idle = 0;
+            continue;
+        }
+
+        idle += 1;
+        if (idle < g_context.spinCount)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(g_context.sleepMutex);
+        g_context.sleepCondition.wait(lock, []
+        {
+            return !g_context.running || g_context.queued.load(std::memory_order_acquire) > 0;
+        });
+
+        if (!g_context.running)
+        {
+            return;
+        }
+        idle = 0;
+    }
+}
+
+//-----------------------------------------------------------------------------
+// [SECTION] PetitTask - End-user API functions
+//-----------------------------------------------------------------------------
+
+void Create()
+{
+    Create(Config());
+}
+
+void Create(const Config& config)
+{
+    if (g_context.running)
+    {
+        DEBUG("PetitTask already created\n");
+        return;
+    }
+
+    auto threads = config.threads;
+    if (threads <= 0)
+    {
+        threads = static_cast<int>(std::thread::hardware_concurrency()) - 1;
+    }
+    if (threads > MAX_WORKER_THREADS)
+    {
+        DEBUG("Worker threads greater than %d, adjusting to %d.\n", MAX_WORKER_THREADS, MAX_WORKER_THREADS);
+        threads = MAX_WORKER_THREADS;
+    }
+    if (threads <= 0)
+    {
+        return;
+    }
+
+    g_context.spinCount = config.spinCount;
+    g_context.running = true;
+    for (auto i=0; i<=threads; ++i)
+    {
+        g_context.queues.push_back(std::unique_ptr<Queue>(new Queue()));
+    }
+
+    for (auto i=0; i<threads; ++i)
+    {
+        g_context.threads.push_back(std::thread(work, i));
+    }
+}
+
+void Destroy()
+{
+    {
+        std::lock_guard<std::mutex> lock(g_context.sleepMutex);
+        g_context.running = false;
+    }
+    g_context.sleepCondition.notify_all();
+
+    for (auto& thread : g_context.threads)
+    {
+        thread.join();
+    }
+
+    g_context.threads.clear();
+    g_context.queues.clear();
+    g_context.queued = 0;
+}
+
+int GetThreadCount()
+{
+    return static_cast<int>(g_context.threads.size());
+}
+
+Group* CreateGroup()
+{
+    return new Group();
+}
+
+void DestroyGroup(Group* group)
+{
+    if (group != nullptr)
+    {
+        Wait(group);
+        delete(group);
+        group = nullptr;
+    }
+}
+
+void Run(Group* group, Task task)
+{
+    if (g_context.threads.empty())
+    {
+        task();
+        return;
+    }
+
+    group->pending.fetch_add(1, std::memory_order_relaxed);
+
+    Job job;
+    job.task = std::move(task);
+    job.group = group;
+    push(std::move(job));
+}
+
+void Wait(Group* group)
+{
+    // The waiting thread runs queued tasks, its own first, so nested waits from
+    // inside tasks make progress instead of blocking a worker.
+    Job job;
+    while (group->pending.load(std::memory_order_acquire) > 0)
+    {
+        if (!g_context.queues.empty() && pop(job))
+        {
+            execute(job);
+            job = Job();
+        }
+        else
+        {
+            std::this_thread::yield();
+        }
+    }
+}
+
+void ParallelFor(int count, int grain, const RangeTask& task)
+{
+    if (count <= 0)
+    {
+        return;
+    }
+
+    if (grain < 1)
+    {
+        grain = 1;
+    }
+
+    // A few chunks per thread leave room for stealing when chunks are uneven.
+    auto threads = GetThreadCount() + 1;
+    auto chunk = (count + threads * 4 - 1) / (threads * 4);
+    if (chunk < grain)
+    {
+        chunk = grain;
+    }
+
+    if (g_context.threads.empty() || chunk >= count)
+    {
+        task(0, count);
+        return;
+    }
+
+    Group group;
+    for (auto begin=chunk; begin<count; begin+=chunk)
+    {
+        auto end = begin + chunk < count ? begin + chunk : count;
+        Run(&group, [&task, begin, end]()
+        {
+            task(begin, end);
+        });
+    }
+
+    task(0, chunk);
+    Wait(&group);
+}
+
+} // namespace PetitTask
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <functional>
+
+namespace PetitTask
+{
+
+//-----------------------------------------------------------------------------
+// [SECTION] PetitTask - Forward declarations and basic types
+//-----------------------------------------------------------------------------
+
+struct          Config;
+struct          Group;
+
+using           Task                = std::function<void()>;
+using           RangeTask           = std::function<void(int begin, int end)>;
+
+//-----------------------------------------------------------------------------
+// [SECTION] PetitTask - End-user API functions
+//-----------------------------------------------------------------------------
+
+// Without Create, or with a single thread, every task runs inline on the
+// calling thread.
+void            Create              ();
+void            Create              (const Config& config);
+void            Destroy             ();
+int             GetThreadCount      ();
+
+Group*          CreateGroup         ();
+void            DestroyGroup        (Group* group);
+void            Run                 (Group* group, Task task);
+void            Wait                (Group* group);
+
+void            ParallelFor         (int count, int grain, const RangeTask& task);
+
+} // namespace PetitTask
+
+//-----------------------------------------------------------------------------
+// [SECTION] PetitTask - Public declarations and basic types
+//-----------------------------------------------------------------------------
+
+struct PetitTask::Config
+{
+    int             threads             = 0;    // Worker threads, 0 picks the core count minus the calling thread
+    int             spinCount           = 2048; // Steal attempts before a worker goes to sleep
+};
@@ -0,0 +1,448 @@
+#include "petittext.h"
+
+#include <list>
+#include <string>
+#include <cstring>
+#include <iterator>
+#include <unordered_map>
+
+#ifdef _DEBUG
+#  include <cstdio>
+#  define DEBUG(...) printf(__VA_ARGS__)
+#else
+#  define DEBUG(...)
+#endif
+
+#define FONT_CELLS                      256
+#define FALLBACK_CODEPOINT              '?'
+#define REPLACEMENT_CODEPOINT           0xFFFDu
+
+namespace PetitText
+{
+
+//-----------------------------------------------------------------------------
+// [SECTION] PetitText - Private declarations and basic types
+//-----------------------------------------------------------------------------
+
+struct Glyph
+{
+    Petit2D::Catalog::SpriteDef     def;
+    float                           advance     = 0.0f;
+};
+
+struct Font
+{
+    Glyph                                       cells[FONT_CELLS];
+    std::unordered_map<unsigned int, Glyph>     glyphs;         // codepoints past the sheet
+    float                                       lineHeight      = 0.0f;
+};
+
+struct Run
+{
+    Petit2D::Sprite::Recorder*  recorder    = nullptr;
+    float                       width       = 0.0f;
+    float                       height      = 0.0f;
+};
+
+// Most recently used runs at the front. Entries keep their run when evicted so
+// a full cache lays out in place without allocating.
+struct Entry
+{
+    std::string     key;
+    Run*            run         = nullptr;
+};
+
+struct Cache
+{
+    std::list<Entry>                                            entries;
+    std::unordered_map<std::string, std::list<Entry>::iterator> index;
+    std::string                                                 key;
+    int                                                         capacity    = 0;
+};
+
+struct Line
+{
+    int             first       = 0;
+    int             last        = 0;    // one past the last glyph
+    float           width       = 0.0f;
+};
+
+struct Context
+{
+    std::vector<unsigned int>               codepoints;
+    std::vector<const Glyph*>               glyphs;
+    std::vector<Line>                       lines;
+    std::vector<Petit2D::Sprite::Sprite>    sprites;
+} g_context;
+
+//-----------------------------------------------------------------------------
+// [SECTION] PetitText - Private functions
+//-----------------------------------------------------------------------------
+
+void decode(const char* text)
+{
+    // Malformed sequences, overlong forms and surrogates become U+FFFD, one per
+    // byte that does not start a valid sequence.
+    g_context.codepoints.clear();
+    auto bytes = reinterpret_cast<const unsigned char*>(text);
+    while (*bytes != 0)
+    {
+        auto lead = *bytes;
+        auto length = lead < 0x80 ? 1 : (lead >> 5) == 0x6 ? 2 : (lead >> 4) == 0xE ? 3 : (lead >> 3) == 0x1E ? 4 : 0;
+        if (length == 0)
+        {
+            g_context.codepoints.push_back(REPLACEMENT_CODEPOINT);
+            bytes += 1;
+            continue;
+        }
+
+        unsigned int codepoint = length == 1 ? lead : lead & (0x7F >> length);
+        auto valid = true;
+        for (auto i=1; i<length && valid; ++i)
+        {
+            valid = (bytes[i] & 0xC0) == 0x80;
+            codepoint = (codepoint << 6) | (bytes[i] & 0x3F);
+        }
+
+        const unsigned int minimums[] = { 0, 0, 0x80, 0x800, 0x10000 };
+        if (!valid || codepoint < minimums[length] || codepoint > 0x10FFFF || (codepoint >= 0xD800 && codepoint <= 0xDFFF))
+        {
+            g_context.codepoints.push_back(REPLACEMENT_CODEPOINT);
+            bytes += 1;
+            continue;
+        }
+
+        g_context.codepoints.push_back(codepoint);
+        bytes += length;
+    }
+}
+
+const Glyph* findGlyph(const Font* font, unsigned int codepoint)
+{
+    if (codepoint < FONT_CELLS)
+    {
+        return &font->cells[codepoint];
+    }
+
+    auto it = font->glyphs.find(codepoint);
+    return it != font->glyphs.end() ? &it->second : &font->cells[FALLBACK_CODEPOINT];
+}
+
+void addLine(int first, int last)
+{
+    // Trailing spaces do not count for alignment.
+    Line line;
+    line.first = first;
+    line.last = first;
+    for (auto i=first; i<last; ++i)
+    {
+        line.width += g_context.glyphs[i]->advance;
+        if (g_context.codepoints[i] != ' ')
+        {
+            line.last = i + 1;
+        }
+    }
+
+    for (auto i=line.last; i<last; ++i)
+    {
+        line.width -= g_context.glyphs[i]->advance;
+    }
+
+    g_context.lines.push_back(line);
+}
+
+void wrap(const Font* font, float maxWidth)
+{
+    // Greedy: a line breaks at its last space once the next glyph overflows, or
+    // in the middle of a word too long to fit on its own.
+    g_context.lines.clear();
+    g_context.glyphs.clear();
+    for (auto codepoint : g_context.codepoints)
+    {
+        g_context.glyphs.push_back(findGlyph(font, codepoint));
+    }
+
+    auto count = static_cast<int>(g_context.codepoints.size());
+    auto first = 0;
+    auto space = -1;
+    auto width = 0.0f;
+    for (auto i=0; i<count; ++i)
+    {
+        auto codepoint = g_context.codepoints[i];
+        if (codepoint == '\n')
+        {
+            addLine(first, i);
+            first = i + 1;
+            space = -1;
+            width = 0.0f;
+            continue;
+        }
+
+        auto advance = g_context.glyphs[i]->advance;
+        if (maxWidth > 0.0f && codepoint != ' ' && i > first && width + advance > maxWidth)
+        {
+            auto next = space >= first ? space + 1 : i;
+            addLine(first, space >= first ? space : i);
+            first = next;
+            space = -1;
+            width = 0.0f;
+            for (auto j=first; j<i; ++j)
+            {
+                width += g_context.glyphs[j]->advance;
+            }
+        }
+
+        if (codepoint == ' ')
+        {
+            space = i;
+        }
+        width += advance;
+    }
+
+    addLine(first, count);
+}
+
+void makeKey(Cache* cache, const Font* font, const char* text, const Style& style)
+{
+    const float floats[] = { style.maxWidth, style.scale };
+    const unsigned char bytes[] = { static_cast<unsigned char>(style.align), style.r, style.g, style.b, style.a };
+    cache->key.assign(reinterpret_cast<const char*>(&font), sizeof(font));
+    cache->key.append(reinterpret_cast<const char*>(floats), sizeof(floats));
+    cache->key.append(reinterpret_cast<const char*>(bytes), sizeof(bytes));
+    cache->key.append(text);
+}
+
+//-----------------------------------------------------------------------------
+// [SECTION] PetitText - End-user API functions
+//-----------------------------------------------------------------------------
+
+Font* CreateFont(const Petit2D::Catalog::SpriteDef& sheet)
+{
+    std::vector<Petit2D::Catalog::SpriteDef> cells;
+    Petit2D::Catalog::PopulateFontGlyphs(cells, sheet);
+
+    auto font = new Font();
+    for (auto i=0; i<FONT_CELLS; ++i)
+    {
+        font->cells[i].def = cells[i];
+        font->cells[i].advance = static_cast<float>(cells[i].width);
+    }
+    font->lineHeight = static_cast<float>(sheet.height / 16);
+    return font;
+}
+
+void DestroyFont(Font* font)
+{
+    if (font != nullptr)
+    {
+        delete(font);
+        font = nullptr;
+    }
+}
+
+void SetGlyph(Font* font, unsigned int codepoint, const Petit2D::Catalog::SpriteDef& glyph, float advance)
+{
+    auto& target = codepoint < FONT_CELLS ? font->cells[codepoint] : font->glyphs[codepoint];
+    target.def = glyph;
+    target.advance = advance;
+}
+
+void SetAdvance(Font* font, unsigned int codepoint, float advance)
+{
+    if (codepoint >= FONT_CELLS && font->glyphs.find(codepoint) == font->glyphs.end())
+    {
+        DEBUG("Glyph not found: U+%04X\n", codepoint);
+        return;
+    }
+
+    auto& target = codepoint < FONT_CELLS ? font->cells[codepoint] : font->glyphs[codepoint];
+    target.advance = advance;
+}
+
+void SetLineHeight(Font* font, float lineHeight)
+{
+    font->lineHeight = lineHeight;
+}
+
+float GetLineHeight(const Font* font)
+{
+    return font->lineHeight;
+}
+
+Run* CreateRun()
+{
+    auto run = new Run();
+    run->recorder = Petit2D::Sprite::CreateRecorder();
+    return run;
+}
+
+void DestroyRun(Run* run)
+{
+    if (run != nullptr)
+    {
+        Petit2D::Sprite::DestroyRecorder(run->recorder);
+        delete(run);
+        run = nullptr;
+    }
+}
+
+void Layout(Run* run, const Font* font, const char* text, const Style& style)
+{
+    Petit2D::Sprite::Clear(run->recorder);
+    run->width = 0.0f;
+    run->height = 0.0f;
+    if (text == nullptr || style.scale <= 0.0f)
+    {
+        return;
+    }
+
+    decode(text);
+    wrap(font, style.maxWidth / style.scale);
+
+    // Advances are in font units until here, scaled once per glyph below.
+    for (const auto& line : g_context.lines)
+    {
+        run->width = line.width > run->width ? line.width : run->width;
+    }
+
+    const float alignments[] = { 0.0f, 0.5f, 1.0f };
+    auto box = style.maxWidth > 0.0f ? style.maxWidth / style.scale : run->width;
+    auto lineTop = 0.0f;
+
+    g_context.sprites.clear();
+    for (const auto& line : g_context.lines)
+    {
+        auto pen = (box - line.width) * alignments[style.align];
+        for (auto i=line.first; i<line.last; ++i)
+        {
+            const auto& glyph = *g_context.glyphs[i];
+            if (g_context.codepoints[i] != ' ' && glyph.def.width > 0)
+            {
+                Petit2D::Sprite::Sprite sprite;
+                sprite.x = (pen + glyph.def.width * 0.5f) * style.scale;
+                sprite.y = (lineTop + glyph.def.height * 0.5f) * style.scale;
+                sprite.width = glyph.def.width;
+                sprite.height = glyph.def.height;
+                sprite.scale_x = style.scale;
+                sprite.scale_y = style.scale;
+                sprite.s = glyph.def.s;
+                sprite.t = glyph.def.t;
+                sprite.p = glyph.def.p;
+                sprite.q = glyph.def.q;
+                sprite.r = style.r;
+                sprite.g = style.g;
+                sprite.b = style.b;
+                sprite.a = style.a;
+                g_context.sprites.push_back(sprite);
+            }
+            pen += glyph.advance;
+        }
+        lineTop += font->lineHeight;
+    }
+
+    Petit2D::Sprite::Record(run->recorder, g_context.sprites.data(), g_context.sprites.size());
+    run->width *= style.scale;
+    run->height = lineTop * style.scale;
+}
+
+float GetWidth(const Run* run)
+{
+    return run->width;
+}
+
+float GetHeight(const Run* run)
+{
+    return run->height;
+}
+
+int GetGlyphCount(const Run* run)
+{
+    return Petit2D::Sprite::GetCount(run->recorder);
+}
+
+void Draw(const Run* run, float x, float y)
+{
+    Petit2D::Sprite::Submit(run->recorder, x, y);
+}
+
+Cache* CreateCache(int capacity)
+{
+    if (capacity < 1)
+    {
+        DEBUG("Text cache capacity less than 1, adjusting to 1.\n");
+        capacity = 1;
+    }
+
+    auto cache = new Cache();
+    cache->capacity = capacity;
+    return cache;
+}
+
+void DestroyCache(Cache* cache)
+{
+    if (cache != nullptr)
+    {
+        ClearCache(cache);
+        delete(cache);
+        cache = nullptr;
+    }
+}
+
+void ClearCache(Cache* cache)
+{
+    for (auto& entry : cache->entries)
+    {
+        DestroyRun(entry.run);
+    }
+    cache->entries.clear();
+    cache->index.clear();
+}
+
+int GetRunCount(const Cache* cache)
+{
+    return static_cast<int>(cache->entries.size());
+}
+
+const Run* Get(Cache* cache, const Font* font, const char* text, const Style& style)
+{
+    if (text == nullptr)
+    {
+        return nullptr;
+    }
+
+    makeKey(cache, font, text, style);
+    auto it = cache->index.find(cache->key);
+    if (it != cache->index.end())
+    {
+        cache->entries.splice(cache->entries.begin(), cache->entries, it->second);
+        return it->second->run;
+    }
+
+    if (static_cast<int>(cache->entries.size()) >= cache->capacity)
+    {
+        cache->index.erase(cache->entries.back().key);
+        cache->entries.splice(cache->entries.begin(), cache->entries, std::prev(cache->entries.end()));
+    }
+    else
+    {
+        cache->entries.emplace_front();
+        cache->entries.front().run = CreateRun();
+    }
+
+    auto& entry = cache->entries.front();
+    entry.key = cache->key;
+    cache->index.emplace(entry.key, cache->entries.begin());
+    Layout(entry.run, font, text, style);
+    return entry.run;
+}
+
+void Draw(Cache* cache, const Font* font, const char* text, float x, float y, const Style& style)
+{
+    auto run = Get(cache, font, text, style);
+    if (run != nullptr)
+    {
+        Draw(run, x, y);
+    }
+}
+
+} // namespace PetitText
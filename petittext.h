@@ -0,0 +1,76 @@
+#pragma once
+
+#include "petit2d.h"
+
+namespace PetitText
+{
+
+//-----------------------------------------------------------------------------
+// [SECTION] PetitText - Forward declarations and basic types
+//-----------------------------------------------------------------------------
+
+struct          Font;
+struct          Style;
+struct          Run;
+struct          Cache;
+
+enum            Align               : int;
+
+//-----------------------------------------------------------------------------
+// [SECTION] PetitText - End-user API functions
+//-----------------------------------------------------------------------------
+
+// Fonts start from a 16x16 cells sheet, cell i is codepoint i and every glyph
+// advances by the cell width. Codepoints past 255 need SetGlyph, missing ones
+// draw as '?'.
+Font*           CreateFont          (const Petit2D::Catalog::SpriteDef& sheet);
+void            DestroyFont         (Font* font);
+void            SetGlyph            (Font* font, unsigned int codepoint, const Petit2D::Catalog::SpriteDef& glyph, float advance);
+void            SetAdvance          (Font* font, unsigned int codepoint, float advance);
+void            SetLineHeight       (Font* font, float lineHeight);
+float           GetLineHeight       (const Font* font);
+
+// Runs hold a UTF-8 string laid out once, as sprite instances relative to its
+// top left corner. Draw copies them to the current sprite batch.
+Run*            CreateRun           ();
+void            DestroyRun          (Run* run);
+void            Layout              (Run* run, const Font* font, const char* text, const Style& style);
+float           GetWidth            (const Run* run);
+float           GetHeight           (const Run* run);
+int             GetGlyphCount       (const Run* run);
+void            Draw                (const Run* run, float x, float y);
+
+// Runs laid out once per font, text and style, the least recently used one is
+// laid out again when the cache is full. ClearCache after changing a font.
+Cache*          CreateCache         (int capacity = 4096);
+void            DestroyCache        (Cache* cache);
+void            ClearCache          (Cache* cache);
+int             GetRunCount         (const Cache* cache);
+const Run*      Get                 (Cache* cache, const Font* font, const char* text, const Style& style);
+void            Draw                (Cache* cache, const Font* font, const char* text, float x, float y, const Style& style);
+
+} // namespace PetitText
+
+//-----------------------------------------------------------------------------
+// [SECTION] PetitText - Public declarations and basic types
+//-----------------------------------------------------------------------------
+
+// Lines are aligned within maxWidth, or within the widest line when there is
+// no wrapping.
+enum PetitText::Align : int
+{
+    ALIGN_LEFT          = 0,
+    ALIGN_CENTER        = 1,
+    ALIGN_RIGHT         = 2
+};
+
+struct PetitText::Style
+{
+    float           maxWidth    = 0.0f;     // Wraps between words past this width, 0 for none
+    Align           align       = ALIGN_LEFT;
+    float           scale       = 1.0f;
+    unsigned char   r           = 255;
+    unsigned char   g           = 255;
+    unsigned char   b           = 255;
+    unsigned char   a           = 255;
+};